@@ -101,6 +101,25 @@ namespace gl
 		{
 			update(data.data(), 0, data.size() * sizeof T);
 		}
+
+		/// \brief reallocates the buffer with more elements. The old content is copied on the gpu.
+		/// The buffer must have been constructed with an element size
+		/// \param elementCount new number of elements. Nothing happens if the buffer is already large enough
+		void reserve(GLsizei elementCount)
+		{
+			assert(m_elementSize);
+			if (elementCount <= m_elementCount)
+				return;
+
+			Buffer tmp(m_elementSize, elementCount);
+			if (m_size)
+			{
+				glBindBuffer(GL_COPY_READ_BUFFER, m_id);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, tmp.m_id);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_size);
+			}
+			*this = std::move(tmp);
+		}
 		
 		void clear()
 		{
@@ -117,7 +136,7 @@ namespace gl
 		}
 
 		template<class T>
-		std::vector<T> getData()
+		std::vector<T> getData() const
 		{
 			std::vector<T> res;
 			res.resize(m_size / sizeof(T));
@@ -230,6 +249,8 @@ namespace gl
 
 	template <GLenum TUsage>
 	using IndirectDrawBufferT = Buffer<GL_DRAW_INDIRECT_BUFFER, TUsage>;
+	using StaticIndirectDrawBuffer = IndirectDrawBufferT<0>;
+	using DynamicIndirectDrawBuffer = IndirectDrawBufferT<GL_DYNAMIC_STORAGE_BIT>;
 
 	template <GLenum TUsage>
 	using TransformFeedbackBuffer = Buffer<GL_TRANSFORM_FEEDBACK_BUFFER, TUsage>;
@@ -81,6 +81,15 @@ namespace gl
 			m_attachments.insert(GL_COLOR_ATTACHMENT0 + index);
 		}
 
+		void attachColor(GLuint index, const Renderbuffer& target)
+		{
+			bind();
+			assert(target.getId());
+			glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + index, GL_RENDERBUFFER, target.getId());
+
+			m_attachments.insert(GL_COLOR_ATTACHMENT0 + index);
+		}
+
 		void detachColor(GLuint index)
 		{
 			bind();
@@ -106,11 +115,32 @@ namespace gl
 			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_id);
 		}
 
+		// binds the default framebuffer
 		static void unbind()
 		{
-			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, defaultId());
+		}
+
+		/**
+		 * \brief replaces the window framebuffer for unbind() (offscreen rendering)
+		 * \param id framebuffer or 0 for the window framebuffer
+		 */
+		static void setDefault(GLuint id)
+		{
+			defaultId() = id;
+		}
+
+		GLuint getId() const
+		{
+			return m_id;
 		}
 	private:
+		static GLuint& defaultId()
+		{
+			static GLuint s_id = 0;
+			return s_id;
+		}
+
 		unique<GLuint> m_id;
 		std::unordered_set<GLenum> m_attachments;
 	};
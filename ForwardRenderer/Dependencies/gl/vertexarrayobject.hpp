@@ -53,6 +53,14 @@ namespace gl
 
 			glVertexAttribBinding(attributeIndex, bindingIndex);
 		}
+
+		/// \brief sets the instance divisor of all attributes of the binding.
+		/// addAttribute() only sets the divisor of the binding with the same index as the attribute
+		void setBindingDivisor(GLuint bindingIndex, GLuint divisor)
+		{
+			bind();
+			glVertexBindingDivisor(bindingIndex, divisor);
+		}
 	private:
 		unique<GLuint> m_id;
 	};
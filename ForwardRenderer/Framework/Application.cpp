@@ -6,6 +6,7 @@
 #include "../ScriptEngine/Token.h"
 #include "../ScriptEngine/ScriptEngine.h"
 #include "Profiler.h"
+#include "ImageMetrics.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../Dependencies/stb_image_write.h"
@@ -20,6 +21,9 @@
 #include "../Renderer/SimpleForwardRenderer.h"
 #include <iostream>
 #include "../Implementations/ObjModel.h"
+#include "../Implementations/ObjCache.h"
+#include "../Implementations/ProceduralScene.h"
+#include "../Graphics/TextureCache.h"
 #include "../Implementations/ProjectionCamera.h"
 #include "../Implementations/SimpleLights.h"
 #include "../Implementations/SimpleTransforms.h"
@@ -29,12 +33,17 @@
 #include "../Renderer/ShadowDebugRenderer.h"
 #include <sstream>
 #include "../Renderer/DebugRenderer.h"
+#include "../Renderer/ReferenceRenderer.h"
+#include "Random.h"
+#include <glm/gtc/matrix_transform.hpp>
 
 std::vector<ITickReceiver*> s_tickReceiver;
 
 static std::string s_rendererName;
 static std::string s_cameraName;
 static std::string s_lightsName;
+// MB of vertices and indices that loadObjAsync uploads per frame
+static int s_uploadBudget = 16;
 
 static std::unique_ptr<IRenderer> makeRenderer(const std::vector<Token>& args)
 {
@@ -57,6 +66,8 @@ static std::unique_ptr<IRenderer> makeRenderer(const std::vector<Token>& args)
 		return std::make_unique<DynamicFragmentBufferRenderer>();
 	if (name == "debug_renderer")
 		return std::make_unique<DebugRenderer>();
+	if (name == "reference")
+		return std::make_unique<ReferenceRenderer>();
 	{
 		const std::regex rgx("adaptive[1-9][0-9]*");
 		if (std::regex_match(name, rgx))
@@ -101,18 +112,12 @@ static std::unique_ptr<ILights> makeLights(const std::vector<Token>& args)
 	throw std::runtime_error("lights not found");
 }
 
-Application::Application()
+Application::Application(bool headless, size_t width, size_t height)
 	:
-	m_window(800, 800, "ForwardRenderer")
+	m_window(width, height, "ForwardRenderer", headless)
 {
 	initScripts();
-
-	// load default shader
-	auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-	auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
-	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs", 430, "#define DISABLE_ENVIRONMENT");
-	m_envmapShader = std::make_unique<SimpleShader>(
-		HotReloadShader::loadProgram({ vertex, geometry, fragment }));
+	loadEnvmapShader();
 
 	m_envmap = std::make_unique<EnvironmentMap>(512);
 	m_lights = std::make_unique<SimpleLights>();
@@ -133,9 +138,30 @@ void Application::tick()
 	for (const auto& r : s_tickReceiver)
 		r->tick(dt);
 
-	if (m_lights && m_shadows && m_model && m_transforms)
+	// the asynchronously loaded model replaces the old one between two frames
+	if (m_loader)
 	{
-		m_lights->upload(*m_shadows, *m_model, *m_transforms);
+		try
+		{
+			if (m_loader->update(size_t(s_uploadBudget) * 1024 * 1024, false))
+			{
+				m_scene.clear();
+				m_scene.addObject(m_loader->release());
+				m_loader.reset();
+				sceneChanged();
+			}
+		}
+		catch (const std::exception& e)
+		{
+			// counted like a failed command, otherwise a headless run would still exit with 0
+			ScriptEngine::reportError("loadObjAsync", e.what());
+			m_loader.reset();
+		}
+	}
+
+	if (m_lights && m_shadows && !m_scene.empty() && m_transforms)
+	{
+		m_lights->upload(*m_shadows, m_scene, *m_transforms);
 	}
 
 	if (m_transforms && m_camera)
@@ -145,7 +171,7 @@ void Application::tick()
 		m_transforms->upload();
 
 	RenderArgs args;
-	args.model = m_model.get();
+	args.model = m_scene.empty() ? nullptr : &m_scene;
 	args.camera = m_camera.get();
 	args.lights = m_lights.get();
 	args.transforms = m_transforms.get();
@@ -164,6 +190,15 @@ void Application::tick()
 
 	m_window.swapBuffer();
 
+	// the exported profile history describes every frame with the active settings
+	Profiler::setInfo("renderer", s_rendererName);
+	Profiler::setInfo("width", std::to_string(Window::getWidth()));
+	Profiler::setInfo("height", std::to_string(Window::getHeight()));
+	Profiler::setInfo("camera", s_cameraName);
+	Profiler::setInfo("lights", s_lightsName);
+	Profiler::setInfo("geometryShader", std::to_string(IRenderer::s_useGeometryShader));
+	Profiler::endFrame(ScriptEngine::getIteration());
+
 	// adjust window title
 	auto profile = Profiler::getActive();
 	std::ostringstream ss;
@@ -171,12 +206,25 @@ void Application::tick()
 		" iterations: " << ScriptEngine::getIteration();
 	if (ScriptEngine::getWaitIteration())
 		ss << " wait: " << ScriptEngine::getWaitIteration();
+	if (m_loader)
+		ss << " loading: " << int(m_loader->getProgress() * 100.0f) << "%";
 	m_window.setTitle(ss.str());
 }
 
+void Application::loadEnvmapShader()
+{
+	auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
+	auto geometry = IRenderer::loadGeometryShader();
+	// the environment map is rendered rarely, therefore opaque and cutout shapes share the alpha tested shader
+	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs", 430, "#define DISABLE_ENVIRONMENT\n#define ALPHA_TEST");
+	m_envmapShader = std::make_unique<SimpleShader>(
+		HotReloadShader::loadProgram({ vertex, geometry, fragment }));
+}
+
 bool Application::isRunning() const
 {
-	return m_window.isOpen();
+	// a screenshot of the same script batch is written before quitting
+	return m_window.isOpen() && !(m_quit && !hasPendingScreenshot());
 }
 
 void Application::registerTickReceiver(ITickReceiver* recv)
@@ -219,6 +267,23 @@ void Application::initScripts()
 		s_cameraName = args[0].getString();
 	});
 
+	// old flat normal path for comparisons. Models keep their missing normals if the geometry shader is active during loadObj
+	ScriptEngine::addProperty("geometryShader", []()
+	{
+		return std::to_string(IRenderer::s_useGeometryShader);
+	}, [this](const std::vector<Token>& args)
+	{
+		IRenderer::s_useGeometryShader = args.at(0).getBool();
+		loadEnvmapShader();
+
+		// rebuild the programs of the active renderer
+		if (this->m_renderer)
+		{
+			this->m_renderer = makeRenderer({ Token(Token::Type::IDENTIFIER, s_rendererName) });
+			this->m_renderer->init();
+		}
+	});
+
 	ScriptEngine::addProperty("lights", []()
 	{
 		return s_lightsName;
@@ -233,7 +298,159 @@ void Application::initScripts()
 		if (args.empty())
 			throw std::runtime_error("filename missing");
 
-		m_model = std::make_unique<ObjModel>(args[0].getString());
+		// the optional second argument selects the quantized vertex format
+		m_loader.reset();
+		m_scene.clear();
+		m_scene.addObject(std::make_unique<ObjModel>(args[0].getString(), args.size() >= 2 && args[1].getBool()));
+		sceneChanged();
+		return "";
+	});
+
+	// same arguments as loadObj. Adds the model to the scene and returns its object index
+	ScriptEngine::addFunction("addObj", [this](const std::vector<Token>& args)
+	{
+		if (args.empty())
+			throw std::runtime_error("filename missing");
+
+		const auto index = m_scene.addObject(std::make_unique<ObjModel>(args[0].getString(), args.size() >= 2 && args[1].getBool()));
+		sceneChanged();
+		return std::to_string(index);
+	});
+
+	ScriptEngine::addFunction("removeObject", [this](const std::vector<Token>& args)
+	{
+		m_scene.removeObject(size_t(args.at(0).getInt()));
+		sceneChanged();
+		return "";
+	});
+
+	// the object is scaled, rotated (degrees around the y axis) and translated
+	ScriptEngine::addFunction("setObjectTransform", [this](const std::vector<Token>& args)
+	{
+		if (args.size() < 4)
+			throw std::runtime_error("expected index, posX, posY, posZ [, scale [, rotationY]]");
+
+		auto m = glm::translate(glm::mat4(1.0f), glm::vec3(args.at(1).getFloat(), args.at(2).getFloat(), args.at(3).getFloat()));
+		if (args.size() >= 6)
+			m = glm::rotate(m, glm::radians(args.at(5).getFloat()), glm::vec3(0.0f, 1.0f, 0.0f));
+		if (args.size() >= 5)
+			m = glm::scale(m, glm::vec3(args.at(4).getFloat()));
+
+		m_scene.setTransform(size_t(args.at(0).getInt()), m);
+		sceneChanged();
+		return "";
+	});
+
+	// replaces the scene with a generated transparent stress scene around the origin (see ProceduralScene)
+	ScriptEngine::addFunction("generateScene", [this](const std::vector<Token>& args)
+	{
+		if (args.empty())
+			throw std::runtime_error("expected type [, count [, alpha [, alphaSpread [, size [, subdivisions [, seed]]]]]]");
+
+		ProceduralScene::Params params;
+		params.type = ProceduralScene::parseType(args[0].getString());
+		if (args.size() >= 2) params.count = args[1].getInt();
+		if (args.size() >= 3) params.alpha = args[2].getFloat();
+		if (args.size() >= 4) params.alphaSpread = args[3].getFloat();
+		if (args.size() >= 5) params.size = args[4].getFloat();
+		if (args.size() >= 6) params.subdivisions = args[5].getInt();
+		if (args.size() >= 7) params.seed = uint32_t(args[6].getInt());
+
+		m_loader.reset();
+		m_scene.clear();
+		m_scene.addObject(std::make_unique<ObjModel>(ProceduralScene::generate(params), args[0].getString()));
+		sceneChanged();
+		return "";
+	});
+
+	ScriptEngine::addProperty("numObjects", [this]()
+	{
+		return std::to_string(m_scene.getNumObjects());
+	});
+
+	// same arguments as loadObj (the streamingWindow is not used). The current model is rendered until the new one is complete
+	ScriptEngine::addFunction("loadObjAsync", [this](const std::vector<Token>& args)
+	{
+		if (args.empty())
+			throw std::runtime_error("filename missing");
+
+		m_loader = std::make_unique<ObjModel::Loader>(args[0].getString(), args.size() >= 2 && args[1].getBool());
+		return "";
+	});
+
+	// the following script commands are executed after loadObjAsync finished
+	ScriptEngine::addFunction("waitLoading", [this](const std::vector<Token>& args)
+	{
+		ScriptEngine::waitUntil([this]()
+		{
+			return !m_loader;
+		});
+		return "";
+	});
+
+	ScriptEngine::addProperty("loadingProgress", [this]()
+	{
+		return std::to_string(m_loader ? m_loader->getProgress() : 1.0f);
+	});
+
+	ScriptEngine::addProperty("uploadBudget", []()
+	{
+		return std::to_string(s_uploadBudget);
+	}, [](const std::vector<Token>& args)
+	{
+		s_uploadBudget = std::max(args.at(0).getInt(), 1);
+	});
+
+	// draws count instances of every object with random positions inside a sphere around the scene center,
+	// random rotations around the y axis and random uniform scales. The default radius keeps the density of the instances constant
+	ScriptEngine::addFunction("scatter", [this](const std::vector<Token>& args)
+	{
+		if (m_scene.empty()) throw std::runtime_error("no model active");
+		if (args.empty())
+			throw std::runtime_error("expected count [, radius [, minScale, maxScale [, seed]]]");
+		const auto count = args.at(0).getInt();
+		if (count < 1)
+			throw std::runtime_error("at least one instance required");
+
+		// bounding box of a single instance
+		m_scene.setInstances({ glm::mat4(1.0f) });
+		const auto center = (m_scene.getBoundingMin() + m_scene.getBoundingMax()) * 0.5f;
+		const auto diagonal = glm::length(m_scene.getBoundingMax() - m_scene.getBoundingMin());
+
+		const auto radius = args.size() >= 2 ? args.at(1).getFloat() : 0.5f * diagonal * std::cbrt(float(count));
+		const auto minScale = args.size() >= 3 ? args.at(2).getFloat() : 1.0f;
+		const auto maxScale = args.size() >= 4 ? args.at(3).getFloat() : minScale;
+		// the same seed gives the same instances with every standard library
+		Random random(args.size() >= 5 ? uint32_t(args.at(4).getInt()) : 0u);
+
+		std::vector<glm::mat4> transforms;
+		transforms.reserve(count);
+		while (transforms.size() < size_t(count))
+		{
+			// separate statements (the evaluation order of constructor arguments is unspecified)
+			glm::vec3 offset;
+			offset.x = random.next(-1.0f, 1.0f);
+			offset.y = random.next(-1.0f, 1.0f);
+			offset.z = random.next(-1.0f, 1.0f);
+			if (glm::dot(offset, offset) > 1.0f)
+				continue;
+
+			// rotate and scale around the model center
+			auto m = glm::translate(glm::mat4(1.0f), center + offset * radius);
+			m = glm::rotate(m, random.next(0.0f, 2.0f * glm::pi<float>()), glm::vec3(0.0f, 1.0f, 0.0f));
+			m = glm::scale(m, glm::vec3(random.next(minScale, maxScale)));
+			transforms.push_back(glm::translate(m, -center));
+		}
+		m_scene.setInstances(transforms);
+		sceneChanged();
+		return "";
+	});
+
+	// ends the application after the current iteration (or after the pending screenshot). The optional argument is the exit code of the process
+	ScriptEngine::addFunction("quit", [this](const std::vector<Token>& args)
+	{
+		m_exitCode = args.empty() ? 0 : args[0].getInt();
+		m_quit = true;
 		return "";
 	});
 
@@ -320,7 +537,7 @@ void Application::initScripts()
 
 	ScriptEngine::addFunction("refreshEnvironment", [this](const std::vector<Token>& args)
 	{
-		if (!(m_model && m_envmapShader && m_camera && m_transforms && m_lights && m_shadows))
+		if (m_scene.empty() || !(m_envmapShader && m_camera && m_transforms && m_lights && m_shadows))
 			throw std::runtime_error("model, camera, lights, shadows and transforms must be loaded for envmaps");
 
 		glm::vec3 pos;
@@ -336,7 +553,7 @@ void Application::initScripts()
 		}
 		else throw std::runtime_error("either 0 or 3 arguments expected for environment map");
 		
-		m_lights->upload(*m_shadows, *m_model, *m_transforms);
+		m_lights->upload(*m_shadows, m_scene, *m_transforms);
 		m_transforms->update(*m_camera);
 		m_transforms->upload();
 
@@ -344,15 +561,60 @@ void Application::initScripts()
 		m_shadows->bind();
 
 		std::cerr << "rendering environment map\n";
-		m_envmap->render(*m_model, *m_envmapShader, *m_camera, *m_transforms, pos);
+		m_envmap->render(m_scene, *m_envmapShader, *m_camera, *m_transforms, pos);
 
 		return "";
 	});
 
+	// material index [, object index]
 	ScriptEngine::addFunction("getMaterialName", [this](const std::vector<Token>& args)
 	{
-		if (!m_model) throw std::runtime_error("no model active");
-		return m_model->getMaterial().getMaterial(args.at(0).getInt()).get("name", std::string("<no name>"));
+		if (m_scene.empty()) throw std::runtime_error("no model active");
+		const auto& object = m_scene.getObject(args.size() >= 2 ? size_t(args.at(1).getInt()) : 0);
+		return object.getMaterial().getMaterial(args.at(0).getInt()).get("name", std::string("<no name>"));
+	});
+
+	ScriptEngine::addFunction("pick", [this](const std::vector<Token>& args)
+	{
+		Bvh::Hit hit;
+		if (!m_scene.getBvh().intersect(getPixelRay(args), hit))
+			return std::string("nothing hit");
+
+		const auto& shape = *m_scene.getShapes().at(hit.shape);
+		return "shape " + std::to_string(hit.shape) + (shape.isTransparent() ? " (transparent)" : "")
+			+ " triangle " + std::to_string(hit.triangle) + " depth " + std::to_string(hit.t);
+	});
+
+	ScriptEngine::addFunction("depthComplexity", [this](const std::vector<Token>& args)
+	{
+		// number of surfaces between the near and the far plane
+		std::vector<Bvh::Hit> hits;
+		return std::to_string(m_scene.getBvh().intersectAll(getPixelRay(args), hits));
+	});
+
+	// [max triangles per node]. Depth range of the visible nodes and their average screen overlap (estimated depth complexity)
+	ScriptEngine::addFunction("depthRanges", [this](const std::vector<Token>& args)
+	{
+		if (m_scene.empty() || !m_camera)
+			throw std::runtime_error("model and camera must be loaded for depth ranges");
+
+		const auto maxTriangles = args.empty() ? 256 : std::max(args[0].getInt(), 1);
+		std::vector<Bvh::NodeRange> ranges;
+		m_scene.getBvh().getDepthRanges(m_camera->getProjection(), uint32_t(maxTriangles), ranges);
+		if (ranges.empty())
+			return std::string("nothing visible");
+
+		float minDepth = 1.0f, maxDepth = 0.0f, area = 0.0f;
+		for (const auto& r : ranges)
+		{
+			minDepth = std::min(minDepth, r.minDepth);
+			maxDepth = std::max(maxDepth, r.maxDepth);
+			const auto size = r.ndcMax - r.ndcMin;
+			area += size.x * size.y;
+		}
+		// the ndc square has the area 4
+		return "nodes " + std::to_string(ranges.size()) + " depth " + std::to_string(minDepth) + " - " + std::to_string(maxDepth)
+			+ " overlap " + std::to_string(area / 4.0f);
 	});
 
 	ScriptEngine::addKeyword("forward");
@@ -365,9 +627,39 @@ void Application::initScripts()
 	ScriptEngine::addKeyword("environment");
 	ScriptEngine::addKeyword("shadow_map");
 	ScriptEngine::addKeyword("debug_renderer");
+	ScriptEngine::addKeyword("reference");
 
 	ICamera::initScripts();
 	IRenderer::initScripts();
+	ObjCache::initScripts();
+	TextureCache::initScripts();
+	ObjModel::initScripts();
+	ImageMetrics::initScripts();
+}
+
+void Application::sceneChanged()
+{
+	// the shadow maps are rendered again with the next frame
+	if (m_lights)
+		m_lights->invalidate();
+}
+
+Ray Application::getPixelRay(const std::vector<Token>& args) const
+{
+	if (m_scene.empty() || !m_camera)
+		throw std::runtime_error("model and camera must be loaded for ray queries");
+
+	// window coordinates with the origin at the top left (like the cursor). The default is the window center
+	glm::vec2 pixel(float(Window::getWidth()) * 0.5f, float(Window::getHeight()) * 0.5f);
+	if (args.size() >= 2)
+		pixel = glm::vec2(args.at(0).getFloat() + 0.5f, args.at(1).getFloat() + 0.5f);
+	else if (!args.empty())
+		throw std::runtime_error("expected no arguments or x, y");
+
+	const glm::vec2 ndc(
+		pixel.x / float(Window::getWidth()) * 2.0f - 1.0f,
+		1.0f - pixel.y / float(Window::getHeight()) * 2.0f);
+	return Ray::fromNdc(m_camera->getProjection(), ndc);
 }
 
 void Application::makeScreenshot(const std::string& filename)
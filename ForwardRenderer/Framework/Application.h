@@ -6,16 +6,33 @@
 #include "../Graphics/IShader.h"
 #include "../Graphics/ICamera.h"
 #include "../Graphics/ILights.h"
+#include "../Implementations/ObjModel.h"
+#include "../Implementations/Scene.h"
 
 class ITickReceiver;
+class Token;
 
 class Application
 {
 public:
-	Application();
+	/**
+	 * \param headless renders into an offscreen framebuffer of the window size without showing the window
+	 */
+	explicit Application(bool headless = false, size_t width = 800, size_t height = 800);
 	void tick();
 
+	// false after the window was closed or the quit script function was called (and the pending screenshot was written)
 	bool isRunning() const;
+	// true if makeScreenshot was called and the image will be written during the next tick
+	bool hasPendingScreenshot() const
+	{
+		return !m_screenshotDestination.empty();
+	}
+	// exit code of the quit script function
+	int getExitCode() const
+	{
+		return m_exitCode;
+	}
 
 	static void registerTickReceiver(ITickReceiver* recv);
 	static void unregisterTickReceiver(ITickReceiver* recv);
@@ -24,10 +41,17 @@ private:
 	static void makeScreenshot(const std::string& filename);
 	static void makeDiff(const std::string& src1, const std::string& src2, const std::string& dst, float factor);
 	void initScripts();
+	void loadEnvmapShader();
+	// call after the objects or transformations of the scene changed
+	void sceneChanged();
+	// camera ray through the pixel of the script arguments
+	Ray getPixelRay(const std::vector<Token>& args) const;
 private:
 	Window m_window;
 	std::unique_ptr<IRenderer> m_renderer;
-	std::unique_ptr<IModel> m_model;
+	Scene m_scene;
+	// model of loadObjAsync that replaces the scene once it is complete
+	std::unique_ptr<ObjModel::Loader> m_loader;
 	std::unique_ptr<ICamera> m_camera;
 	std::unique_ptr<ILights> m_lights;
 	std::unique_ptr<ITransforms> m_transforms;
@@ -36,4 +60,6 @@ private:
 	std::unique_ptr<IShadows> m_shadows;
 	bool m_recalcEnvironment = true;
 	std::string m_screenshotDestination;
+	bool m_quit = false;
+	int m_exitCode = 0;
 };
@@ -1,10 +1,13 @@
 #include "AsynchInput.h"
+
+static std::vector<std::string> s_keywords;
+
+#ifdef _WIN32
 #include <Windows.h>
 
 static HANDLE s_inHandle = nullptr;
 static HANDLE s_outHandle = nullptr;
 
-static std::vector<std::string> s_keywords;
 static decltype(s_keywords)::iterator s_lastAutoComplete = s_keywords.end();
 static std::string s_lastCompleteWord;
 
@@ -194,3 +197,20 @@ void AsynchInput::setKeywords(std::vector<std::string> keywords)
 	s_keywords = keywords;
 	s_lastAutoComplete = s_keywords.end();
 }
+#else
+// the console input uses the windows console api. Other platforms are controlled by script files only
+
+std::string AsynchInput::get()
+{
+	return "";
+}
+
+void AsynchInput::init()
+{
+}
+
+void AsynchInput::setKeywords(std::vector<std::string> keywords)
+{
+	s_keywords = std::move(keywords);
+}
+#endif
@@ -2,6 +2,7 @@
 #include <string>
 #include <iostream>
 #include <future>
+#include <vector>
 
 class AsynchInput
 {
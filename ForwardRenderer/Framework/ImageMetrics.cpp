@@ -0,0 +1,509 @@
+#include "ImageMetrics.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "../ScriptEngine/ScriptEngine.h"
+#include "../Dependencies/stbi_helper.h"
+#include "../Dependencies/stb_image_write.h"
+#include <glm/glm.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <limits>
+#include <iostream>
+
+namespace
+{
+	using Plane = std::vector<float>;
+
+	const float PI = 3.14159265f;
+	// rows that are processed by one task
+	const size_t ROW_GRAIN = 8;
+
+	void checkSize(const ImageMetrics::Image& a, const ImageMetrics::Image& b)
+	{
+		if (a.width != b.width || a.height != b.height)
+			throw std::runtime_error("the images have not the same dimensions");
+		if (!a.size())
+			throw std::runtime_error("the images are empty");
+	}
+
+	// sum of func(row) over all rows. The partial sums are added in row order (deterministic)
+	template<class F>
+	double sumRows(int height, F func)
+	{
+		std::vector<double> rows(size_t(height), 0.0);
+		ThreadPool::get().parallelFor(0, size_t(height), [&](size_t y)
+		{
+			rows[y] = func(y);
+		}, ROW_GRAIN);
+		return std::accumulate(rows.begin(), rows.end(), 0.0);
+	}
+
+	// normalized gaussian with the radius ceil(3 sigma)
+	std::vector<float> gaussianKernel(float sigma)
+	{
+		const auto radius = std::max(int(std::ceil(3.0f * sigma)), 1);
+		std::vector<float> res(size_t(2 * radius + 1));
+		for (int i = -radius; i <= radius; ++i)
+			res[size_t(i + radius)] = std::exp(-float(i * i) / (2.0f * sigma * sigma));
+		const auto sum = std::accumulate(res.begin(), res.end(), 0.0f);
+		for (auto& w : res)
+			w /= sum;
+		return res;
+	}
+
+	// first or second derivative of a gaussian. The positive weights sum to one and the negative weights to minus one
+	std::vector<float> derivativeKernel(float sigma, int order)
+	{
+		const auto radius = std::max(int(std::ceil(3.0f * sigma)), 1);
+		std::vector<float> res(size_t(2 * radius + 1));
+		for (int i = -radius; i <= radius; ++i)
+		{
+			const auto x = float(i);
+			const auto g = std::exp(-x * x / (2.0f * sigma * sigma));
+			res[size_t(i + radius)] = order == 1 ? -x * g : (x * x / (sigma * sigma) - 1.0f) * g;
+		}
+		float positive = 0.0f, negative = 0.0f;
+		for (auto w : res)
+			(w > 0.0f ? positive : negative) += w;
+		for (auto& w : res)
+			w /= w > 0.0f ? positive : -negative;
+		return res;
+	}
+
+	/**
+	 * \brief separable convolution with clamped borders. Each row is padded once, therefore the inner loops
+	 * over x only multiply and add contiguous floats
+	 */
+	Plane convolve(const Plane& src, int width, int height, const std::vector<float>& kernelX, const std::vector<float>& kernelY)
+	{
+		const auto rx = int(kernelX.size() / 2);
+		const auto ry = int(kernelY.size() / 2);
+		const auto w = size_t(width);
+		Plane temp(src.size());
+		Plane res(src.size());
+
+		ThreadPool::get().parallelFor(0, size_t(height), [&](size_t y)
+		{
+			std::vector<float> padded(w + 2 * size_t(rx));
+			const auto* row = &src[y * w];
+			std::fill_n(padded.begin(), rx, row[0]);
+			std::copy(row, row + w, padded.begin() + rx);
+			std::fill_n(padded.begin() + rx + w, rx, row[w - 1]);
+
+			auto* dst = &temp[y * w];
+			std::fill_n(dst, w, 0.0f);
+			for (size_t k = 0; k < kernelX.size(); ++k)
+			{
+				const auto weight = kernelX[k];
+				const auto* p = &padded[k];
+				for (size_t x = 0; x < w; ++x)
+					dst[x] += weight * p[x];
+			}
+		}, ROW_GRAIN);
+
+		ThreadPool::get().parallelFor(0, size_t(height), [&](size_t y)
+		{
+			auto* dst = &res[y * w];
+			std::fill_n(dst, w, 0.0f);
+			for (int k = -ry; k <= ry; ++k)
+			{
+				const auto weight = kernelY[size_t(k + ry)];
+				const auto* p = &temp[size_t(glm::clamp(int(y) + k, 0, height - 1)) * w];
+				for (size_t x = 0; x < w; ++x)
+					dst[x] += weight * p[x];
+			}
+		}, ROW_GRAIN);
+		return res;
+	}
+
+	// luminance of the srgb values (weights of Rec. 601 like most ssim implementations)
+	Plane luminance(const ImageMetrics::Image& img)
+	{
+		Plane res(img.size());
+		const auto& r = img.planes[0];
+		const auto& g = img.planes[1];
+		const auto& b = img.planes[2];
+		for (size_t i = 0; i < res.size(); ++i)
+			res[i] = 0.299f * r[i] + 0.587f * g[i] + 0.114f * b[i];
+		return res;
+	}
+
+	// color conversions of FLIP (srgb primaries, D65 white)
+	float srgbToLinear(float c)
+	{
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	glm::vec3 linearRgbToXyz(const glm::vec3& c)
+	{
+		return glm::vec3(
+			0.4124564f * c.r + 0.3575761f * c.g + 0.1804375f * c.b,
+			0.2126729f * c.r + 0.7151522f * c.g + 0.0721750f * c.b,
+			0.0193339f * c.r + 0.1191920f * c.g + 0.9503041f * c.b);
+	}
+
+	glm::vec3 xyzToLinearRgb(const glm::vec3& c)
+	{
+		return glm::vec3(
+			3.2404542f * c.x - 1.5371385f * c.y - 0.4985314f * c.z,
+			-0.9692660f * c.x + 1.8760108f * c.y + 0.0415560f * c.z,
+			0.0556434f * c.x - 0.2040259f * c.y + 1.0572252f * c.z);
+	}
+
+	const glm::vec3 WHITE = linearRgbToXyz(glm::vec3(1.0f));
+
+	// linearized cielab (opponent space for the contrast sensitivity filters)
+	glm::vec3 xyzToYCxCz(const glm::vec3& c)
+	{
+		const auto n = c / WHITE;
+		return glm::vec3(116.0f * n.y - 16.0f, 500.0f * (n.x - n.y), 200.0f * (n.y - n.z));
+	}
+
+	glm::vec3 yCxCzToXyz(const glm::vec3& c)
+	{
+		const auto y = (c.x + 16.0f) / 116.0f;
+		return glm::vec3(c.y / 500.0f + y, y, y - c.z / 200.0f) * WHITE;
+	}
+
+	// cielab with the hunt adjustment of the chromatic channels
+	glm::vec3 linearRgbToHuntLab(const glm::vec3& rgb)
+	{
+		const auto f = [](float t)
+		{
+			const auto delta = 6.0f / 29.0f;
+			return t > delta * delta * delta ? std::cbrt(t) : t / (3.0f * delta * delta) + 4.0f / 29.0f;
+		};
+		const auto n = linearRgbToXyz(rgb) / WHITE;
+		const auto l = 116.0f * f(n.y) - 16.0f;
+		const auto a = 500.0f * (f(n.x) - f(n.y));
+		const auto b = 200.0f * (f(n.y) - f(n.z));
+		return glm::vec3(l, 0.01f * l * a, 0.01f * l * b);
+	}
+
+	float hyab(const glm::vec3& a, const glm::vec3& b)
+	{
+		const auto d = a - b;
+		return std::abs(d.x) + std::sqrt(d.y * d.y + d.z * d.z);
+	}
+
+	struct FlipPlanes
+	{
+		// contrast sensitivity filtered color in hunt adjusted cielab
+		std::array<Plane, 3> lab;
+		// edge and point feature magnitudes of the luminance
+		Plane edges;
+		Plane points;
+	};
+
+	FlipPlanes flipPlanes(const ImageMetrics::Image& img, float pixelsPerDegree)
+	{
+		const auto size = img.size();
+		std::array<Plane, 3> opponent;
+		for (auto& p : opponent)
+			p.resize(size);
+		Plane gray(size);
+		ThreadPool::get().parallelFor(0, size, [&](size_t i)
+		{
+			const auto xyz = linearRgbToXyz(glm::vec3(srgbToLinear(img.planes[0][i]), srgbToLinear(img.planes[1][i]), srgbToLinear(img.planes[2][i])));
+			const auto c = xyzToYCxCz(xyz);
+			for (int k = 0; k < 3; ++k)
+				opponent[k][i] = c[k];
+			gray[i] = (c.x + 16.0f) / 116.0f;
+		}, 4096);
+
+		// contrast sensitivity functions as sums of gaussians in degrees (a, b of FLIP). The variance of exp(-pi^2 x^2 / b) is b / (2 pi^2)
+		const auto sigma = [pixelsPerDegree](float b)
+		{
+			return std::sqrt(b / (2.0f * PI * PI)) * pixelsPerDegree;
+		};
+		const auto blur = [&](const Plane& p, float b)
+		{
+			const auto kernel = gaussianKernel(sigma(b));
+			return convolve(p, img.width, img.height, kernel, kernel);
+		};
+		opponent[0] = blur(opponent[0], 0.0047f);
+		opponent[1] = blur(opponent[1], 0.0053f);
+		{
+			// blue-yellow: two gaussians weighted by their integrals a * sqrt(b / pi)
+			const auto w1 = 34.1f * std::sqrt(0.04f / PI);
+			const auto w2 = 13.5f * std::sqrt(0.025f / PI);
+			const auto g1 = blur(opponent[2], 0.04f);
+			const auto g2 = blur(opponent[2], 0.025f);
+			for (size_t i = 0; i < size; ++i)
+				opponent[2][i] = (w1 * g1[i] + w2 * g2[i]) / (w1 + w2);
+		}
+
+		FlipPlanes res;
+		for (auto& p : res.lab)
+			p.resize(size);
+		ThreadPool::get().parallelFor(0, size, [&](size_t i)
+		{
+			const auto rgb = glm::clamp(xyzToLinearRgb(yCxCzToXyz(glm::vec3(opponent[0][i], opponent[1][i], opponent[2][i]))), 0.0f, 1.0f);
+			const auto lab = linearRgbToHuntLab(rgb);
+			for (int k = 0; k < 3; ++k)
+				res.lab[k][i] = lab[k];
+		}, 4096);
+
+		const auto featureSigma = 0.5f * 0.082f * pixelsPerDegree;
+		const auto g = gaussianKernel(featureSigma);
+		const auto d1 = derivativeKernel(featureSigma, 1);
+		const auto d2 = derivativeKernel(featureSigma, 2);
+		const auto edgeX = convolve(gray, img.width, img.height, d1, g);
+		const auto edgeY = convolve(gray, img.width, img.height, g, d1);
+		const auto pointX = convolve(gray, img.width, img.height, d2, g);
+		const auto pointY = convolve(gray, img.width, img.height, g, d2);
+		res.edges.resize(size);
+		res.points.resize(size);
+		for (size_t i = 0; i < size; ++i)
+		{
+			res.edges[i] = std::sqrt(edgeX[i] * edgeX[i] + edgeY[i] * edgeY[i]);
+			res.points[i] = std::sqrt(pointX[i] * pointX[i] + pointY[i] * pointY[i]);
+		}
+		return res;
+	}
+
+	ImageMetrics::Image loadArgument(const std::vector<Token>& args, size_t index)
+	{
+		return ImageMetrics::load(args.at(index).getString());
+	}
+
+	// returns the value for the script and keeps it as profile for recordTime
+	std::string setResult(const std::string& name, double value)
+	{
+		Profiler::set(name, value);
+		return std::to_string(value);
+	}
+}
+
+ImageMetrics::Image ImageMetrics::load(const std::string& filename)
+{
+	int width = 0, height = 0, channels = 0;
+	stbi_set_flip_vertically_on_load(0);
+	stbi_ptr pixels(stbi_load(filename.c_str(), &width, &height, &channels, 3));
+	if (!pixels)
+		throw std::runtime_error("could not open " + filename);
+
+	Image res;
+	res.width = width;
+	res.height = height;
+	for (auto& p : res.planes)
+		p.resize(res.size());
+	const auto* data = pixels.get();
+	ThreadPool::get().parallelFor(0, size_t(height), [&](size_t y)
+	{
+		for (size_t x = 0, i = y * size_t(width); x < size_t(width); ++x, ++i)
+			for (int c = 0; c < 3; ++c)
+				res.planes[c][i] = float(data[i * 3 + c]) / 255.0f;
+	}, ROW_GRAIN);
+	return res;
+}
+
+double ImageMetrics::mse(const Image& a, const Image& b)
+{
+	checkSize(a, b);
+	const auto w = size_t(a.width);
+	const auto sum = sumRows(a.height, [&](size_t y)
+	{
+		double rowSum = 0.0;
+		for (int c = 0; c < 3; ++c)
+		{
+			const auto* pa = &a.planes[c][y * w];
+			const auto* pb = &b.planes[c][y * w];
+			float s = 0.0f;
+			for (size_t x = 0; x < w; ++x)
+				s += (pa[x] - pb[x]) * (pa[x] - pb[x]);
+			rowSum += double(s);
+		}
+		return rowSum;
+	});
+	return sum / double(a.size() * 3);
+}
+
+double ImageMetrics::psnr(const Image& a, const Image& b)
+{
+	const auto error = mse(a, b);
+	if (error <= 0.0)
+		return std::numeric_limits<double>::infinity();
+	return 10.0 * std::log10(1.0 / error);
+}
+
+float ImageMetrics::maxError(const Image& a, const Image& b)
+{
+	checkSize(a, b);
+	const auto w = size_t(a.width);
+	std::vector<float> rows(size_t(a.height), 0.0f);
+	ThreadPool::get().parallelFor(0, size_t(a.height), [&](size_t y)
+	{
+		float m = 0.0f;
+		for (int c = 0; c < 3; ++c)
+		{
+			const auto* pa = &a.planes[c][y * w];
+			const auto* pb = &b.planes[c][y * w];
+			for (size_t x = 0; x < w; ++x)
+				m = std::max(m, std::abs(pa[x] - pb[x]));
+		}
+		rows[y] = m;
+	}, ROW_GRAIN);
+	return *std::max_element(rows.begin(), rows.end());
+}
+
+double ImageMetrics::ssim(const Image& a, const Image& b)
+{
+	checkSize(a, b);
+	const auto size = a.size();
+	const auto y1 = luminance(a);
+	const auto y2 = luminance(b);
+	Plane y11(size), y22(size), y12(size);
+	for (size_t i = 0; i < size; ++i)
+	{
+		y11[i] = y1[i] * y1[i];
+		y22[i] = y2[i] * y2[i];
+		y12[i] = y1[i] * y2[i];
+	}
+
+	// local statistics in a gaussian window
+	const auto kernel = gaussianKernel(1.5f);
+	const auto mu1 = convolve(y1, a.width, a.height, kernel, kernel);
+	const auto mu2 = convolve(y2, a.width, a.height, kernel, kernel);
+	const auto s11 = convolve(y11, a.width, a.height, kernel, kernel);
+	const auto s22 = convolve(y22, a.width, a.height, kernel, kernel);
+	const auto s12 = convolve(y12, a.width, a.height, kernel, kernel);
+
+	const auto c1 = 0.01f * 0.01f;
+	const auto c2 = 0.03f * 0.03f;
+	const auto w = size_t(a.width);
+	const auto sum = sumRows(a.height, [&](size_t y)
+	{
+		float s = 0.0f;
+		for (size_t x = 0, i = y * w; x < w; ++x, ++i)
+		{
+			const auto m12 = mu1[i] * mu2[i];
+			const auto m11 = mu1[i] * mu1[i];
+			const auto m22 = mu2[i] * mu2[i];
+			s += (2.0f * m12 + c1) * (2.0f * (s12[i] - m12) + c2) /
+				((m11 + m22 + c1) * ((s11[i] - m11) + (s22[i] - m22) + c2));
+		}
+		return double(s);
+	});
+	return sum / double(size);
+}
+
+std::vector<float> ImageMetrics::flip(const Image& reference, const Image& test, float pixelsPerDegree)
+{
+	checkSize(reference, test);
+	if (pixelsPerDegree <= 0.0f)
+		throw std::runtime_error("ImageMetrics::flip pixels per degree must be positive");
+
+	const auto r = flipPlanes(reference, pixelsPerDegree);
+	const auto t = flipPlanes(test, pixelsPerDegree);
+
+	// the color difference is remapped with the largest difference (green to blue)
+	const auto qc = 0.7f, pc = 0.4f, pt = 0.95f, qf = 0.5f;
+	const auto cmax = std::pow(hyab(linearRgbToHuntLab(glm::vec3(0.0f, 1.0f, 0.0f)), linearRgbToHuntLab(glm::vec3(0.0f, 0.0f, 1.0f))), qc);
+
+	std::vector<float> res(reference.size());
+	const auto w = size_t(reference.width);
+	ThreadPool::get().parallelFor(0, size_t(reference.height), [&](size_t y)
+	{
+		for (size_t x = 0, i = y * w; x < w; ++x, ++i)
+		{
+			const auto d = std::pow(hyab(glm::vec3(r.lab[0][i], r.lab[1][i], r.lab[2][i]), glm::vec3(t.lab[0][i], t.lab[1][i], t.lab[2][i])), qc);
+			const auto color = d < pc * cmax ? pt / (pc * cmax) * d : pt + (d - pc * cmax) / (cmax - pc * cmax) * (1.0f - pt);
+			const auto feature = std::pow(std::max(std::abs(r.edges[i] - t.edges[i]), std::abs(r.points[i] - t.points[i])) / std::sqrt(2.0f), qf);
+			res[i] = std::pow(glm::clamp(color, 0.0f, 1.0f), 1.0f - glm::clamp(feature, 0.0f, 1.0f));
+		}
+	}, ROW_GRAIN);
+	return res;
+}
+
+std::vector<size_t> ImageMetrics::errorHistogram(const Image& a, const Image& b, int numBins)
+{
+	checkSize(a, b);
+	if (numBins < 1)
+		throw std::runtime_error("ImageMetrics::errorHistogram requires at least one bin");
+
+	// one histogram per row that are added afterwards
+	const auto w = size_t(a.width);
+	const auto bins = size_t(numBins);
+	std::vector<size_t> rows(size_t(a.height) * bins, 0);
+	ThreadPool::get().parallelFor(0, size_t(a.height), [&](size_t y)
+	{
+		for (size_t x = 0, i = y * w; x < w; ++x, ++i)
+		{
+			float e = 0.0f;
+			for (int c = 0; c < 3; ++c)
+				e = std::max(e, std::abs(a.planes[c][i] - b.planes[c][i]));
+			++rows[y * bins + std::min(size_t(e * float(numBins)), bins - 1)];
+		}
+	}, ROW_GRAIN);
+
+	std::vector<size_t> res(bins, 0);
+	for (size_t y = 0; y < size_t(a.height); ++y)
+		for (size_t i = 0; i < bins; ++i)
+			res[i] += rows[y * bins + i];
+	return res;
+}
+
+void ImageMetrics::initScripts()
+{
+	ScriptEngine::addFunction("computeMSE", [](const std::vector<Token>& args)
+	{
+		if (args.size() < 2)
+			throw std::runtime_error("expected image1, image2");
+		return setResult("mse", mse(loadArgument(args, 0), loadArgument(args, 1)));
+	});
+	ScriptEngine::addFunction("computePSNR", [](const std::vector<Token>& args)
+	{
+		if (args.size() < 2)
+			throw std::runtime_error("expected image1, image2");
+		return setResult("psnr", psnr(loadArgument(args, 0), loadArgument(args, 1)));
+	});
+	ScriptEngine::addFunction("computeMaxError", [](const std::vector<Token>& args)
+	{
+		if (args.size() < 2)
+			throw std::runtime_error("expected image1, image2");
+		return setResult("max_error", maxError(loadArgument(args, 0), loadArgument(args, 1)));
+	});
+	ScriptEngine::addFunction("computeSSIM", [](const std::vector<Token>& args)
+	{
+		if (args.size() < 2)
+			throw std::runtime_error("expected image1, image2");
+		return setResult("ssim", ssim(loadArgument(args, 0), loadArgument(args, 1)));
+	});
+	ScriptEngine::addFunction("computeFLIP", [](const std::vector<Token>& args)
+	{
+		if (args.size() < 2)
+			throw std::runtime_error("expected reference, test [, pixelsPerDegree [, errorMap]]");
+		const auto reference = loadArgument(args, 0);
+		const auto errors = flip(reference, loadArgument(args, 1), args.size() >= 3 ? args.at(2).getFloat() : 67.0f);
+
+		if (args.size() >= 4)
+		{
+			std::vector<uint8_t> map(errors.size());
+			std::transform(errors.begin(), errors.end(), map.begin(), [](float e)
+			{
+				return uint8_t(e * 255.0f + 0.5f);
+			});
+			stbi_flip_vertically_on_write(0);
+			if (!stbi_write_png(args.at(3).getString().c_str(), reference.width, reference.height, 1, map.data(), 0))
+				std::cerr << "could not save error map\n";
+		}
+		return setResult("flip", std::accumulate(errors.begin(), errors.end(), 0.0) / double(errors.size()));
+	});
+	ScriptEngine::addFunction("errorHistogram", [](const std::vector<Token>& args)
+	{
+		if (args.size() < 2)
+			throw std::runtime_error("expected image1, image2 [, bins]");
+		const auto numBins = args.size() >= 3 ? args.at(2).getInt() : 10;
+		const auto histogram = errorHistogram(loadArgument(args, 0), loadArgument(args, 1), numBins);
+
+		// one line per bin with the error range in 8 bit steps
+		std::string res;
+		for (size_t i = 0; i < histogram.size(); ++i)
+			res += std::to_string(int(255.0f * float(i) / float(numBins))) + "-" + std::to_string(int(255.0f * float(i + 1) / float(numBins)))
+				+ ": " + std::to_string(histogram[i]) + "\n";
+		return res;
+	});
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <array>
+
+/**
+ * \brief comparison of rendered images with a reference (for example a screenshot of the reference renderer).
+ * The images are stored as float planes and all kernels process rows of contiguous floats, split across the thread pool.
+ * The script functions return the metric and set a profile with the same name, so that it can be recorded with recordTime.
+ */
+class ImageMetrics
+{
+	ImageMetrics() = default;
+public:
+	// srgb color planes with values in [0, 1] (top row first)
+	struct Image
+	{
+		int width = 0;
+		int height = 0;
+		std::array<std::vector<float>, 3> planes;
+
+		size_t size() const
+		{
+			return size_t(width) * size_t(height);
+		}
+	};
+
+	/**
+	 * \brief loads the rgb channels of an image file
+	 * \throws runtime_error if the file could not be loaded
+	 */
+	static Image load(const std::string& filename);
+
+	// mean squared error over all channels
+	static double mse(const Image& a, const Image& b);
+	// peak signal to noise ratio in dB (infinite for equal images)
+	static double psnr(const Image& a, const Image& b);
+	// largest absolute channel difference
+	static float maxError(const Image& a, const Image& b);
+	// mean structural similarity of the luminance (11x11 gaussian window with sigma 1.5)
+	static double ssim(const Image& a, const Image& b);
+
+	/**
+	 * \brief per pixel error of the FLIP metric for low dynamic range images (Andersson et al. 2020).
+	 * The color difference of the contrast sensitivity filtered images is raised to the power of one minus the edge and point feature difference
+	 * \param pixelsPerDegree observer distance (67 is a 0.7m distance to a 24 inch monitor with 1920 pixels)
+	 * \return errors in [0, 1]
+	 */
+	static std::vector<float> flip(const Image& reference, const Image& test, float pixelsPerDegree = 67.0f);
+
+	/**
+	 * \brief number of pixels per error range. The error of a pixel is its largest absolute channel difference
+	 * \param numBins bins of equal width in [0, 1]
+	 */
+	static std::vector<size_t> errorHistogram(const Image& a, const Image& b, int numBins);
+
+	static void initScripts();
+};
@@ -0,0 +1,96 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		throw std::runtime_error("could not open " + filename);
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		CloseHandle(m_file);
+		throw std::runtime_error("could not determine size of " + filename);
+	}
+	m_size = size_t(size.QuadPart);
+	// empty files cannot be mapped
+	if (m_size == 0) return;
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping)
+	{
+		CloseHandle(m_file);
+		throw std::runtime_error("could not map " + filename);
+	}
+
+	m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data)
+	{
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+		throw std::runtime_error("could not map view of " + filename);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	m_file = open(filename.c_str(), O_RDONLY);
+	if (m_file < 0)
+		throw std::runtime_error("could not open " + filename);
+
+	struct stat info{};
+	if (fstat(m_file, &info) != 0)
+	{
+		close(m_file);
+		throw std::runtime_error("could not determine size of " + filename);
+	}
+	m_size = size_t(info.st_size);
+	// empty files cannot be mapped
+	if (m_size == 0) return;
+
+	auto ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (ptr == MAP_FAILED)
+	{
+		close(m_file);
+		throw std::runtime_error("could not map " + filename);
+	}
+	madvise(ptr, m_size, MADV_SEQUENTIAL);
+	m_data = static_cast<const uint8_t*>(ptr);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data)
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+	if (m_file >= 0)
+		close(m_file);
+}
+
+#endif
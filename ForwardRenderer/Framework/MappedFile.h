@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+/**
+ * \brief read only memory mapping of a file. The file stays mapped until the object is destroyed
+ */
+class MappedFile
+{
+public:
+	/**
+	 * \brief maps the whole file into the address space
+	 * \param filename file that should be mapped
+	 * \throws runtime_error if the file could not be opened or mapped
+	 */
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const uint8_t* data() const { return m_data; }
+	size_t size() const { return m_size; }
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_file = -1;
+#endif
+};
@@ -3,6 +3,11 @@
 #include <unordered_map>
 #include <iostream>
 #include <numeric>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <fstream>
+#include <algorithm>
 
 static std::unordered_map<std::string, Profiler::Profile> m_profiles;
 static std::string s_activeProfile = "time";
@@ -10,6 +15,92 @@ static std::string s_activeType = "latest";
 // helper to create a list
 static std::string s_profileList;
 
+struct HistorySample
+{
+	size_t frame;
+	// index into s_infos
+	size_t info;
+	double value;
+};
+
+// ring buffer with the latest samples of a profile
+struct History
+{
+	std::vector<HistorySample> samples;
+	// oldest sample if the buffer is full
+	size_t next = 0;
+	// frame of the newest sample
+	size_t lastFrame = Profiler::Profile::NO_FRAME;
+
+	void push(const HistorySample& sample, size_t capacity)
+	{
+		lastFrame = sample.frame;
+		if (samples.size() < capacity)
+		{
+			samples.push_back(sample);
+			return;
+		}
+		samples[next] = sample;
+		next = (next + 1) % samples.size();
+	}
+	// calls func for all samples from old to new
+	template<class F>
+	void forEach(F func) const
+	{
+		for (size_t i = 0; i < samples.size(); ++i)
+			func(samples[(next + i) % samples.size()]);
+	}
+};
+
+static int s_historySize = 4096;
+static std::unordered_map<std::string, History> s_history;
+// profiles that were set since the last frame
+static std::unordered_set<std::string> s_updated;
+// descriptions of the frames (renderer, resolution and parameters)
+static std::map<std::string, std::string> s_info;
+static std::vector<std::map<std::string, std::string>> s_infos;
+static bool s_infoChanged = true;
+
+static void clearHistory()
+{
+	s_history.clear();
+	s_updated.clear();
+	s_infos.clear();
+	s_infoChanged = true;
+}
+
+static std::string escapeCsv(const std::string& s)
+{
+	if (s.find_first_of(",\"\n") == std::string::npos)
+		return s;
+	std::string res = "\"";
+	for (auto c : s)
+	{
+		if (c == '"') res += '"';
+		res += c;
+	}
+	return res + "\"";
+}
+
+static std::string escapeJson(const std::string& s)
+{
+	std::string res = "\"";
+	for (auto c : s)
+	{
+		if (c == '"' || c == '\\') res += '\\';
+		if (c == '\n') res += "\\n";
+		else res += c;
+	}
+	return res + "\"";
+}
+
+static void writeJsonValue(std::ostream& o, double value)
+{
+	// json has no infinity (e.g. psnr of equal images)
+	if (std::isfinite(value)) o << value;
+	else o << "null";
+}
+
 void Profiler::init()
 {
 	ScriptEngine::addProperty("profiler", []() {return s_activeProfile; }, [](const std::vector<Token>& args)
@@ -55,11 +146,12 @@ void Profiler::init()
 	ScriptEngine::addProperty("profileType", []() {return s_activeType; }, [](const std::vector<Token>& args)
 	{
 		if (args.empty())
-			throw std::runtime_error("profile type missing. Use min, max, average or latest");
+			throw std::runtime_error("profile type missing. Use min, max, average, median, stddev, latest or a percentile like p99");
 		auto val = args[0].getString();
-		if (val == "min" || val == "max" || val == "latest" || val == "average" || val == "median")
+		double percent;
+		if (val == "min" || val == "max" || val == "latest" || val == "average" || val == "median" || val == "stddev" || Profile::parsePercentile(val, percent))
 			s_activeType = val;
-		else std::cerr << "type must be min, max, average, median or latest\n";
+		else std::cerr << "type must be min, max, average, median, stddev, latest or a percentile in [0, 100] like p99.9\n";
 	});
 
 	ScriptEngine::addFunction("recordTime", [](const std::vector<Token>& args)
@@ -85,6 +177,34 @@ void Profiler::init()
 	{
 		return s_profileList;
 	});
+
+	ScriptEngine::addProperty("profileHistory", []() {return std::to_string(s_historySize); }, [](const std::vector<Token>& args)
+	{
+		if (args.empty())
+			throw std::runtime_error("number of frames missing");
+		s_historySize = std::max(args[0].getInt(), 1);
+		// the ring buffers start again with the new size
+		clearHistory();
+	});
+	ScriptEngine::addFunction("profileInfo", [](const std::vector<Token>& args)
+	{
+		if (args.size() < 2)
+			throw std::runtime_error("expected key, value");
+		setInfo(args[0].getString(), args[1].getString());
+		return "";
+	});
+	ScriptEngine::addFunction("clearProfileHistory", [](const std::vector<Token>&)
+	{
+		clearHistory();
+		return "";
+	});
+	ScriptEngine::addFunction("exportProfiles", [](const std::vector<Token>& args)
+	{
+		if (args.empty())
+			throw std::runtime_error("filename missing");
+		exportHistory(args[0].getString());
+		return "";
+	});
 }
 
 void Profiler::reset()
@@ -95,6 +215,12 @@ void Profiler::reset()
 void Profiler::set(const std::string& name, Profile time)
 {
 	m_profiles[name] = time;
+	s_updated.insert(name);
+}
+
+void Profiler::set(const std::string& name, double value)
+{
+	set(name, Profile::constant(value));
 }
 
 double Profiler::get(const std::string& name)
@@ -105,7 +231,127 @@ double Profiler::get(const std::string& name)
 	return 0.0;
 }
 
+bool Profiler::getActivePercentile(double& percent)
+{
+	// the named percentiles are always evaluated
+	if (s_activeType == "p50" || s_activeType == "p90" || s_activeType == "p99" || s_activeType == "p99.9")
+		return false;
+	return Profile::parsePercentile(s_activeType, percent);
+}
+
 std::tuple<std::string, double> Profiler::getActive()
 {
 	return { s_activeProfile, get(s_activeProfile) };
 }
+
+void Profiler::endFrame(size_t frame)
+{
+	if (s_infoChanged)
+	{
+		s_infos.push_back(s_info);
+		s_infoChanged = false;
+	}
+
+	for (const auto& name : s_updated)
+	{
+		const auto it = m_profiles.find(name);
+		if (it == m_profiles.end() || it->second.frame == Profile::NO_FRAME)
+			continue;
+
+		const auto sampleFrame = it->second.frame == Profile::CURRENT_FRAME ? frame : it->second.frame;
+		auto& history = s_history[name];
+		// the latest value is unchanged until the next gpu result arrives
+		if (history.lastFrame == sampleFrame)
+			continue;
+		history.push({ sampleFrame, s_infos.size() - 1, it->second.latest }, size_t(s_historySize));
+	}
+	s_updated.clear();
+}
+
+void Profiler::setInfo(const std::string& key, const std::string& value)
+{
+	auto& cur = s_info[key];
+	if (cur == value)
+		return;
+	cur = value;
+	s_infoChanged = true;
+}
+
+void Profiler::exportHistory(const std::string& filename)
+{
+	const auto ext = filename.substr(filename.find_last_of('.') + 1);
+	if (ext != "csv" && ext != "json")
+		throw std::runtime_error("exportProfiles expects a .csv or .json file");
+
+	std::ofstream file(filename);
+	if (!file.is_open())
+		throw std::runtime_error("could not open " + filename);
+	file.precision(10);
+
+	// sorted profile names for a stable output
+	std::map<std::string, const History*> histories;
+	for (const auto& h : s_history)
+		histories[h.first] = &h.second;
+
+	if (ext == "csv")
+	{
+		// one row per sample with a column for every key of the infos
+		std::set<std::string> keys;
+		for (const auto& info : s_infos)
+			for (const auto& i : info)
+				keys.insert(i.first);
+
+		file << "profile,frame";
+		for (const auto& k : keys)
+			file << ',' << escapeCsv(k);
+		file << ",value\n";
+		for (const auto& h : histories)
+		{
+			h.second->forEach([&](const HistorySample& s)
+			{
+				file << escapeCsv(h.first) << ',' << s.frame;
+				const auto& info = s_infos[s.info];
+				for (const auto& k : keys)
+				{
+					const auto it = info.find(k);
+					file << ',' << (it != info.end() ? escapeCsv(it->second) : "");
+				}
+				file << ',' << s.value << '\n';
+			});
+		}
+		return;
+	}
+
+	// one run per info with the frames and values of each profile
+	std::map<size_t, std::map<std::string, std::vector<HistorySample>>> runs;
+	for (const auto& h : histories)
+		h.second->forEach([&](const HistorySample& s)
+		{
+			runs[s.info][h.first].push_back(s);
+		});
+
+	file << "{\n\t\"runs\": [";
+	for (auto run = runs.begin(); run != runs.end(); ++run)
+	{
+		file << (run == runs.begin() ? "\n" : ",\n") << "\t\t{\n\t\t\t\"info\": {";
+		const auto& info = s_infos[run->first];
+		for (auto i = info.begin(); i != info.end(); ++i)
+			file << (i == info.begin() ? " " : ", ") << escapeJson(i->first) << ": " << escapeJson(i->second);
+		file << " },\n\t\t\t\"profiles\": {";
+		for (auto p = run->second.begin(); p != run->second.end(); ++p)
+		{
+			file << (p == run->second.begin() ? "\n" : ",\n") << "\t\t\t\t" << escapeJson(p->first) << ": {\n\t\t\t\t\t\"frames\": [";
+			for (size_t i = 0; i < p->second.size(); ++i)
+				file << (i ? ", " : "") << p->second[i].frame;
+			file << "],\n\t\t\t\t\t\"values\": [";
+			for (size_t i = 0; i < p->second.size(); ++i)
+			{
+				if (i) file << ", ";
+				writeJsonValue(file, p->second[i].value);
+			}
+			file << "]\n\t\t\t\t}";
+		}
+		file << "\n\t\t\t}\n\t\t}";
+	}
+	file << "\n\t]\n}\n";
+}
@@ -1,5 +1,8 @@
 #pragma once
 #include <string>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
 
 class Profiler
 {
@@ -7,11 +10,30 @@ class Profiler
 public:
 	struct Profile
 	{
+		// the latest value was measured in the frame that is ended next (e.g. cpu times and counters)
+		static constexpr size_t CURRENT_FRAME = size_t(-1);
+		// no value was measured yet (e.g. gpu timers without a received query)
+		static constexpr size_t NO_FRAME = size_t(-2);
+
 		double min = 0.0;
 		double max = 0.0;
 		double latest = 0.0;
 		double average = 0.0;
 		double median = 0.0;
+		double p90 = 0.0;
+		double p99 = 0.0;
+		double p999 = 0.0;
+		double stddev = 0.0;
+		// evaluated for the active profile type if it is another percentile (see getActivePercentile)
+		double percentile = 0.0;
+		// frame that issued the latest value. Gpu results arrive a few frames later
+		size_t frame = CURRENT_FRAME;
+
+		// profile with the same value for all statistics (e.g. for counters)
+		static Profile constant(double value)
+		{
+			return Profile{ value, value, value, value, value, value, value, value, 0.0, value };
+		}
 
 		Profile& operator+=(const Profile& rhs)
 		{
@@ -20,6 +42,13 @@ public:
 			latest += rhs.latest;
 			average += rhs.average;
 			median += rhs.median;
+			p90 += rhs.p90;
+			p99 += rhs.p99;
+			p999 += rhs.p999;
+			stddev += rhs.stddev;
+			percentile += rhs.percentile;
+			// a sum is as old as its oldest part
+			frame = (frame == NO_FRAME || rhs.frame == NO_FRAME) ? NO_FRAME : (std::min)(frame, rhs.frame);
 			return *this;
 		}
 		Profile operator+(const Profile& rhs) const
@@ -35,16 +64,66 @@ public:
 				return max;
 			if (name == "average")
 				return average;
-			if (name == "median")
+			if (name == "median" || name == "p50")
 				return median;
+			if (name == "p90")
+				return p90;
+			if (name == "p99")
+				return p99;
+			if (name == "p99.9")
+				return p999;
+			if (name == "stddev")
+				return stddev;
+			double percent;
+			if (parsePercentile(name, percent))
+				return percentile;
 			return latest;
 		}
+		// parses profile types like p95 or p99.5
+		static bool parsePercentile(const std::string& name, double& percent)
+		{
+			if (name.size() < 2 || name[0] != 'p')
+				return false;
+			try
+			{
+				size_t pos = 0;
+				percent = std::stod(name.substr(1), &pos);
+				return pos == name.size() - 1 && percent >= 0.0 && percent <= 100.0;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		}
 	};
 
 	static void init();
 	// resets all timers
 	static void reset();
 	static void set(const std::string& name, Profile time);
+	// sets all statistics to the same value (e.g. for counters)
+	static void set(const std::string& name, double value);
 	static double get(const std::string& name);
 	static std::tuple<std::string, double> getActive();
+	/**
+	 * \brief percentile of the active profile type (e.g. 95 for p95) that is not stored by name in the profile.
+	 * Timers evaluate it into Profile::percentile
+	 * \return false if the active type is no such percentile
+	 */
+	static bool getActivePercentile(double& percent);
+
+	/**
+	 * \brief adds the latest values of the profiles that were set since the last call to their history.
+	 * A value is only added once for the frame that issued it (see Profile::frame), therefore gpu timers only add
+	 * a sample when a new query result was received.
+	 * The history of each profile is a ring buffer with the size of the profileHistory property
+	 */
+	static void endFrame(size_t frame);
+	// describes the following frames in the exported history (e.g. renderer or resolution)
+	static void setInfo(const std::string& key, const std::string& value);
+	/**
+	 * \brief writes the history of all profiles as csv or json (depending on the extension)
+	 * \throws runtime_error if the file could not be opened
+	 */
+	static void exportHistory(const std::string& filename);
 };
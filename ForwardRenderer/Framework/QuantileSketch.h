@@ -0,0 +1,129 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+/**
+ * \brief streaming quantile estimator for positive values (DDSketch, Masson et al. 2019).
+ * The values are counted in logarithmic buckets, each quantile is returned with a relative error below RELATIVE_ACCURACY.
+ * The number of buckets only depends on the range of the values and is capped by MAX_BUCKETS (the lowest buckets are merged then).
+ */
+class QuantileSketch
+{
+public:
+	static constexpr double RELATIVE_ACCURACY = 0.005;
+	static constexpr size_t MAX_BUCKETS = 2048;
+
+	void add(double value)
+	{
+		++m_count;
+		m_min = (std::min)(m_min, value);
+		m_max = (std::max)(m_max, value);
+		if (value <= 0.0)
+		{
+			++m_zeroCount;
+			return;
+		}
+
+		const auto index = int(std::ceil(std::log(value) / logGamma()));
+		if (m_buckets.empty())
+		{
+			m_offset = index;
+			m_buckets.push_back(0);
+		}
+		else if (index < m_offset)
+		{
+			m_buckets.insert(m_buckets.begin(), size_t(m_offset - index), 0);
+			m_offset = index;
+		}
+		else if (index >= m_offset + int(m_buckets.size()))
+		{
+			m_buckets.resize(size_t(index - m_offset + 1), 0);
+		}
+		++m_buckets[size_t(index - m_offset)];
+		collapse();
+	}
+
+	/**
+	 * \brief quantiles of the added values
+	 * \param q quantiles in [0, 1] in ascending order
+	 * \param out receives one value per quantile
+	 */
+	void quantiles(const double* q, double* out, size_t count) const
+	{
+		if (!m_count)
+		{
+			std::fill(out, out + count, 0.0);
+			return;
+		}
+
+		// walk the buckets only once for all quantiles
+		uint64_t cumulative = m_zeroCount;
+		size_t bucket = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto rank = uint64_t(q[i] * double(m_count - 1));
+			if (rank < m_zeroCount)
+			{
+				out[i] = (std::max)(m_min, 0.0);
+				continue;
+			}
+			if (rank + 1 >= m_count)
+			{
+				out[i] = m_max;
+				continue;
+			}
+			while (bucket < m_buckets.size() && cumulative + m_buckets[bucket] <= rank)
+				cumulative += m_buckets[bucket++];
+			bucket = (std::min)(bucket, m_buckets.size() - 1);
+
+			// center of the bucket with the smallest relative error
+			const auto gamma = std::exp(logGamma());
+			const auto value = 2.0 * std::pow(gamma, double(m_offset + int(bucket))) / (gamma + 1.0);
+			out[i] = std::clamp(value, m_min, m_max);
+		}
+	}
+
+	double quantile(double q) const
+	{
+		double res;
+		quantiles(&q, &res, 1);
+		return res;
+	}
+
+	uint64_t count() const
+	{
+		return m_count;
+	}
+
+	void clear()
+	{
+		*this = QuantileSketch();
+	}
+private:
+	static double logGamma()
+	{
+		static const double value = std::log((1.0 + RELATIVE_ACCURACY) / (1.0 - RELATIVE_ACCURACY));
+		return value;
+	}
+	void collapse()
+	{
+		if (m_buckets.size() <= MAX_BUCKETS)
+			return;
+		const auto excess = m_buckets.size() - MAX_BUCKETS;
+		for (size_t i = 0; i < excess; ++i)
+			m_buckets[excess] += m_buckets[i];
+		m_buckets.erase(m_buckets.begin(), m_buckets.begin() + excess);
+		m_offset += int(excess);
+	}
+
+	// counts of the buckets m_offset, m_offset + 1 ...
+	std::vector<uint32_t> m_buckets;
+	int m_offset = 0;
+	uint64_t m_zeroCount = 0;
+	uint64_t m_count = 0;
+	double m_min = std::numeric_limits<double>::max();
+	double m_max = std::numeric_limits<double>::lowest();
+};
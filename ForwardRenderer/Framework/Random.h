@@ -0,0 +1,34 @@
+#pragma once
+#include <random>
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * \brief seeded random numbers that only depend on std::mt19937.
+ * The standard distributions are implementation defined, this produces the same sequence with every standard library
+ */
+class Random
+{
+public:
+	explicit Random(uint32_t seed)
+		:
+	m_rng(seed)
+	{}
+
+	// uniform in [0, 1) from the upper 24 bits
+	float next()
+	{
+		return float(m_rng() >> 8) * (1.0f / 16777216.0f);
+	}
+	float next(float min, float max)
+	{
+		return min + (max - min) * next();
+	}
+	// uniform in [0, count)
+	int nextInt(int count)
+	{
+		return std::min(int(next() * float(count)), count - 1);
+	}
+private:
+	std::mt19937 m_rng;
+};
@@ -0,0 +1,158 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <algorithm>
+
+/**
+ * \brief global worker pool for cpu heavy load time tasks (parsing, mesh processing etc.)
+ */
+class ThreadPool
+{
+	ThreadPool()
+	{
+		const auto numThreads = std::max(1u, std::thread::hardware_concurrency());
+		m_workers.reserve(numThreads);
+		for (unsigned i = 0; i < numThreads; ++i)
+			m_workers.emplace_back([this]() { workerLoop(); });
+	}
+public:
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> g(m_mutex);
+			m_stop = true;
+		}
+		m_condition.notify_all();
+		for (auto& w : m_workers)
+			w.join();
+	}
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	static ThreadPool& get()
+	{
+		static ThreadPool s_pool;
+		return s_pool;
+	}
+
+	size_t getNumThreads() const
+	{
+		return m_workers.size();
+	}
+
+	/**
+	 * \brief executes the function on a worker thread
+	 * \return future for the result of the function
+	 */
+	template<class F>
+	auto enqueue(F func) -> std::future<decltype(func())>
+	{
+		using ResultT = decltype(func());
+		auto task = std::make_shared<std::packaged_task<ResultT()>>(std::move(func));
+		auto res = task->get_future();
+		{
+			std::lock_guard<std::mutex> g(m_mutex);
+			m_tasks.emplace([task]() { (*task)(); });
+		}
+		m_condition.notify_one();
+		return res;
+	}
+
+	/**
+	 * \brief executes func(i) for all i in [begin, end) on all threads and waits until all indices were processed.
+	 * The calling thread participates, therefore this may be called from a worker thread as well.
+	 * \param grainSize number of consecutive indices that are processed by one thread at once
+	 * \throws the first exception that was thrown by func
+	 */
+	template<class F>
+	void parallelFor(size_t begin, size_t end, F func, size_t grainSize = 1)
+	{
+		if (begin >= end) return;
+		grainSize = std::max(grainSize, size_t(1));
+		const auto numGrains = (end - begin + grainSize - 1) / grainSize;
+
+		struct State
+		{
+			std::atomic<size_t> nextGrain{ 0 };
+			std::atomic<size_t> finishedGrains{ 0 };
+			std::mutex mutex;
+			std::condition_variable done;
+			std::exception_ptr exception;
+		};
+		// the state is shared because helper tasks may start after the call returned
+		auto state = std::make_shared<State>();
+
+		auto work = [state, begin, end, grainSize, numGrains, func]()
+		{
+			size_t grain;
+			while ((grain = state->nextGrain++) < numGrains)
+			{
+				const auto first = begin + grain * grainSize;
+				const auto last = std::min(first + grainSize, end);
+				try
+				{
+					for (auto i = first; i < last; ++i)
+						func(i);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> g(state->mutex);
+					if (!state->exception)
+						state->exception = std::current_exception();
+				}
+
+				if (++state->finishedGrains == numGrains)
+				{
+					std::lock_guard<std::mutex> g(state->mutex);
+					state->done.notify_all();
+				}
+			}
+		};
+
+		const auto numHelpers = std::min(numGrains - 1, getNumThreads());
+		{
+			std::lock_guard<std::mutex> g(m_mutex);
+			for (size_t i = 0; i < numHelpers; ++i)
+				m_tasks.emplace(work);
+		}
+		m_condition.notify_all();
+
+		work();
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->done.wait(lock, [&state, numGrains]() { return state->finishedGrains == numGrains; });
+		if (state->exception)
+			std::rethrow_exception(state->exception);
+	}
+
+private:
+	void workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+				if (m_stop && m_tasks.empty())
+					return;
+				task = std::move(m_tasks.front());
+				m_tasks.pop();
+			}
+			task();
+		}
+	}
+
+private:
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stop = false;
+};
@@ -10,6 +10,7 @@
 #include "IWindowReceiver.h"
 #include <cassert>
 #include "../ScriptEngine/ScriptEngine.h"
+#include "../Dependencies/gl/framebuffer.hpp"
 
 static std::vector<IKeyReceiver*> s_keyReceiver;
 static std::vector<IMouseReceiver*> s_mouseReceiver;
@@ -73,7 +74,34 @@ void Window::windowSizeFunc(GLFWwindow* window, int width, int height)
 		r->onSizeChange(width, height);
 }
 
-Window::Window(size_t width, size_t height, const std::string& title)
+// color and depth targets with the formats of the window framebuffer
+struct Window::Offscreen
+{
+	Offscreen(int width, int height)
+		:
+	color(gl::InternalFormat::RGBA8, width, height),
+	depth(gl::InternalFormat::DEPTH32F_STENCIL8, width, height)
+	{
+		framebuffer.attachColor(0, color);
+		framebuffer.attachDepth(depth);
+		framebuffer.validate();
+
+		// the renderers unbind their framebuffers to this one and the screenshots read from it
+		gl::Framebuffer::setDefault(framebuffer.getId());
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.getId());
+	}
+	~Offscreen()
+	{
+		gl::Framebuffer::setDefault(0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	}
+
+	gl::Framebuffer framebuffer;
+	gl::Renderbuffer color;
+	gl::Renderbuffer depth;
+};
+
+Window::Window(size_t width, size_t height, const std::string& title, bool headless)
 {
 	assert(!s_wnd);
 	s_wnd = this;
@@ -90,6 +118,15 @@ Window::Window(size_t width, size_t height, const std::string& title)
 #ifndef _NO_GL_DEBUG
 	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 #endif
+	if (headless)
+	{
+		// the window only provides the context
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifndef _WIN32
+		// egl also finds software implementations (llvmpipe) on machines without gpu
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+#endif
+	}
 	 
 	m_handle = glfwCreateWindow(static_cast<int>(width), static_cast<int>(height), title.c_str(), nullptr, nullptr);
 	s_windowWidth = int(width);
@@ -105,7 +142,7 @@ Window::Window(size_t width, size_t height, const std::string& title)
 	glfwSetWindowSizeCallback(m_handle, windowSizeFunc);
 
 	if (!gladLoadGL())
-		throw std::exception("Cannot initialize Glad/load gl-function pointers!\n");
+		throw std::runtime_error("Cannot initialize Glad/load gl-function pointers!\n");
 	std::cerr << "INF: Loaded GL-context is version " << GLVersion.major << '.' << GLVersion.minor << '\n';
 
 #ifndef _NO_GL_DEBUG
@@ -116,21 +153,36 @@ Window::Window(size_t width, size_t height, const std::string& title)
 	glPixelStorei(GL_PACK_ALIGNMENT, 1);
 	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
+	if (headless)
+	{
+		m_offscreen = std::make_unique<Offscreen>(s_windowWidth, s_windowHeight);
+		std::cerr << "INF: headless mode with a " << s_windowWidth << "x" << s_windowHeight << " offscreen framebuffer\n";
+	}
+
 	ScriptEngine::addProperty("windowSize", [this]()
 	{
-		int w, h;
-		glfwGetWindowSize(m_handle, &w, &h);
+		int w = s_windowWidth, h = s_windowHeight;
+		if (!m_offscreen)
+			glfwGetWindowSize(m_handle, &w, &h);
 		return std::to_string(w) + ", " + std::to_string(h);
 	}, [this](const std::vector<Token>& args)
 	{
 		auto w = std::max(1, args.at(0).getInt());
 		auto h = std::max(1, args.at(1).getInt());
-		glfwSetWindowSize(m_handle, w, h);
+		if (m_offscreen)
+		{
+			// the old framebuffer is released first
+			m_offscreen.reset();
+			m_offscreen = std::make_unique<Offscreen>(w, h);
+			windowSizeFunc(m_handle, w, h);
+		}
+		else glfwSetWindowSize(m_handle, w, h);
 	});
 }
 
 Window::~Window()
 {
+	m_offscreen.reset();
 	if (m_handle)
 		glfwDestroyWindow(m_handle);
 	glfwTerminate();
@@ -146,13 +198,15 @@ void Window::handleEvents()
 void Window::swapBuffer() const
 {
 	glFlush();
-	glfwSwapBuffers(m_handle);
+	if (!m_offscreen)
+		glfwSwapBuffers(m_handle);
 	resetState();
 }
 
 void Window::setTitle(const std::string& title)
 {
-	glfwSetWindowTitle(m_handle, title.c_str());
+	if (!m_offscreen)
+		glfwSetWindowTitle(m_handle, title.c_str());
 }
 
 int Window::getWidth()
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <memory>
 
 class IKeyReceiver;
 class IMouseReceiver;
@@ -8,7 +9,10 @@ class IWindowReceiver;
 class Window
 {
 public:
-	Window(size_t width, size_t height, const std::string& title);
+	/**
+	 * \param headless the window stays hidden and everything is rendered into an offscreen framebuffer of the given size
+	 */
+	Window(size_t width, size_t height, const std::string& title, bool headless = false);
 	~Window();
 	bool isOpen() const { return m_open; }
 	void handleEvents();
@@ -29,7 +33,11 @@ private:
 	static void windowSizeFunc(struct GLFWwindow* window, int width, int height);
 	void resetState() const;
 
+	struct Offscreen;
+
 	struct GLFWwindow* m_handle = nullptr;
 	bool m_open = true;
+	// replaces the window framebuffer in the headless mode
+	std::unique_ptr<Offscreen> m_offscreen;
 };
 
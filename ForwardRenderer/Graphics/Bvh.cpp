@@ -0,0 +1,565 @@
+#include "Bvh.h"
+#include "../Framework/ThreadPool.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace
+{
+	const int NUM_BINS = 16;
+	// nodes with more triangles are always split
+	const uint32_t MAX_LEAF_SIZE = 8;
+	// cost of a node traversal relative to a triangle intersection
+	const float TRAVERSAL_COST = 1.0f;
+	// triangles per task for the parallel bounds and binning passes
+	const uint32_t CHUNK_SIZE = 1 << 15;
+	// minimum triangles of a subtree that is built by a single thread
+	const uint32_t MIN_TASK_SIZE = 1 << 12;
+
+	struct Bounds
+	{
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+		void extend(const glm::vec3& p)
+		{
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		Bounds& operator+=(const Bounds& rhs)
+		{
+			min = glm::min(min, rhs.min);
+			max = glm::max(max, rhs.max);
+			return *this;
+		}
+		float area() const
+		{
+			const auto e = glm::max(max - min, glm::vec3(0.0f));
+			return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+	};
+
+	// bounds of the triangles and of their centroids
+	struct NodeBounds
+	{
+		Bounds bounds;
+		Bounds centroids;
+
+		NodeBounds& operator+=(const NodeBounds& rhs)
+		{
+			bounds += rhs.bounds;
+			centroids += rhs.centroids;
+			return *this;
+		}
+	};
+
+	struct Bin
+	{
+		Bounds bounds;
+		uint32_t count = 0;
+	};
+
+	// bins of all three axes
+	struct BinSet
+	{
+		Bin bins[3][NUM_BINS];
+
+		BinSet& operator+=(const BinSet& rhs)
+		{
+			for (int a = 0; a < 3; ++a)
+				for (int b = 0; b < NUM_BINS; ++b)
+				{
+					bins[a][b].bounds += rhs.bins[a][b].bounds;
+					bins[a][b].count += rhs.bins[a][b].count;
+				}
+			return *this;
+		}
+	};
+
+	class Builder
+	{
+	public:
+		Builder(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+			:
+		m_bounds(indices.size() / 3),
+		m_centroids(indices.size() / 3),
+		m_order(indices.size() / 3)
+		{
+			std::iota(m_order.begin(), m_order.end(), 0u);
+			ThreadPool::get().parallelFor(0, m_order.size(), [&](size_t t)
+			{
+				auto& b = m_bounds[t];
+				for (size_t i = 0; i < 3; ++i)
+				{
+					const auto idx = indices[3 * t + i];
+					if (idx >= positions.size())
+						throw std::runtime_error("bvh vertex index out of range");
+					b.extend(positions[idx]);
+				}
+				m_centroids[t] = (b.min + b.max) * 0.5f;
+			}, CHUNK_SIZE);
+		}
+
+		std::vector<Bvh::Node> build()
+		{
+			std::vector<Bvh::Node> res;
+			const auto numTriangles = uint32_t(m_order.size());
+			if (numTriangles == 0)
+				return res;
+
+			// the upper levels are split with parallel passes until the subtrees are small enough for a single thread
+			auto& pool = ThreadPool::get();
+			m_taskSize = std::max(MIN_TASK_SIZE, uint32_t(numTriangles / (pool.getNumThreads() * 8)));
+			res.emplace_back();
+			std::vector<Task> tasks;
+			buildTop(res, tasks, 0, 0, numTriangles);
+
+			std::vector<std::vector<Bvh::Node>> subtrees(tasks.size());
+			pool.parallelFor(0, tasks.size(), [&](size_t i)
+			{
+				auto& nodes = subtrees[i];
+				nodes.emplace_back();
+				buildSubtree(nodes, 0, tasks[i].first, tasks[i].count);
+			});
+
+			// append the subtrees. The root of a subtree replaces the task node
+			std::vector<size_t> offsets(tasks.size());
+			auto numNodes = res.size();
+			for (size_t i = 0; i < tasks.size(); ++i)
+			{
+				offsets[i] = numNodes;
+				numNodes += subtrees[i].size() - 1;
+			}
+			if (numNodes >= size_t(std::numeric_limits<uint32_t>::max()))
+				throw std::runtime_error("too many bvh nodes");
+			res.resize(numNodes);
+
+			pool.parallelFor(0, tasks.size(), [&](size_t i)
+			{
+				const auto& nodes = subtrees[i];
+				const auto offset = offsets[i];
+				const auto relocate = [offset](Bvh::Node n)
+				{
+					if (!n.isLeaf())
+						n.leftChild = uint32_t(offset + n.leftChild - 1);
+					return n;
+				};
+				res[tasks[i].node] = relocate(nodes[0]);
+				for (size_t j = 1; j < nodes.size(); ++j)
+					res[offset + j - 1] = relocate(nodes[j]);
+				std::vector<Bvh::Node>().swap(subtrees[i]);
+			});
+
+			return res;
+		}
+
+		const std::vector<uint32_t>& getOrder() const
+		{
+			return m_order;
+		}
+	private:
+		struct Task
+		{
+			uint32_t node;
+			uint32_t first;
+			uint32_t count;
+		};
+
+		void buildTop(std::vector<Bvh::Node>& nodes, std::vector<Task>& tasks, uint32_t index, uint32_t first, uint32_t count)
+		{
+			if (count <= m_taskSize)
+			{
+				tasks.push_back({ index, first, count });
+				return;
+			}
+
+			Bounds bounds;
+			const auto numLeft = split(first, count, true, bounds);
+			nodes[index] = { bounds.min, first, bounds.max, count, 0 };
+			if (numLeft == 0)
+				return;
+
+			const auto left = uint32_t(nodes.size());
+			nodes[index].leftChild = left;
+			nodes.resize(nodes.size() + 2);
+			buildTop(nodes, tasks, left, first, numLeft);
+			buildTop(nodes, tasks, left + 1, first + numLeft, count - numLeft);
+		}
+
+		void buildSubtree(std::vector<Bvh::Node>& nodes, uint32_t index, uint32_t first, uint32_t count)
+		{
+			Bounds bounds;
+			const auto numLeft = split(first, count, false, bounds);
+			nodes[index] = { bounds.min, first, bounds.max, count, 0 };
+			if (numLeft == 0)
+				return;
+
+			const auto left = uint32_t(nodes.size());
+			nodes[index].leftChild = left;
+			nodes.resize(nodes.size() + 2);
+			buildSubtree(nodes, left, first, numLeft);
+			buildSubtree(nodes, left + 1, first + numLeft, count - numLeft);
+		}
+
+		/**
+		 * \brief computes the node bounds and partitions the triangles of the node
+		 * \param parallel use the thread pool for the passes over the triangles
+		 * \return number of triangles in the left child. Zero if the node should be a leaf
+		 */
+		uint32_t split(uint32_t first, uint32_t count, bool parallel, Bounds& bounds)
+		{
+			const auto nodeBounds = accumulate<NodeBounds>(first, count, parallel, [this](NodeBounds& dst, uint32_t t)
+			{
+				dst.bounds += m_bounds[t];
+				dst.centroids.extend(m_centroids[t]);
+			});
+			bounds = nodeBounds.bounds;
+			if (count <= 1)
+				return 0;
+
+			const auto cmin = nodeBounds.centroids.min;
+			const auto extent = nodeBounds.centroids.max - cmin;
+			glm::vec3 scale;
+			for (int a = 0; a < 3; ++a)
+				scale[a] = extent[a] > 0.0f ? float(NUM_BINS) / extent[a] : 0.0f;
+			const auto getBin = [cmin, scale](const glm::vec3& c, int axis)
+			{
+				return std::min(int((c[axis] - cmin[axis]) * scale[axis]), NUM_BINS - 1);
+			};
+
+			const auto binSet = accumulate<BinSet>(first, count, parallel, [this, &getBin, &scale](BinSet& dst, uint32_t t)
+			{
+				for (int a = 0; a < 3; ++a)
+				{
+					if (scale[a] == 0.0f) continue;
+					auto& bin = dst.bins[a][getBin(m_centroids[t], a)];
+					bin.bounds += m_bounds[t];
+					++bin.count;
+				}
+			});
+
+			// sweep over the bins of each axis. A split after bin b puts bins [0, b] into the left child
+			const auto invArea = bounds.area() > 0.0f ? 1.0f / bounds.area() : 0.0f;
+			float bestCost = std::numeric_limits<float>::max();
+			int bestAxis = -1, bestBin = 0;
+			for (int a = 0; a < 3; ++a)
+			{
+				if (scale[a] == 0.0f) continue;
+				const auto& bins = binSet.bins[a];
+
+				float rightCost[NUM_BINS];
+				Bounds right;
+				uint32_t numRight = 0;
+				for (int b = NUM_BINS - 1; b > 0; --b)
+				{
+					right += bins[b].bounds;
+					numRight += bins[b].count;
+					rightCost[b - 1] = right.area() * float(numRight);
+				}
+
+				Bounds left;
+				uint32_t numLeft = 0;
+				for (int b = 0; b < NUM_BINS - 1; ++b)
+				{
+					left += bins[b].bounds;
+					numLeft += bins[b].count;
+					if (numLeft == 0 || numLeft == count) continue;
+					const auto cost = TRAVERSAL_COST + (left.area() * float(numLeft) + rightCost[b]) * invArea;
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = a;
+						bestBin = b;
+					}
+				}
+			}
+
+			// all centroids are equal
+			if (bestAxis < 0)
+				return count <= MAX_LEAF_SIZE ? 0 : count / 2;
+
+			// intersecting all triangles of a leaf costs one per triangle
+			if (bestCost >= float(count) && count <= MAX_LEAF_SIZE)
+				return 0;
+
+			const auto begin = m_order.begin() + first;
+			const auto mid = std::partition(begin, begin + count, [this, &getBin, bestAxis, bestBin](uint32_t t)
+			{
+				return getBin(m_centroids[t], bestAxis) <= bestBin;
+			});
+			return uint32_t(mid - begin);
+		}
+
+		// calls func(partial result, triangle) for the triangles of the range and merges the partial results
+		template<class T, class F>
+		T accumulate(uint32_t first, uint32_t count, bool parallel, const F& func) const
+		{
+			const auto numChunks = parallel ? (count + CHUNK_SIZE - 1) / CHUNK_SIZE : 1;
+			if (numChunks <= 1)
+			{
+				T res;
+				for (auto i = first; i < first + count; ++i)
+					func(res, m_order[i]);
+				return res;
+			}
+
+			std::vector<T> partial(numChunks);
+			ThreadPool::get().parallelFor(0, numChunks, [&](size_t c)
+			{
+				const auto begin = first + uint32_t(c) * CHUNK_SIZE;
+				const auto end = std::min(begin + CHUNK_SIZE, first + count);
+				for (auto i = begin; i < end; ++i)
+					func(partial[c], m_order[i]);
+			});
+			for (size_t c = 1; c < partial.size(); ++c)
+				partial[0] += partial[c];
+			return partial[0];
+		}
+	private:
+		std::vector<Bounds> m_bounds;
+		std::vector<glm::vec3> m_centroids;
+		// triangles in leaf order
+		std::vector<uint32_t> m_order;
+		uint32_t m_taskSize = MIN_TASK_SIZE;
+	};
+
+	// slab test. Returns the entry distance or infinity on miss
+	float intersectBox(const glm::vec3& bmin, const glm::vec3& bmax, const Ray& ray, const glm::vec3& invDir, float tMax)
+	{
+		const auto t0 = (bmin - ray.origin) * invDir;
+		const auto t1 = (bmax - ray.origin) * invDir;
+		const auto tNear = glm::min(t0, t1);
+		const auto tFar = glm::max(t0, t1);
+		const auto enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, ray.tMin));
+		const auto exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+	}
+
+	// Moeller-Trumbore test without backface culling
+	bool intersectTriangle(const Ray& ray, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& t, glm::vec2& barycentric)
+	{
+		const auto e1 = v1 - v0;
+		const auto e2 = v2 - v0;
+		const auto p = glm::cross(ray.direction, e2);
+		const auto det = glm::dot(e1, p);
+		if (det == 0.0f)
+			return false;
+		const auto invDet = 1.0f / det;
+
+		const auto s = ray.origin - v0;
+		const auto u = glm::dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		const auto q = glm::cross(s, e1);
+		const auto v = glm::dot(ray.direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+
+		t = glm::dot(e2, q) * invDet;
+		barycentric = glm::vec2(u, v);
+		return true;
+	}
+
+	glm::vec3 getInverseDirection(const glm::vec3& dir)
+	{
+		// infinite values for axis aligned rays are handled by the slab test
+		return glm::vec3(1.0f) / dir;
+	}
+}
+
+Ray Ray::fromNdc(const glm::mat4& viewProjection, const glm::vec2& ndc)
+{
+	const auto inv = glm::inverse(viewProjection);
+	auto nearPoint = inv * glm::vec4(ndc, -1.0f, 1.0f);
+	auto farPoint = inv * glm::vec4(ndc, 1.0f, 1.0f);
+	nearPoint /= nearPoint.w;
+	farPoint /= farPoint.w;
+
+	Ray r;
+	r.origin = glm::vec3(nearPoint);
+	r.direction = glm::vec3(farPoint) - glm::vec3(nearPoint);
+	r.tMin = 0.0f;
+	r.tMax = 1.0f;
+	return r;
+}
+
+Bvh::Bvh(std::vector<glm::vec3> positions, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& triangleShapes)
+	:
+m_positions(std::move(positions))
+{
+	const auto numTriangles = indices.size() / 3;
+	if (triangleShapes.size() != numTriangles)
+		throw std::runtime_error("bvh requires one shape per triangle");
+	if (numTriangles >= size_t(std::numeric_limits<uint32_t>::max()))
+		throw std::runtime_error("too many triangles for the bvh");
+
+	Builder builder(m_positions, indices);
+	m_nodes = builder.build();
+
+	const auto& order = builder.getOrder();
+	m_triangles.resize(numTriangles);
+	ThreadPool::get().parallelFor(0, numTriangles, [&](size_t i)
+	{
+		const auto t = order[i];
+		auto& dst = m_triangles[i];
+		for (size_t v = 0; v < 3; ++v)
+			dst.vertex[v] = indices[3 * size_t(t) + v];
+		dst.id = t;
+		dst.shape = triangleShapes[t];
+	}, CHUNK_SIZE);
+}
+
+bool Bvh::intersect(const Ray& ray, Hit& hit) const
+{
+	if (empty()) return false;
+
+	const auto invDir = getInverseDirection(ray.direction);
+	float closest = ray.tMax;
+	bool found = false;
+
+	std::vector<uint32_t> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const auto& node = m_nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.isLeaf())
+		{
+			for (auto i = node.firstTriangle; i < node.firstTriangle + node.numTriangles; ++i)
+			{
+				const auto& tri = m_triangles[i];
+				float t;
+				glm::vec2 barycentric;
+				if (intersectTriangle(ray, m_positions[tri.vertex[0]], m_positions[tri.vertex[1]], m_positions[tri.vertex[2]], t, barycentric)
+					&& t >= ray.tMin && t <= closest)
+				{
+					closest = t;
+					hit = { t, barycentric, tri.id, tri.shape };
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// visit the closer child first
+		auto nearChild = node.leftChild;
+		auto farChild = node.leftChild + 1;
+		auto tNear = intersectBox(m_nodes[nearChild].bboxMin, m_nodes[nearChild].bboxMax, ray, invDir, closest);
+		auto tFar = intersectBox(m_nodes[farChild].bboxMin, m_nodes[farChild].bboxMax, ray, invDir, closest);
+		if (tFar < tNear)
+		{
+			std::swap(nearChild, farChild);
+			std::swap(tNear, tFar);
+		}
+		if (tFar != std::numeric_limits<float>::infinity())
+			stack.push_back(farChild);
+		if (tNear != std::numeric_limits<float>::infinity())
+			stack.push_back(nearChild);
+	}
+	return found;
+}
+
+size_t Bvh::intersectAll(const Ray& ray, std::vector<Hit>& hits) const
+{
+	hits.clear();
+	if (empty()) return 0;
+
+	const auto invDir = getInverseDirection(ray.direction);
+	std::vector<uint32_t> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const auto& node = m_nodes[stack.back()];
+		stack.pop_back();
+		if (intersectBox(node.bboxMin, node.bboxMax, ray, invDir, ray.tMax) == std::numeric_limits<float>::infinity())
+			continue;
+
+		if (node.isLeaf())
+		{
+			for (auto i = node.firstTriangle; i < node.firstTriangle + node.numTriangles; ++i)
+			{
+				const auto& tri = m_triangles[i];
+				float t;
+				glm::vec2 barycentric;
+				if (intersectTriangle(ray, m_positions[tri.vertex[0]], m_positions[tri.vertex[1]], m_positions[tri.vertex[2]], t, barycentric)
+					&& t >= ray.tMin && t <= ray.tMax)
+					hits.push_back({ t, barycentric, tri.id, tri.shape });
+			}
+			continue;
+		}
+
+		stack.push_back(node.leftChild);
+		stack.push_back(node.leftChild + 1);
+	}
+
+	std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b)
+	{
+		return a.t < b.t;
+	});
+	return hits.size();
+}
+
+void Bvh::getDepthRanges(const glm::mat4& viewProjection, uint32_t maxTriangles, std::vector<NodeRange>& ranges) const
+{
+	if (empty()) return;
+
+	const Frustum frustum(viewProjection);
+	std::vector<uint32_t> stack;
+	stack.push_back(0);
+	while (!stack.empty())
+	{
+		const auto index = stack.back();
+		const auto& node = m_nodes[index];
+		stack.pop_back();
+		if (!frustum.isVisible(node.bboxMin, node.bboxMax))
+			continue;
+
+		if (!node.isLeaf() && node.numTriangles > maxTriangles)
+		{
+			stack.push_back(node.leftChild);
+			stack.push_back(node.leftChild + 1);
+			continue;
+		}
+
+		NodeRange range;
+		range.node = index;
+		range.ndcMin = glm::vec2(std::numeric_limits<float>::max());
+		range.ndcMax = glm::vec2(std::numeric_limits<float>::lowest());
+		range.minDepth = std::numeric_limits<float>::max();
+		range.maxDepth = std::numeric_limits<float>::lowest();
+		bool behindCamera = false;
+		for (int c = 0; c < 8; ++c)
+		{
+			const glm::vec3 corner(
+				c & 1 ? node.bboxMax.x : node.bboxMin.x,
+				c & 2 ? node.bboxMax.y : node.bboxMin.y,
+				c & 4 ? node.bboxMax.z : node.bboxMin.z);
+			const auto clip = viewProjection * glm::vec4(corner, 1.0f);
+			if (clip.w <= 0.0f)
+			{
+				behindCamera = true;
+				continue;
+			}
+			const auto ndc = glm::vec3(clip) / clip.w;
+			range.ndcMin = glm::min(range.ndcMin, glm::vec2(ndc));
+			range.ndcMax = glm::max(range.ndcMax, glm::vec2(ndc));
+			range.minDepth = std::min(range.minDepth, ndc.z * 0.5f + 0.5f);
+			range.maxDepth = std::max(range.maxDepth, ndc.z * 0.5f + 0.5f);
+		}
+
+		// the projection of boxes that cross the camera plane is unbounded
+		if (behindCamera)
+		{
+			range.ndcMin = glm::vec2(-1.0f);
+			range.ndcMax = glm::vec2(1.0f);
+			range.minDepth = 0.0f;
+			range.maxDepth = std::max(range.maxDepth, 1.0f);
+		}
+		range.ndcMin = glm::clamp(range.ndcMin, glm::vec2(-1.0f), glm::vec2(1.0f));
+		range.ndcMax = glm::clamp(range.ndcMax, glm::vec2(-1.0f), glm::vec2(1.0f));
+		range.minDepth = glm::clamp(range.minDepth, 0.0f, 1.0f);
+		range.maxDepth = glm::clamp(range.maxDepth, 0.0f, 1.0f);
+		ranges.push_back(range);
+	}
+}
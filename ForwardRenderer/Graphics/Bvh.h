@@ -0,0 +1,125 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+
+struct Ray
+{
+	glm::vec3 origin;
+	// hit distances are multiples of the direction (it does not need to be normalized)
+	glm::vec3 direction;
+	float tMin = 0.0f;
+	float tMax = std::numeric_limits<float>::max();
+
+	/**
+	 * \brief ray from the near plane (t = 0) to the far plane (t = 1)
+	 * \param ndc normalized device coordinates in [-1, 1]
+	 */
+	static Ray fromNdc(const glm::mat4& viewProjection, const glm::vec2& ndc);
+};
+
+/**
+ * \brief bounding volume hierarchy over the triangles of a model. Built with the binned surface area heuristic (multithreaded).
+ * The triangles of every subtree are stored consecutively.
+ */
+class Bvh
+{
+public:
+	struct Node
+	{
+		glm::vec3 bboxMin;
+		// first triangle of the subtree
+		uint32_t firstTriangle;
+		glm::vec3 bboxMax;
+		// number of triangles of the subtree
+		uint32_t numTriangles;
+		// the right child follows the left child. Zero for leaves
+		uint32_t leftChild;
+
+		bool isLeaf() const
+		{
+			return leftChild == 0;
+		}
+	};
+
+	struct Triangle
+	{
+		uint32_t vertex[3];
+		// index of the triangle in the element buffer that was passed to the constructor
+		uint32_t id;
+		// shape index of the model
+		uint32_t shape;
+	};
+
+	struct Hit
+	{
+		float t;
+		// barycentric coordinates of the second and third vertex
+		glm::vec2 barycentric;
+		// Triangle::id
+		uint32_t triangle;
+		uint32_t shape;
+	};
+
+	// screen space bounds of a node
+	struct NodeRange
+	{
+		uint32_t node;
+		// normalized device coordinates clamped to [-1, 1]
+		glm::vec2 ndcMin;
+		glm::vec2 ndcMax;
+		// window depth in [0, 1]
+		float minDepth;
+		float maxDepth;
+	};
+
+	Bvh() = default;
+	/**
+	 * \param positions vertex positions
+	 * \param indices triangle list
+	 * \param triangleShapes shape of each triangle
+	 */
+	Bvh(std::vector<glm::vec3> positions, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& triangleShapes);
+
+	/**
+	 * \brief finds the closest triangle in [ray.tMin, ray.tMax] (front and back faces)
+	 * \return false if nothing was hit
+	 */
+	bool intersect(const Ray& ray, Hit& hit) const;
+	/**
+	 * \brief finds all triangles in [ray.tMin, ray.tMax] (front and back faces)
+	 * \param hits hits sorted by distance
+	 * \return number of hits
+	 */
+	size_t intersectAll(const Ray& ray, std::vector<Hit>& hits) const;
+	/**
+	 * \brief collects the screen space bounds and depth ranges of the uppermost visible nodes
+	 * that contain at most maxTriangles triangles (or leaves)
+	 */
+	void getDepthRanges(const glm::mat4& viewProjection, uint32_t maxTriangles, std::vector<NodeRange>& ranges) const;
+
+	const std::vector<Node>& getNodes() const
+	{
+		return m_nodes;
+	}
+	const std::vector<Triangle>& getTriangles() const
+	{
+		return m_triangles;
+	}
+	const std::vector<glm::vec3>& getPositions() const
+	{
+		return m_positions;
+	}
+	bool empty() const
+	{
+		return m_nodes.empty();
+	}
+private:
+	std::vector<glm::vec3> m_positions;
+	// sorted by leaves
+	std::vector<Triangle> m_triangles;
+	// the root is the first node
+	std::vector<Node> m_nodes;
+};
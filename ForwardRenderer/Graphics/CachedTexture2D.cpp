@@ -1,13 +1,21 @@
 #include "CachedTexture2D.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "../Dependencies/stb_image.h"
+#include "TextureCache.h"
 #include <unordered_map>
+#include <unordered_set>
 #include <glm/gtx/hash.hpp>
 #include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include "../Framework/ThreadPool.h"
 
 std::unordered_map<glm::vec4, std::shared_ptr<CachedTexture2D>> s_cachedConstantTextures;
 std::unordered_map<std::string, std::shared_ptr<CachedTexture2D>> s_cachedTextures;
 
+// size of the pixel unpack buffer that is used for uploading multiple images at once
+static const size_t STAGING_SIZE = 64 * 1024 * 1024;
+
 CachedTexture2D::CachedTexture2D(const glm::vec4& color)
 	:
 Texture(gl::InternalFormat::RGBA8, 1, 1)
@@ -42,40 +50,128 @@ static gl::SetDataFormat getFormatFromComponents(int numComponents)
 	return gl::SetDataFormat(-1);
 }
 
-CachedTexture2D::CachedTexture2D(const std::string& filename)
+// 2x2 box filter (the last row and column are repeated for odd sizes)
+static void downsample(const uint8_t* src, int srcWidth, int srcHeight, uint8_t* dst, int dstWidth, int dstHeight, int numComponents)
 {
-	int width = 0, height = 0, numComponents = 0;
-	
-	stbi_set_flip_vertically_on_load(true);
-	auto data = stbi_load(filename.c_str(), &width, &height, &numComponents, 0);
+	for (int y = 0; y < dstHeight; ++y)
+	{
+		const auto y0 = std::min(2 * y, srcHeight - 1);
+		const auto y1 = std::min(2 * y + 1, srcHeight - 1);
+		for (int x = 0; x < dstWidth; ++x)
+		{
+			const auto x0 = std::min(2 * x, srcWidth - 1);
+			const auto x1 = std::min(2 * x + 1, srcWidth - 1);
+			for (int c = 0; c < numComponents; ++c)
+			{
+				const auto sum = 
+					src[(size_t(y0) * srcWidth + x0) * numComponents + c] + src[(size_t(y0) * srcWidth + x1) * numComponents + c] +
+					src[(size_t(y1) * srcWidth + x0) * numComponents + c] + src[(size_t(y1) * srcWidth + x1) * numComponents + c];
+				dst[(size_t(y) * dstWidth + x) * numComponents + c] = uint8_t((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+// decodes the file, computes the mip chain and determines if it is transparent (thread safe).
+// The rows are flipped here instead of with the global stbi flag, which other threads may change while decoding
+static CachedTexture2D::Image decodeImage(const std::string& filename)
+{
+	CachedTexture2D::Image image;
+	image.filename = filename;
+
+	auto data = stbi_load(filename.c_str(), &image.width, &image.height, &image.numComponents, 0);
 	if (!data)
 		throw std::runtime_error("cannot load texture " + filename);
 
-	auto format = getSizedFormatFromComponents(numComponents);
-
-	// reinitialize texture
-	reinterpret_cast<gl::Texture2D&>(*this) = gl::Texture2D(format, width, height);
-	update(getFormatFromComponents(numComponents), gl::SetDataType::UINT8, data);
-	generateMipmaps();
+	image.levels = int(gl::computeMaxMipMapLevels(GLuint(std::max(image.width, image.height))));
+	auto levels = std::make_shared<std::vector<uint8_t>>(image.byteSize());
+	// bottom row first (opengl texture coordinates)
+	const auto rowSize = size_t(image.width) * size_t(image.numComponents);
+	for (int y = 0; y < image.height; ++y)
+		memcpy(levels->data() + size_t(image.height - 1 - y) * rowSize, data + size_t(y) * rowSize, rowSize);
+	stbi_image_free(data);
+	for (int level = 1; level < image.levels; ++level)
+	{
+		downsample(levels->data() + image.levelOffset(level - 1), image.levelWidth(level - 1), image.levelHeight(level - 1),
+			levels->data() + image.levelOffset(level), image.levelWidth(level), image.levelHeight(level), image.numComponents);
+	}
+	image.pixels = std::shared_ptr<const uint8_t>(levels, levels->data());
 
 	// determine if transparent
-	if(numComponents == 4)
+	if(image.numComponents == 4)
 	{
-		auto bytes = reinterpret_cast<unsigned char*>(data);
-		auto end = bytes + width * height * numComponents;
+		auto bytes = levels->data();
+		auto end = bytes + image.levelSize(0);
 		while(bytes != end)
 		{
 			// alpha
 			if(bytes[3] != 255)
 			{
-				m_isTransparent = true;
+				image.isTransparent = true;
 				break;
 			}
 			bytes += 4; // next pixel
 		}
 	}
 
-	stbi_image_free(data);
+	return image;
+}
+
+// takes the image from the texture cache or decodes it and updates the cache
+static CachedTexture2D::Image loadImage(const std::string& filename)
+{
+	std::string cacheFilename;
+	try
+	{
+		cacheFilename = TextureCache::getCacheFilename(filename);
+	}
+	catch (const std::exception&)
+	{
+		throw std::runtime_error("cannot load texture " + filename);
+	}
+
+	CachedTexture2D::Image image;
+	if (TextureCache::load(cacheFilename, image))
+	{
+		image.filename = filename;
+		return image;
+	}
+
+	image = decodeImage(filename);
+	TextureCache::save(cacheFilename, image);
+	return image;
+}
+
+CachedTexture2D::CachedTexture2D(const Image& image, const void* pixels)
+	:
+Texture(getSizedFormatFromComponents(image.numComponents), image.width, image.height, GLuint(image.levels)),
+m_isTransparent(image.isTransparent)
+{
+	// the mip levels are precomputed
+	glBindTexture(GL_TEXTURE_2D, getId());
+	// rows of rgb textures are not 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int level = 0; level < image.levels; ++level)
+	{
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, image.levelWidth(level), image.levelHeight(level),
+			GLenum(getFormatFromComponents(image.numComponents)), GL_UNSIGNED_BYTE, static_cast<const uint8_t*>(pixels) + image.levelOffset(level));
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+std::vector<uint8_t> CachedTexture2D::readChannel(int channel) const
+{
+	const size_t numTexels = size_t(width()) * size_t(height());
+	std::vector<uint8_t> rgba(numTexels * 4);
+	glBindTexture(GL_TEXTURE_2D, getId());
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	std::vector<uint8_t> res(numTexels);
+	for (size_t i = 0; i < numTexels; ++i)
+		res[i] = rgba[i * 4 + channel];
+	return res;
 }
 
 std::shared_ptr<CachedTexture2D> CachedTexture2D::loadFromFile(const std::string& filename)
@@ -86,8 +182,9 @@ std::shared_ptr<CachedTexture2D> CachedTexture2D::loadFromFile(const std::string
 		return it->second;
 
 	// create new one
+	const auto image = loadImage(filename);
 	std::shared_ptr<CachedTexture2D> tex;
-	tex.reset(new CachedTexture2D(filename));
+	tex.reset(new CachedTexture2D(image, image.pixels.get()));
 	s_cachedTextures[filename] = tex;
 	return tex;
 }
@@ -106,6 +203,96 @@ std::shared_ptr<CachedTexture2D> CachedTexture2D::loadConstant(const glm::vec4&
 	return tex;
 }
 
+std::vector<std::future<CachedTexture2D::Image>> CachedTexture2D::decodeAsync(const std::vector<std::string>& filenames)
+{
+	auto& pool = ThreadPool::get();
+	std::vector<std::future<Image>> res;
+	std::unordered_set<std::string> queued;
+	for (const auto& filename : filenames)
+	{
+		if (s_cachedTextures.find(filename) != s_cachedTextures.end() || !queued.insert(filename).second)
+			continue;
+
+		res.push_back(pool.enqueue([filename]()
+		{
+			return loadImage(filename);
+		}));
+	}
+	return res;
+}
+
+void CachedTexture2D::uploadDecoded(std::vector<std::future<Image>>& images)
+{
+	std::vector<Image> decoded;
+	decoded.reserve(images.size());
+	for (auto& i : images)
+	{
+		try
+		{
+			decoded.push_back(i.get());
+		}
+		catch (const std::exception&)
+		{
+			// not cached, loadFromFile() will report the error
+		}
+	}
+	images.clear();
+	if (decoded.empty())
+		return;
+
+	// images that are larger than the staging size get their own buffer size
+	size_t stagingSize = STAGING_SIZE;
+	for (const auto& i : decoded)
+		stagingSize = std::max(stagingSize, i.byteSize());
+
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(stagingSize), nullptr, GL_MAP_WRITE_BIT);
+
+	auto& pool = ThreadPool::get();
+	std::vector<size_t> offsets(decoded.size());
+	for (size_t first = 0; first < decoded.size();)
+	{
+		// fill the staging buffer with as many images as possible
+		size_t last = first;
+		size_t size = 0;
+		for (; last < decoded.size() && size + decoded[last].byteSize() <= stagingSize; ++last)
+		{
+			offsets[last] = size;
+			size += decoded[last].byteSize();
+		}
+
+		// the storage is immutable and cannot be orphaned. The (synchronized) map waits until the uploads of the previous batch have read it
+		// and the invalidation only tells the driver that the old content is not needed
+		auto dst = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+		if (!dst)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+			throw std::runtime_error("could not map the texture staging buffer");
+		}
+		pool.parallelFor(first, last, [&](size_t i)
+		{
+			memcpy(dst + offsets[i], decoded[i].pixels.get(), decoded[i].byteSize());
+		});
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		for (auto i = first; i < last; ++i)
+		{
+			std::shared_ptr<CachedTexture2D> tex;
+			tex.reset(new CachedTexture2D(decoded[i], reinterpret_cast<const void*>(offsets[i])));
+			s_cachedTextures[decoded[i].filename] = tex;
+			// the decoded memory is not needed anymore
+			decoded[i].pixels.reset();
+		}
+		first = last;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+}
+
 void CachedTexture2D::clearCache()
 {
 	s_cachedConstantTextures.clear();
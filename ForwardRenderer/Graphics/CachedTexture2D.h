@@ -4,14 +4,56 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <future>
+#include <algorithm>
 #include "../Dependencies/gl/texture.hpp"
 
 class CachedTexture2D : public gl::Texture2D
 {
+public:
+	// decoded texture file with its full mip chain (can be created on any thread)
+	struct Image
+	{
+		std::string filename;
+		int width = 0;
+		int height = 0;
+		int numComponents = 0;
+		int levels = 1;
+		// tightly packed mip levels, starting with the base level
+		std::shared_ptr<const uint8_t> pixels;
+		// at least one alpha value below 255
+		bool isTransparent = false;
+
+		int levelWidth(int level) const
+		{
+			return std::max(width >> level, 1);
+		}
+		int levelHeight(int level) const
+		{
+			return std::max(height >> level, 1);
+		}
+		size_t levelSize(int level) const
+		{
+			return size_t(levelWidth(level)) * size_t(levelHeight(level)) * size_t(numComponents);
+		}
+		size_t levelOffset(int level) const
+		{
+			size_t offset = 0;
+			for (int l = 0; l < level; ++l)
+				offset += levelSize(l);
+			return offset;
+		}
+		// size of all mip levels
+		size_t byteSize() const
+		{
+			return levelOffset(levels);
+		}
+	};
+private:
 	// create texture with a single color
 	CachedTexture2D(const glm::vec4& color);
-	// load texture from file
-	CachedTexture2D(const std::string& filename);
+	// create texture from a decoded image. pixels is either the image memory or an offset into the bound pixel unpack buffer
+	CachedTexture2D(const Image& image, const void* pixels);
 public:
 	CachedTexture2D(const CachedTexture2D&) = delete;
 	CachedTexture2D& operator=(const CachedTexture2D&) = delete;
@@ -22,11 +64,26 @@ public:
 		return m_isTransparent;
 	}
 
+	// reads one channel (0 = red, 3 = alpha) of the base level from the gpu. Intended for load time analysis
+	std::vector<uint8_t> readChannel(int channel) const;
+
 	// load texture from file
 	static std::shared_ptr<CachedTexture2D> loadFromFile(const std::string& filename);
 	// create texture with a single color
 	static std::shared_ptr<CachedTexture2D> loadConstant(const glm::vec4& color);
 
+	/**
+	 * \brief starts decoding the texture files on the thread pool. Files that are already cached are skipped.
+	 * Images are taken from the TextureCache if possible.
+	 * \return pending images for uploadDecoded()
+	 */
+	static std::vector<std::future<Image>> decodeAsync(const std::vector<std::string>& filenames);
+	/**
+	 * \brief waits for the decoded images and uploads them through pixel buffer staging into the cache.
+	 * Images that could not be decoded are skipped.
+	 */
+	static void uploadDecoded(std::vector<std::future<Image>>& images);
+
 	// empties the cache. note: textures will only be deleted if no shared pointers use them
 	static void clearCache();
 
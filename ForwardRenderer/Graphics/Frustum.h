@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <limits>
+#include <cmath>
+#include <glm/glm.hpp>
+
+/**
+ * \brief clip planes of a view projection matrix for bounding box culling
+ */
+class Frustum
+{
+public:
+	explicit Frustum(const glm::mat4& viewProjection)
+		:
+	m_viewProjection(viewProjection),
+	// the camera position is projected to (0, 0, z, 0). Orthographic projections give the view direction with w = 0
+	m_eye(glm::inverse(viewProjection) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f))
+	{
+		// rows of the matrix (Gribb and Hartmann)
+		const auto m = glm::transpose(viewProjection);
+		m_planes[0] = m[3] + m[0]; // left
+		m_planes[1] = m[3] - m[0]; // right
+		m_planes[2] = m[3] + m[1]; // bottom
+		m_planes[3] = m[3] - m[1]; // top
+		m_planes[4] = m[3] + m[2]; // near
+		m_planes[5] = m[3] - m[2]; // far
+	}
+
+	/**
+	 * \brief conservative intersection test (boxes near the frustum edges may be reported as visible)
+	 * \return false if the box is completely outside of the frustum
+	 */
+	bool isVisible(const glm::vec3& bboxMin, const glm::vec3& bboxMax) const
+	{
+		for (const auto& p : m_planes)
+		{
+			// box corner that is the furthest along the plane normal
+			const glm::vec3 corner(
+				p.x >= 0.0f ? bboxMax.x : bboxMin.x,
+				p.y >= 0.0f ? bboxMax.y : bboxMin.y,
+				p.z >= 0.0f ? bboxMax.z : bboxMin.z);
+			if (glm::dot(glm::vec3(p), corner) + p.w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+	/**
+	 * \brief projected size of the box as fraction of the viewport (larger side)
+	 * \return the size of the whole viewport if the box reaches behind the camera
+	 */
+	float getScreenSize(const glm::vec3& bboxMin, const glm::vec3& bboxMax) const
+	{
+		glm::vec2 ndcMin(std::numeric_limits<float>::max());
+		glm::vec2 ndcMax(-std::numeric_limits<float>::max());
+		for (int i = 0; i < 8; ++i)
+		{
+			const glm::vec4 corner(i & 1 ? bboxMax.x : bboxMin.x, i & 2 ? bboxMax.y : bboxMin.y, i & 4 ? bboxMax.z : bboxMin.z, 1.0f);
+			const auto clip = m_viewProjection * corner;
+			if (clip.w <= 0.0f)
+				return 1.0f;
+			const auto ndc = glm::vec2(clip) / clip.w;
+			ndcMin = glm::min(ndcMin, ndc);
+			ndcMax = glm::max(ndcMax, ndc);
+		}
+		// the viewport is two units wide
+		const auto size = (ndcMax - ndcMin) * 0.5f;
+		return glm::max(size.x, size.y);
+	}
+
+	// clip space depth that increases with the distance to the camera (for sorting)
+	float getDepth(const glm::vec3& point) const
+	{
+		return (m_viewProjection * glm::vec4(point, 1.0f)).z;
+	}
+
+	/**
+	 * \brief conservative test if all faces inside of a sphere face away from the camera
+	 * \param coneAxis average normal of the faces
+	 * \param coneCutoff cosine of the largest angle between the axis and a face normal
+	 */
+	bool isBackfacing(const glm::vec3& center, float radius, const glm::vec3& coneAxis, float coneCutoff) const
+	{
+		if (coneCutoff <= 0.0f)
+			return false;
+
+		// direction from the camera to the sphere and the angular radius of the sphere
+		glm::vec3 view;
+		float spread = 0.0f;
+		if (std::abs(m_eye.w) > 1e-6f * glm::length(glm::vec3(m_eye)))
+		{
+			view = center - glm::vec3(m_eye) / m_eye.w;
+			const auto distance = glm::length(view);
+			if (distance <= radius)
+				return false;
+			view /= distance;
+			spread = std::asin(radius / distance);
+		}
+		else view = glm::normalize(glm::vec3(m_eye));
+
+		// the angle between every view direction and every normal must be below 90 degrees
+		const auto angle = std::acos(coneCutoff) + spread;
+		if (angle >= 1.5707963f)
+			return false;
+		return glm::dot(view, coneAxis) > std::sin(angle);
+	}
+private:
+	std::array<glm::vec4, 6> m_planes;
+	glm::mat4 m_viewProjection;
+	// homogeneous camera position
+	glm::vec4 m_eye;
+};
@@ -5,6 +5,8 @@
 #include <cassert>
 #include <queue>
 #include "../Framework/Profiler.h"
+#include "../Framework/QuantileSketch.h"
+#include "../ScriptEngine/ScriptEngine.h"
 #include "../Dependencies/gl/query.h"
 
 class GpuTimer
@@ -26,6 +28,7 @@ public:
 			m_currentQuery = std::move(m_freeQueries.back());
 			m_freeQueries.pop_back();
 			m_currentQuery.begin();
+			m_currentFrame = ScriptEngine::getIteration();
 			curTimer() = this;
 		}
 	}
@@ -37,14 +40,33 @@ public:
 
 		glEndQuery(GL_TIME_ELAPSED);
 		m_runningQueries.push(std::move(m_currentQuery));
+		m_runningFrames.push(m_currentFrame);
 		curTimer() = nullptr;
 		receive();
 	}
 	Profiler::Profile get() const
 	{
-		return {
-			min(), max(), latest(), average(), median()
-		};
+		Profiler::Profile res;
+		res.min = min();
+		res.max = max();
+		res.latest = latest();
+		res.average = average();
+		res.stddev = stddev();
+		res.frame = m_latestFrame;
+
+		// the named percentiles in a single pass
+		const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+		double values[4];
+		m_sketch.quantiles(q, values, 4);
+		res.median = values[0] / TIME_DIVIDE;
+		res.p90 = values[1] / TIME_DIVIDE;
+		res.p99 = values[2] / TIME_DIVIDE;
+		res.p999 = values[3] / TIME_DIVIDE;
+
+		double percent;
+		if (Profiler::getActivePercentile(percent))
+			res.percentile = percentile(percent);
+		return res;
 	}
 	double average() const
 	{
@@ -64,10 +86,17 @@ public:
 	}
 	double median() const
 	{
-		//return m_weighted;
-		if (m_lastValues.empty()) return 0.0;
-		return m_lastValues[m_lastValues.size() / 2] / TIME_DIVIDE;
-		//return std::accumulate(m_lastValues.begin(), m_lastValues.end(), size_t(0)) / m_lastValues.size() / TIME_DIVIDE;
+		return percentile(50.0);
+	}
+	// percent in [0, 100]
+	double percentile(double percent) const
+	{
+		return m_sketch.quantile(percent / 100.0) / TIME_DIVIDE;
+	}
+	double stddev() const
+	{
+		if (m_sumCount < 2) return 0.0;
+		return std::sqrt(m_squaredDeviations / double(m_sumCount - 1)) / TIME_DIVIDE;
 	}
 	void receive()
 	{
@@ -79,11 +108,17 @@ public:
 
 			// update statistics
 			m_latestTime = size_t(res);
+			m_latestFrame = m_runningFrames.front();
+			m_runningFrames.pop();
 			m_sumTime += size_t(res);
 			++m_sumCount;
 			m_minTime = (std::min)(m_latestTime, m_minTime);
 			m_maxTime = (std::max)(m_latestTime, m_maxTime);
-			updateMedian(size_t(res));
+			m_sketch.add(double(res));
+			// running variance (Welford)
+			const auto delta = double(res) - m_runningMean;
+			m_runningMean += delta / double(m_sumCount);
+			m_squaredDeviations += delta * (double(res) - m_runningMean);
 			if (m_weighted == 0.0)
 				m_weighted = res / TIME_DIVIDE;
 			else
@@ -102,20 +137,14 @@ private:
 		static GpuTimer* ptr = nullptr;
 		return ptr;
 	}
-	void updateMedian(size_t time)
-	{
-		// sortedinsert
-		m_lastValues.insert(
-			std::upper_bound(m_lastValues.begin(), m_lastValues.end(), time),
-			time
-		);
-		if (m_lastValues.size() > MAX_LAST_VALUES)
-			m_lastValues.pop_back();
-	}
 private:
 	std::queue<gl::TimeElapsedQuery> m_runningQueries;
 	std::vector<gl::TimeElapsedQuery> m_freeQueries;
 	gl::TimeElapsedQuery m_currentQuery = gl::TimeElapsedQuery::empty();
+	// frames that issued the running queries
+	std::queue<size_t> m_runningFrames;
+	size_t m_currentFrame = 0;
+	size_t m_latestFrame = Profiler::Profile::NO_FRAME;
 	size_t m_sumTime = 0;
 	size_t m_sumCount = 0;
 	size_t m_latestTime = 0;
@@ -123,8 +152,10 @@ private:
 	size_t m_maxTime = 0;
 	double m_weighted = 0.0;
 
-	// this is used for the median
-	std::vector<size_t> m_lastValues;
-	inline static size_t MAX_LAST_VALUES = 4096;
+	double m_runningMean = 0.0;
+	double m_squaredDeviations = 0.0;
+
+	// this is used for the median and percentiles
+	QuantileSketch m_sketch;
 	static constexpr double TIME_DIVIDE = 1000000.0;
 };
@@ -5,6 +5,8 @@
 #include <numeric>
 #include <filesystem>
 #include <map>
+#include <algorithm>
+#include <iterator>
 namespace fs = std::experimental::filesystem;
 
 struct HotReloadShader
@@ -94,9 +96,12 @@ struct HotReloadShader
 	{
 		friend HotReloadShader;
 		WatchedProgram(std::initializer_list<std::shared_ptr<WatchedShader>> usedShader)
-			:
-		m_usedShader(usedShader)
 		{
+			// optional stages are null
+			std::copy_if(usedShader.begin(), usedShader.end(), std::back_inserter(m_usedShader), [](const auto& shader)
+			{
+				return shader != nullptr;
+			});
 		}
 		bool hasShader(const WatchedShader& shader) const
 		{
@@ -143,6 +148,7 @@ struct HotReloadShader
 	 * \return 
 	 */
 	static std::shared_ptr<WatchedShader> loadShader(gl::Shader::Type type, const fs::path& filename, size_t glVersion = 430, std::string preamble = "");
+	// null shaders are skipped
 	static std::shared_ptr<WatchedProgram> loadProgram(std::initializer_list<std::shared_ptr<WatchedShader>> shader);
 
 	static void initScripts();
@@ -12,6 +12,9 @@ public:
 	virtual void addLight(ParamSet light) = 0;
 	virtual void removeLight(int index) = 0;
 
+	// the shadows are rendered again by the next upload (the geometry of the model changed)
+	virtual void invalidate() = 0;
+
 	// uploads the lights and the new shadows
 	virtual void upload(IShadows& shadows, const IModel& model, ITransforms& transforms) = 0;
 	virtual void bind() const = 0;
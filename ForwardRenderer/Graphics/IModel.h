@@ -4,6 +4,7 @@
 #include <memory>
 #include <vector>
 #include "IMaterials.h"
+#include "Bvh.h"
 
 class IModel
 {
@@ -15,6 +16,62 @@ public:
 	virtual const std::vector<std::unique_ptr<IShape>>& getShapes() const = 0;
 	virtual const IMaterials& getMaterial() const = 0;
 
+	/**
+	 * \brief restricts the following draw calls of the shapes to the parts that intersect the frustum
+	 * and selects the levels of detail for the frustum.
+	 * The result is shared by all passes. Passes that cull to another frustum than the camera (shadows, environment map)
+	 * call resetCulling() afterwards, so that the following draws never use the visibility of a light or cube face
+	 * \return number of visible shapes
+	 */
+	virtual size_t cull(const Frustum& frustum) const = 0;
+	// everything is visible with the full detail until the next cull()
+	virtual void resetCulling() const = 0;
+
+	struct TriangleStatistics
+	{
+		// triangles of all instances that are drawn after the last cull()
+		size_t drawn = 0;
+		// triangles that the levels of detail removed
+		size_t saved = 0;
+	};
+	virtual TriangleStatistics getTriangleStatistics() const = 0;
+
+	// triangle hierarchy for cpu queries (ray casts and depth ranges)
+	virtual const Bvh& getBvh() const = 0;
+
+	// unindexed triangles for cpu renderers
+	struct Geometry
+	{
+		struct Vertex
+		{
+			glm::vec3 position;
+			glm::vec3 normal;
+			glm::vec2 texcoord;
+		};
+		// three vertices per triangle, transformed by the instance transformations
+		std::vector<Vertex> vertices;
+		// index into getShapes() for each triangle
+		std::vector<uint32_t> triangleShapes;
+		// material of each shape
+		std::vector<const ParamSet*> shapeMaterials;
+	};
+	/**
+	 * \brief appends the full detail triangles of all instances and the materials of all shapes.
+	 * The triangles are read back from the gpu buffers (intended for reference images, not for every frame)
+	 */
+	virtual void getGeometry(Geometry& geometry) const = 0;
+	// changes whenever getGeometry() would return other triangles (e.g. after setInstances), for caching the geometry
+	virtual size_t getGeometryVersion() const = 0;
+
+	/**
+	 * \brief replaces the instances of the model. Each shape is drawn once per instance (instanced draw calls)
+	 * and the instance transformation is applied before the model transformation.
+	 * Bounding boxes and culling cover all instances, the bvh only contains the untransformed model
+	 * \param transforms at least one transformation
+	 */
+	virtual void setInstances(const std::vector<glm::mat4>& transforms) = 0;
+	virtual size_t getNumInstances() const = 0;
+
 	// functions for scene bounding box retrieval
 	virtual const glm::vec3& getBoundingMin() const = 0;
 	virtual const glm::vec3& getBoundingMax() const = 0;
@@ -1,14 +1,47 @@
 #include "IRenderer.h"
 #include "../ScriptEngine/ScriptEngine.h"
+#include "../Implementations/SimpleShader.h"
+#include "../Framework/Profiler.h"
+#include <mutex>
 
 glm::vec4 IRenderer::s_clearColor = glm::vec4(0.4666f, 0.709f, 0.87f, 0.99f);
 int IRenderer::s_filterMaterial = -1;
+bool IRenderer::s_useGeometryShader = false;
 
 void IRenderer::setClearColor()
 {
 	glClearColor(s_clearColor.r, s_clearColor.g, s_clearColor.b, s_clearColor.a);
 }
 
+std::shared_ptr<HotReloadShader::WatchedShader> IRenderer::loadGeometryShader()
+{
+	if (!s_useGeometryShader)
+		return nullptr;
+	return HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+}
+
+std::unique_ptr<IShader> IRenderer::loadCutoutShader(const std::shared_ptr<HotReloadShader::WatchedShader>& vertex,
+	const std::shared_ptr<HotReloadShader::WatchedShader>& geometry)
+{
+	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs", 430, "#define ALPHA_TEST");
+	return std::make_unique<SimpleShader>(HotReloadShader::loadProgram({ vertex, geometry, fragment }));
+}
+
+void IRenderer::drawCutoutShapes(const RenderArgs& args, IShader& shader, GpuTimer& timer)
+{
+	{
+		std::lock_guard<GpuTimer> g(timer);
+		// alpha tested shapes write depth like opaque shapes
+		args.model->prepareDrawing(shader);
+		for (const auto& s : args.model->getShapes())
+		{
+			if (s->isCutout())
+				s->draw(&shader);
+		}
+	}
+	Profiler::set("cutout", timer.get());
+}
+
 void IRenderer::initScripts()
 {
 	ScriptEngine::addProperty("clearColor", []()
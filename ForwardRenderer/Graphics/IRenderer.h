@@ -1,5 +1,8 @@
 #pragma once
 #include "RenderArgs.h"
+#include "HotReloadShader.h"
+#include "IShader.h"
+#include "GpuTimer.h"
 
 class IRenderer
 {
@@ -12,7 +15,16 @@ public:
 	static glm::vec4 s_clearColor;
 	// only draw material with this id (draw all if id == -1)
 	static int s_filterMaterial;
+	// the default programs generate flat normals in DefaultShader.gs instead of using the normals of the model
+	static bool s_useGeometryShader;
 
 	static void setClearColor();
+	// DefaultShader.gs or nullptr if the geometry shader is disabled
+	static std::shared_ptr<HotReloadShader::WatchedShader> loadGeometryShader();
+	// DefaultShader.fs with the alpha test for the cutout shapes
+	static std::unique_ptr<IShader> loadCutoutShader(const std::shared_ptr<HotReloadShader::WatchedShader>& vertex,
+		const std::shared_ptr<HotReloadShader::WatchedShader>& geometry);
+	// draws the cutout shapes into the bound framebuffer and sets the cutout profile
+	static void drawCutoutShapes(const RenderArgs& args, IShader& shader, GpuTimer& timer);
 	static void initScripts();
 };
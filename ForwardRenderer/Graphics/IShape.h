@@ -1,4 +1,5 @@
 #pragma once
+#include <glm/glm.hpp>
 
 class IShader;
 
@@ -8,4 +9,9 @@ public:
 	virtual ~IShape(){}
 	virtual void draw(IShader* shader) = 0;
 	virtual bool isTransparent() const = 0;
+	// alpha tested shape that is drawn in the opaque pass (discards fragments with alpha < 0.5)
+	virtual bool isCutout() const { return false; }
+
+	virtual const glm::vec3& getBoundingMin() const = 0;
+	virtual const glm::vec3& getBoundingMax() const = 0;
 };
@@ -5,6 +5,7 @@
 #include "ITransforms.h"
 #include "IEnvironmentMap.h"
 #include "IShadows.h"
+#include "../Framework/Profiler.h"
 
 struct RenderArgs
 {
@@ -35,6 +36,14 @@ struct RenderArgs
 		return !isNotNull();
 	}
 
+	// culls the model against the camera frustum for all following passes
+	void cullToCamera() const
+	{
+		Profiler::set("visible_camera", double(model->cull(Frustum(camera->getProjection()))));
+		Profiler::set("triangles_camera", double(model->getTriangleStatistics().drawn));
+		Profiler::set("lod_saved_camera", double(model->getTriangleStatistics().saved));
+	}
+
 	// binds lights shadows and envmap (relevant light information)
 	void bindLightData() const
 	{
@@ -0,0 +1,165 @@
+#include "TextureCache.h"
+#include "../Framework/MappedFile.h"
+#include "../ScriptEngine/ScriptEngine.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <cstring>
+namespace fs = std::experimental::filesystem;
+
+// increase this number if the layout of the cache changes
+static const uint32_t CACHE_MAGIC = 0x58455443; // "CTEX"
+static const uint32_t CACHE_VERSION = 1;
+static const char* CACHE_DIRECTORY = "TextureCache";
+
+static bool s_useCache = true;
+static std::atomic<size_t> s_numLookups{ 0 };
+static std::atomic<size_t> s_numHits{ 0 };
+
+struct CacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t numComponents;
+	int32_t levels;
+	uint32_t isTransparent;
+	uint32_t padding;
+	uint64_t byteSize;
+};
+
+// 64 bit FNV-1a over 8 byte words
+static uint64_t hashContents(const uint8_t* data, size_t size)
+{
+	const uint64_t prime = 0x100000001B3ull;
+	uint64_t hash = 0xCBF29CE484222325ull ^ uint64_t(size);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (; i < size; ++i)
+		hash = (hash ^ data[i]) * prime;
+	return hash;
+}
+
+std::string TextureCache::getCacheFilename(const std::string& textureFilename)
+{
+	if (!s_useCache)
+		return "";
+
+	MappedFile file(textureFilename);
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.tex", static_cast<unsigned long long>(hashContents(file.data(), file.size())));
+	return (fs::path(CACHE_DIRECTORY) / name).string();
+}
+
+bool TextureCache::load(const std::string& cacheFilename, CachedTexture2D::Image& dst)
+{
+	if (cacheFilename.empty())
+		return false;
+
+	++s_numLookups;
+	try
+	{
+		if (!fs::exists(cacheFilename))
+			return false;
+
+		auto file = std::make_shared<MappedFile>(cacheFilename);
+		if (file->size() < sizeof(CacheHeader))
+			throw std::runtime_error("unexpected end of cache file");
+
+		CacheHeader header;
+		memcpy(&header, file->data(), sizeof(header));
+		if (header.magic != CACHE_MAGIC)
+			throw std::runtime_error("invalid cache file");
+		if (header.version != CACHE_VERSION)
+			return false;
+
+		dst.width = header.width;
+		dst.height = header.height;
+		dst.numComponents = header.numComponents;
+		dst.levels = header.levels;
+		dst.isTransparent = header.isTransparent != 0;
+		if (dst.width <= 0 || dst.height <= 0 || dst.numComponents < 1 || dst.numComponents > 4 || dst.levels < 1 || dst.levels > 32
+			|| header.byteSize != dst.byteSize() || header.byteSize > file->size() - sizeof(CacheHeader))
+			throw std::runtime_error("corrupted cache file");
+
+		// the image keeps the file mapped
+		dst.pixels = std::shared_ptr<const uint8_t>(file, file->data() + sizeof(CacheHeader));
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERR: could not read texture cache " << cacheFilename << ": " << e.what() << '\n';
+		dst = CachedTexture2D::Image();
+		return false;
+	}
+
+	++s_numHits;
+	return true;
+}
+
+void TextureCache::save(const std::string& cacheFilename, const CachedTexture2D::Image& src)
+{
+	if (cacheFilename.empty())
+		return;
+
+	// the temporary file is unique per thread because textures with the same contents may be saved simultaneously
+	const auto tmpFilename = cacheFilename + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	try
+	{
+		fs::create_directories(CACHE_DIRECTORY);
+		{
+			std::ofstream file(tmpFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				throw std::runtime_error("could not create file");
+
+			CacheHeader header = {};
+			header.magic = CACHE_MAGIC;
+			header.version = CACHE_VERSION;
+			header.width = src.width;
+			header.height = src.height;
+			header.numComponents = src.numComponents;
+			header.levels = src.levels;
+			header.isTransparent = src.isTransparent;
+			header.byteSize = src.byteSize();
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(reinterpret_cast<const char*>(src.pixels.get()), std::streamsize(header.byteSize));
+			if (!file.good())
+				throw std::runtime_error("could not write file");
+		}
+
+		if (fs::exists(cacheFilename))
+			fs::remove(cacheFilename);
+		fs::rename(tmpFilename, cacheFilename);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERR: could not save texture cache " << cacheFilename << ": " << e.what() << '\n';
+		std::error_code ec;
+		fs::remove(tmpFilename, ec);
+	}
+}
+
+void TextureCache::initScripts()
+{
+	ScriptEngine::addProperty("textureCache", []()
+	{
+		return std::to_string(s_useCache);
+	}, [](const std::vector<Token>& args)
+	{
+		s_useCache = args.at(0).getBool();
+	});
+
+	// hits / lookups of all textures that were loaded since the start
+	ScriptEngine::addProperty("textureCacheHitRatio", []()
+	{
+		const size_t lookups = s_numLookups;
+		return std::to_string(lookups ? double(s_numHits) / double(lookups) : 0.0);
+	});
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include "CachedTexture2D.h"
+
+/**
+ * \brief content hashed on-disk cache for decoded textures with their full mip chain.
+ * Each entry is named after the hash of the texture file contents and stored in the TextureCache directory,
+ * therefore warm starts neither decode images nor generate mip maps.
+ */
+class TextureCache
+{
+	TextureCache() = default;
+public:
+	/**
+	 * \brief hashes the contents of the texture file
+	 * \param textureFilename original image file
+	 * \return filename of the cache entry or an empty string if the cache is disabled
+	 * \throws runtime_error if the texture file could not be read
+	 */
+	static std::string getCacheFilename(const std::string& textureFilename);
+
+	/**
+	 * \brief tries to load a cache entry (thread safe). The pixels stay memory mapped until the image is released
+	 * \param cacheFilename filename from getCacheFilename()
+	 * \param dst destination for the cached image
+	 * \return true if a valid entry was found
+	 */
+	static bool load(const std::string& cacheFilename, CachedTexture2D::Image& dst);
+
+	/**
+	 * \brief writes the image with all mip levels into the cache (thread safe, errors are reported but not thrown)
+	 * \param cacheFilename filename from getCacheFilename()
+	 * \param src image that should be cached
+	 */
+	static void save(const std::string& cacheFilename, const CachedTexture2D::Image& src);
+
+	static void initScripts();
+};
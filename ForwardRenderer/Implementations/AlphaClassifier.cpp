@@ -0,0 +1,273 @@
+#include "AlphaClassifier.h"
+#include "../Framework/ThreadPool.h"
+#include <map>
+#include <array>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	// additional texels around the uv footprint (bilinear filtering reads the neighbour texels)
+	const float FILTER_BORDER = 1.0f;
+	// triangles per task
+	const size_t GRAIN_SIZE = 1024;
+	// alpha values in [BINARY_THRESHOLD, 255 - BINARY_THRESHOLD] are neither opaque nor fully transparent
+	const int BINARY_THRESHOLD = 16;
+	// maximum fraction of intermediate alpha values for an alpha test (antialiased cutout edges)
+	const float BINARY_MAX_PARTIAL = 0.02f;
+
+	/**
+	 * \brief summed area table of the texels with an alpha value below 255 and alpha histogram of the texture
+	 */
+	class AlphaMask
+	{
+	public:
+		AlphaMask(const CachedTexture2D& texture, int channel)
+			:
+		m_width(texture.width()),
+		m_height(texture.height()),
+		m_alpha(texture.readChannel(channel)),
+		m_sat(size_t(m_width + 1) * size_t(m_height + 1), 0)
+		{
+			std::array<size_t, 256> histogram = {};
+			for (int y = 0; y < m_height; ++y)
+			{
+				uint32_t rowSum = 0;
+				for (int x = 0; x < m_width; ++x)
+				{
+					const auto alpha = m_alpha[size_t(y) * m_width + x];
+					++histogram[alpha];
+					rowSum += alpha != 255 ? 1 : 0;
+					sat(x + 1, y + 1) = sat(x + 1, y) + rowSum;
+				}
+			}
+
+			size_t numPartial = 0;
+			for (int a = BINARY_THRESHOLD; a <= 255 - BINARY_THRESHOLD; ++a)
+				numPartial += histogram[a];
+			m_isBinary = float(numPartial) <= BINARY_MAX_PARTIAL * float(m_alpha.size());
+		}
+
+		bool isEmpty() const
+		{
+			return sat(m_width, m_height) == 0;
+		}
+
+		// true if the texels are (almost) only opaque or fully transparent
+		bool isBinary() const
+		{
+			return m_isBinary;
+		}
+
+		/**
+		 * \brief tests if the triangle covers at least one texel with alpha < 255
+		 * \param uv texture coordinates of the triangle
+		 */
+		bool isTransparent(const glm::vec2 (&uv)[3]) const
+		{
+			glm::vec2 p[3];
+			for (int i = 0; i < 3; ++i)
+				p[i] = uv[i] * glm::vec2(float(m_width), float(m_height));
+
+			const auto pMin = glm::min(p[0], glm::min(p[1], p[2])) - FILTER_BORDER;
+			const auto pMax = glm::max(p[0], glm::max(p[1], p[2])) + FILTER_BORDER;
+			if (!std::isfinite(pMin.x) || !std::isfinite(pMin.y) || !std::isfinite(pMax.x) || !std::isfinite(pMax.y))
+				return true;
+
+			// footprints that wrap around the whole texture cover all texels of that axis
+			int x0 = int(std::floor(pMin.x)), x1 = int(std::ceil(pMax.x));
+			int y0 = int(std::floor(pMin.y)), y1 = int(std::ceil(pMax.y));
+			bool clamped = false;
+			if (x1 - x0 >= m_width)
+			{
+				x0 = 0; x1 = m_width; clamped = true;
+			}
+			if (y1 - y0 >= m_height)
+			{
+				y0 = 0; y1 = m_height; clamped = true;
+			}
+
+			const auto count = countWrapped(x0, y0, x1, y1);
+			if (count == 0)
+				return false;
+			if (clamped || count == uint32_t(x1 - x0) * uint32_t(y1 - y0))
+				return true;
+
+			// inward facing edge normals
+			const float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+			if (std::abs(area) < 1e-6f)
+				return true; // degenerated footprint (the bbox contains transparent texels)
+
+			glm::vec2 normal[3];
+			float offset[3];
+			for (int i = 0; i < 3; ++i)
+			{
+				const auto& a = p[i];
+				const auto& b = p[(i + 1) % 3];
+				auto n = glm::vec2(-(b.y - a.y), b.x - a.x);
+				if (area < 0.0f) n = -n;
+				n = glm::normalize(n);
+				normal[i] = n;
+				offset[i] = glm::dot(n, a);
+			}
+
+			// a texel is covered if its center is closer than the half diagonal plus the filter border
+			const float tolerance = 0.7072f + FILTER_BORDER;
+			for (int y = y0; y < y1; ++y)
+			{
+				const auto row = size_t(wrap(y, m_height)) * m_width;
+				for (int x = x0; x < x1; ++x)
+				{
+					if (m_alpha[row + wrap(x, m_width)] == 255)
+						continue;
+
+					const glm::vec2 center(float(x) + 0.5f, float(y) + 0.5f);
+					if (glm::dot(normal[0], center) - offset[0] >= -tolerance &&
+						glm::dot(normal[1], center) - offset[1] >= -tolerance &&
+						glm::dot(normal[2], center) - offset[2] >= -tolerance)
+						return true;
+				}
+			}
+			return false;
+		}
+	private:
+		uint32_t& sat(int x, int y)
+		{
+			return m_sat[size_t(y) * (m_width + 1) + x];
+		}
+		uint32_t sat(int x, int y) const
+		{
+			return m_sat[size_t(y) * (m_width + 1) + x];
+		}
+
+		static int wrap(int v, int size)
+		{
+			v %= size;
+			return v < 0 ? v + size : v;
+		}
+
+		// number of transparent texels in [x0, x1) x [y0, y1) with all coordinates inside the texture
+		uint32_t count(int x0, int y0, int x1, int y1) const
+		{
+			return sat(x1, y1) - sat(x0, y1) - sat(x1, y0) + sat(x0, y0);
+		}
+
+		// number of transparent texels with repeat wrapping (x1 - x0 <= width, y1 - y0 <= height)
+		uint32_t countWrapped(int x0, int y0, int x1, int y1) const
+		{
+			int xs[4], ys[4];
+			const auto numX = split(x0, x1, m_width, xs);
+			const auto numY = split(y0, y1, m_height, ys);
+			uint32_t res = 0;
+			for (int i = 0; i < numX; i += 2)
+				for (int j = 0; j < numY; j += 2)
+					res += count(xs[i], ys[j], xs[i + 1], ys[j + 1]);
+			return res;
+		}
+
+		// splits the range into at most two ranges inside [0, size)
+		static int split(int v0, int v1, int size, int(&dst)[4])
+		{
+			const auto len = v1 - v0;
+			const auto start = wrap(v0, size);
+			if (start + len <= size)
+			{
+				dst[0] = start; dst[1] = start + len;
+				return 2;
+			}
+			dst[0] = start; dst[1] = size;
+			dst[2] = 0; dst[3] = start + len - size;
+			return 4;
+		}
+
+		int m_width;
+		int m_height;
+		std::vector<uint8_t> m_alpha;
+		std::vector<uint32_t> m_sat;
+		bool m_isBinary = false;
+	};
+
+	struct MaterialInfo
+	{
+		// the whole material is transparent
+		bool transparent = false;
+		std::vector<const AlphaMask*> masks;
+	};
+}
+
+std::vector<std::vector<uint8_t>> AlphaClassifier::classify(const ObjCache::Data& data, const IMaterials& materials, int defaultMaterialId)
+{
+	// read back the alpha textures (masks are shared between materials)
+	std::map<std::pair<const CachedTexture2D*, int>, std::unique_ptr<AlphaMask>> masks;
+	const auto getMask = [&masks](const std::shared_ptr<CachedTexture2D>& tex, int channel) -> const AlphaMask*
+	{
+		auto& mask = masks[{ tex.get(), channel }];
+		if (!mask)
+			mask = std::make_unique<AlphaMask>(*tex, channel);
+		return mask->isEmpty() ? nullptr : mask.get();
+	};
+
+	std::vector<MaterialInfo> infos(defaultMaterialId + 1);
+	for (int i = 0; i <= defaultMaterialId; ++i)
+	{
+		const auto& mat = materials.getMaterial(i);
+		auto& info = infos[i];
+		auto dissolve = mat.get<float>("dissolve");
+		if (dissolve && *dissolve < 1.0f)
+		{
+			info.transparent = true;
+			continue;
+		}
+		// the shader multiplies the dissolve texture red channel with the diffuse texture alpha
+		if (auto tex = mat.getTexture("dissolve"))
+			if (auto mask = getMask(tex, 0))
+				info.masks.push_back(mask);
+		auto diffuseTex = mat.getTexture("diffuse");
+		if (diffuseTex && diffuseTex->isTransparent())
+			if (auto mask = getMask(diffuseTex, 3))
+				info.masks.push_back(mask);
+	}
+
+	const auto& texcoords = data.attrib.texcoords;
+	const auto numTexcoords = int(texcoords.size() / 2);
+	const auto getTexcoord = [&texcoords, numTexcoords](const tinyobj::index_t& idx)
+	{
+		if (idx.texcoord_index < 0 || idx.texcoord_index >= numTexcoords)
+			return glm::vec2(0.0f);
+		return glm::vec2(texcoords[2 * idx.texcoord_index], texcoords[2 * idx.texcoord_index + 1]);
+	};
+
+	auto& pool = ThreadPool::get();
+	std::vector<std::vector<uint8_t>> res(data.shapes.size());
+	for (size_t s = 0; s < data.shapes.size(); ++s)
+	{
+		const auto& mesh = data.shapes[s].mesh;
+		auto& classes = res[s];
+		classes.resize(mesh.indices.size() / 3);
+		pool.parallelFor(0, classes.size(), [&](size_t t)
+		{
+			int materialId = t < mesh.material_ids.size() ? mesh.material_ids[t] : -1;
+			if (materialId < 0 || materialId >= defaultMaterialId)
+				materialId = defaultMaterialId;
+
+			const auto& info = infos[materialId];
+			auto c = info.transparent ? TRANSPARENT_TRIANGLE : OPAQUE_TRIANGLE;
+			if (!info.transparent && !info.masks.empty())
+			{
+				const glm::vec2 uv[3] = {
+					getTexcoord(mesh.indices[3 * t]),
+					getTexcoord(mesh.indices[3 * t + 1]),
+					getTexcoord(mesh.indices[3 * t + 2])
+				};
+				// a single non binary mask requires blending
+				for (const auto mask : info.masks)
+					if (c != TRANSPARENT_TRIANGLE && mask->isTransparent(uv))
+						c = mask->isBinary() ? CUTOUT_TRIANGLE : TRANSPARENT_TRIANGLE;
+			}
+			classes[t] = c;
+		}, GRAIN_SIZE);
+	}
+
+	return res;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "ObjCache.h"
+#include "../Graphics/IMaterials.h"
+
+/**
+ * \brief load time classification of triangles into opaque, cutout and transparent ones.
+ * The uv footprint of each triangle is rasterized into the alpha textures of its material,
+ * therefore only triangles that actually sample non-opaque texels end up in the transparent passes.
+ * Triangles that only sample alpha textures with a binary histogram (e.g. leaves or fences) are alpha tested instead.
+ */
+class AlphaClassifier
+{
+	AlphaClassifier() = default;
+public:
+	enum TriangleClass : uint8_t
+	{
+		OPAQUE_TRIANGLE = 0,
+		TRANSPARENT_TRIANGLE = 1,
+		CUTOUT_TRIANGLE = 2,
+	};
+
+	/**
+	 * \brief classifies all triangles of the obj data (multithreaded, textures are read back from the gpu)
+	 * \param materials uploaded materials of the model
+	 * \param defaultMaterialId material for faces without a valid material
+	 * \return class of each triangle for each shape
+	 */
+	static std::vector<std::vector<uint8_t>> classify(const ObjCache::Data& data, const IMaterials& materials, int defaultMaterialId);
+};
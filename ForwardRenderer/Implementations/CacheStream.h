@@ -0,0 +1,100 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+// bounds checked reader for the mapped cache file
+class CacheReader
+{
+public:
+	CacheReader(const uint8_t* data, size_t size)
+		:
+	m_cur(data),
+	m_end(data + size)
+	{}
+
+	template<class T>
+	T read()
+	{
+		T res;
+		readRaw(&res, sizeof(T));
+		return res;
+	}
+
+	template<class T>
+	void readArray(std::vector<T>& dst)
+	{
+		const auto count = read<uint64_t>();
+		if (count > uint64_t(m_end - m_cur) / sizeof(T))
+			throw std::runtime_error("cache array exceeds file size");
+		dst.resize(size_t(count));
+		readRaw(dst.data(), size_t(count) * sizeof(T));
+	}
+
+	std::string readString()
+	{
+		const auto length = read<uint32_t>();
+		if (length > size_t(m_end - m_cur))
+			throw std::runtime_error("cache string exceeds file size");
+		std::string res(reinterpret_cast<const char*>(m_cur), length);
+		m_cur += length;
+		return res;
+	}
+
+	template<class T, size_t N>
+	void readFloats(T(&dst)[N])
+	{
+		readRaw(dst, sizeof(dst));
+	}
+private:
+	void readRaw(void* dst, size_t size)
+	{
+		if (size > size_t(m_end - m_cur))
+			throw std::runtime_error("unexpected end of cache file");
+		if (size)
+			memcpy(dst, m_cur, size);
+		m_cur += size;
+	}
+
+	const uint8_t* m_cur;
+	const uint8_t* m_end;
+};
+
+class CacheWriter
+{
+public:
+	explicit CacheWriter(std::ofstream& stream)
+		:
+	m_stream(stream)
+	{}
+
+	template<class T>
+	void write(const T& value)
+	{
+		m_stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<class T>
+	void writeArray(const std::vector<T>& src)
+	{
+		write(uint64_t(src.size()));
+		m_stream.write(reinterpret_cast<const char*>(src.data()), src.size() * sizeof(T));
+	}
+
+	void writeString(const std::string& str)
+	{
+		write(uint32_t(str.size()));
+		m_stream.write(str.data(), str.size());
+	}
+
+	template<class T, size_t N>
+	void writeFloats(const T(&src)[N])
+	{
+		m_stream.write(reinterpret_cast<const char*>(src), sizeof(src));
+	}
+private:
+	std::ofstream& m_stream;
+};
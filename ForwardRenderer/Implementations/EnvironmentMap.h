@@ -7,6 +7,7 @@
 #include "../Graphics/ITransforms.h"
 #include "../Graphics/SamplerCache.h"
 #include "../Graphics/IEnvironmentMap.h"
+#include "../Framework/Profiler.h"
 #include <glad/glad.h>
 
 
@@ -43,6 +44,8 @@ public:
 		transforms.setModelTransform(glm::mat4(1.0f));
 		// draw from all directions
 		model.prepareDrawing(shader);
+		size_t numVisible = 0;
+		IModel::TriangleStatistics triangles;
 		for(auto i = 0; i < m_fbos.size(); ++i)
 		{
 			m_fbos[i].bind();
@@ -58,6 +61,9 @@ public:
 			transforms.upload();
 			transforms.bind();
 
+			numVisible += model.cull(Frustum(envcam.getProjection()));
+			triangles.drawn += model.getTriangleStatistics().drawn;
+			triangles.saved += model.getTriangleStatistics().saved;
 			for(auto& shape : model.getShapes())
 			{
 				if (!shape->isTransparent()) shape->draw(&shader);
@@ -65,7 +71,13 @@ public:
 		}
 
 		gl::Framebuffer::unbind();
+		// the following passes must not use the visibility of the last face
+		model.resetCulling();
 		m_cubeMap.generateMipmaps();
+		// sum over all faces
+		Profiler::set("visible_envmap", double(numVisible));
+		Profiler::set("triangles_envmap", double(triangles.drawn));
+		Profiler::set("lod_saved_envmap", double(triangles.saved));
 
 		transforms.update(cam);
 		transforms.upload();
@@ -0,0 +1,465 @@
+#include "IndexedMesh.h"
+#include "../Framework/ThreadPool.h"
+#include <limits>
+#include <map>
+#include <algorithm>
+#include <tuple>
+#include <atomic>
+#include <glm/gtc/packing.hpp>
+
+namespace
+{
+	struct KeyHash
+	{
+		size_t operator()(const tinyobj::index_t& i) const
+		{
+			uint64_t h = uint64_t(uint32_t(i.vertex_index)) * 0x9E3779B97F4A7C15ull;
+			h ^= uint64_t(uint32_t(i.normal_index)) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+			h ^= uint64_t(uint32_t(i.texcoord_index)) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+			return size_t(h ^ (h >> 29));
+		}
+	};
+
+	struct KeyEqual
+	{
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const
+		{
+			return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+		}
+	};
+
+	// corners per block for the parallel loops
+	const size_t BLOCK_SIZE = 1 << 16;
+	const uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();
+}
+
+IndexedMesh IndexedMesh::build(const ObjCache::Data& data)
+{
+	auto& pool = ThreadPool::get();
+	IndexedMesh res;
+
+	// flatten the corners of all shapes
+	std::vector<size_t> shapeOffset(data.shapes.size() + 1, 0);
+	for (size_t s = 0; s < data.shapes.size(); ++s)
+		shapeOffset[s + 1] = shapeOffset[s] + data.shapes[s].mesh.indices.size();
+	const auto numCorners = shapeOffset.back();
+	if (numCorners >= size_t(std::numeric_limits<uint32_t>::max()))
+		throw std::runtime_error("too many indices for 32 bit element buffers");
+
+	std::vector<tinyobj::index_t> corners(numCorners);
+	pool.parallelFor(0, data.shapes.size(), [&](size_t s)
+	{
+		const auto& indices = data.shapes[s].mesh.indices;
+		std::copy(indices.begin(), indices.end(), corners.begin() + shapeOffset[s]);
+	});
+
+	// distribute the corners into partitions by their hash. Each partition is deduplicated by one thread.
+	// The scatter is stable, so corners stay in ascending order inside a partition.
+	const size_t numPartitions = pool.getNumThreads() * 2;
+	const size_t numBlocks = (numCorners + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	std::vector<uint32_t> partitionOf(numCorners);
+	std::vector<size_t> blockCounts(numBlocks * numPartitions, 0);
+	pool.parallelFor(0, numBlocks, [&](size_t b)
+	{
+		const auto end = std::min((b + 1) * BLOCK_SIZE, numCorners);
+		auto counts = blockCounts.data() + b * numPartitions;
+		for (auto i = b * BLOCK_SIZE; i < end; ++i)
+		{
+			partitionOf[i] = uint32_t((KeyHash()(corners[i]) >> 7) % numPartitions);
+			++counts[partitionOf[i]];
+		}
+	});
+
+	// exclusive prefix sum in partition major order
+	std::vector<size_t> partitionStart(numPartitions + 1, 0);
+	{
+		size_t sum = 0;
+		for (size_t p = 0; p < numPartitions; ++p)
+		{
+			partitionStart[p] = sum;
+			for (size_t b = 0; b < numBlocks; ++b)
+			{
+				const auto count = blockCounts[b * numPartitions + p];
+				blockCounts[b * numPartitions + p] = sum;
+				sum += count;
+			}
+		}
+		partitionStart[numPartitions] = sum;
+	}
+
+	std::vector<uint32_t> sorted(numCorners);
+	pool.parallelFor(0, numBlocks, [&](size_t b)
+	{
+		const auto end = std::min((b + 1) * BLOCK_SIZE, numCorners);
+		auto offsets = blockCounts.data() + b * numPartitions;
+		for (auto i = b * BLOCK_SIZE; i < end; ++i)
+			sorted[offsets[partitionOf[i]]++] = uint32_t(i);
+	});
+	std::vector<uint32_t>().swap(partitionOf);
+
+	// find the first occurence of every corner
+	std::vector<uint32_t> first(numCorners);
+	pool.parallelFor(0, numPartitions, [&](size_t p)
+	{
+		// open addressing table with linear probing that stores the first corner of each key
+		size_t capacity = 16;
+		while (capacity < (partitionStart[p + 1] - partitionStart[p]) * 2)
+			capacity *= 2;
+		std::vector<uint32_t> table(capacity, EMPTY_SLOT);
+
+		for (auto i = partitionStart[p]; i < partitionStart[p + 1]; ++i)
+		{
+			const auto corner = sorted[i];
+			const auto& key = corners[corner];
+			auto slot = KeyHash()(key) & (capacity - 1);
+			while (table[slot] != EMPTY_SLOT && !KeyEqual()(corners[table[slot]], key))
+				slot = (slot + 1) & (capacity - 1);
+			if (table[slot] == EMPTY_SLOT)
+				table[slot] = corner;
+			first[corner] = table[slot];
+		}
+	});
+	std::vector<uint32_t>().swap(sorted);
+
+	// assign vertex ids in order of the first occurence
+	std::vector<uint32_t> vertexId(numCorners);
+	uint32_t numVertices = 0;
+	for (size_t i = 0; i < numCorners; ++i)
+	{
+		if (first[i] == i)
+			vertexId[i] = numVertices++;
+	}
+
+	res.vertices.resize(numVertices);
+	const auto& attrib = data.attrib;
+	const auto numPositions = attrib.vertices.size() / 3;
+	const auto numNormals = attrib.normals.size() / 3;
+	const auto numTexcoords = attrib.texcoords.size() / 2;
+
+	res.indices.resize(numCorners);
+	pool.parallelFor(0, numCorners, [&](size_t corner)
+	{
+		const auto id = vertexId[first[corner]];
+		res.indices[corner] = id;
+		if (first[corner] != corner)
+			return;
+
+		// fetch attributes for unique corners
+		const auto& idx = corners[corner];
+		if (idx.vertex_index < 0 || size_t(idx.vertex_index) >= numPositions)
+			throw std::runtime_error("vertex index out of range");
+
+		auto& v = res.vertices[id];
+		v.position = glm::vec3(
+			attrib.vertices[3 * idx.vertex_index],
+			attrib.vertices[3 * idx.vertex_index + 1],
+			attrib.vertices[3 * idx.vertex_index + 2]);
+		v.normal = glm::vec3(0.0f);
+		if (idx.normal_index >= 0 && size_t(idx.normal_index) < numNormals)
+			v.normal = glm::vec3(
+				attrib.normals[3 * idx.normal_index],
+				attrib.normals[3 * idx.normal_index + 1],
+				attrib.normals[3 * idx.normal_index + 2]);
+		v.texcoord = glm::vec2(0.0f);
+		if (idx.texcoord_index >= 0 && size_t(idx.texcoord_index) < numTexcoords)
+			v.texcoord = glm::vec2(
+				attrib.texcoords[2 * idx.texcoord_index],
+				attrib.texcoords[2 * idx.texcoord_index + 1]);
+	}, BLOCK_SIZE);
+
+	return res;
+}
+
+size_t IndexedMesh::generateNormals(const ObjCache::Data& data, bool smooth)
+{
+	auto& pool = ThreadPool::get();
+	const auto numCorners = indices.size();
+	const auto numTriangles = numCorners / 3;
+	std::vector<size_t> shapeOffset(data.shapes.size() + 1, 0);
+	for (size_t s = 0; s < data.shapes.size(); ++s)
+		shapeOffset[s + 1] = shapeOffset[s] + data.shapes[s].mesh.indices.size();
+	if (shapeOffset.back() != numCorners)
+		throw std::runtime_error("indexed mesh does not match the obj data");
+
+	// vertices without obj normal have a zero normal
+	std::vector<uint8_t> missing(vertices.size());
+	pool.parallelFor(0, vertices.size(), [&](size_t v)
+	{
+		missing[v] = vertices[v].normal == glm::vec3(0.0f);
+	}, BLOCK_SIZE);
+
+	// area weighted face normals
+	std::vector<glm::vec3> faceNormals(numTriangles);
+	pool.parallelFor(0, numTriangles, [&](size_t t)
+	{
+		const auto& p0 = vertices[indices[3 * t]].position;
+		const auto& p1 = vertices[indices[3 * t + 1]].position;
+		const auto& p2 = vertices[indices[3 * t + 2]].position;
+		faceNormals[t] = glm::cross(p1 - p0, p2 - p0);
+	}, BLOCK_SIZE);
+
+	// degenerated triangles point upwards
+	const auto safeNormalize = [](const glm::vec3& n)
+	{
+		const auto length = glm::length(n);
+		return length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	};
+
+	if (smooth)
+	{
+		// the obj position of each corner (the indices are still in the order of the obj faces)
+		std::vector<uint32_t> cornerPosition(numCorners);
+		pool.parallelFor(0, data.shapes.size(), [&](size_t s)
+		{
+			const auto& src = data.shapes[s].mesh.indices;
+			for (size_t i = 0; i < src.size(); ++i)
+				cornerPosition[shapeOffset[s] + i] = uint32_t(src[i].vertex_index);
+		});
+
+		// triangles with a missing normal per obj position (compressed rows)
+		const auto numPositions = data.attrib.vertices.size() / 3;
+		std::vector<std::atomic<uint32_t>> cursor(numPositions);
+		pool.parallelFor(0, numCorners, [&](size_t c)
+		{
+			if (missing[indices[c]])
+				++cursor[cornerPosition[c]];
+		}, BLOCK_SIZE);
+
+		std::vector<uint32_t> rowStart(numPositions + 1, 0);
+		for (size_t p = 0; p < numPositions; ++p)
+		{
+			rowStart[p + 1] = rowStart[p] + cursor[p];
+			cursor[p] = rowStart[p];
+		}
+
+		std::vector<uint32_t> rows(rowStart.back());
+		pool.parallelFor(0, numCorners, [&](size_t c)
+		{
+			if (missing[indices[c]])
+				rows[cursor[cornerPosition[c]]++] = uint32_t(c / 3);
+		}, BLOCK_SIZE);
+		std::vector<std::atomic<uint32_t>>().swap(cursor);
+
+		std::vector<glm::vec3> positionNormals(numPositions);
+		pool.parallelFor(0, numPositions, [&](size_t p)
+		{
+			glm::vec3 sum(0.0f);
+			for (auto i = rowStart[p]; i < rowStart[p + 1]; ++i)
+				sum += faceNormals[rows[i]];
+			positionNormals[p] = safeNormalize(sum);
+		}, BLOCK_SIZE);
+
+		// a vertex without normal belongs to exactly one obj position
+		std::vector<uint32_t> vertexPosition(vertices.size(), 0);
+		for (size_t c = 0; c < numCorners; ++c)
+			vertexPosition[indices[c]] = cornerPosition[c];
+
+		std::atomic<size_t> numGenerated{ 0 };
+		pool.parallelFor(0, vertices.size(), [&](size_t v)
+		{
+			if (!missing[v]) return;
+			vertices[v].normal = positionNormals[vertexPosition[v]];
+			++numGenerated;
+		}, BLOCK_SIZE);
+		return numGenerated;
+	}
+
+	// triangles with a missing normal get three new vertices with the face normal
+	const auto numBlocks = (numTriangles + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	std::vector<size_t> blockStart(numBlocks + 1, 0);
+	const auto isFlat = [&](size_t t)
+	{
+		return missing[indices[3 * t]] || missing[indices[3 * t + 1]] || missing[indices[3 * t + 2]];
+	};
+	pool.parallelFor(0, numBlocks, [&](size_t b)
+	{
+		const auto end = std::min((b + 1) * BLOCK_SIZE, numTriangles);
+		for (auto t = b * BLOCK_SIZE; t < end; ++t)
+			blockStart[b + 1] += isFlat(t) ? 1 : 0;
+	});
+	for (size_t b = 0; b < numBlocks; ++b)
+		blockStart[b + 1] += blockStart[b];
+
+	const auto numOld = vertices.size();
+	const auto numFlat = blockStart.back();
+	if (numOld + numFlat * 3 >= size_t(std::numeric_limits<uint32_t>::max()))
+		throw std::runtime_error("too many vertices for 32 bit element buffers");
+	vertices.resize(numOld + numFlat * 3);
+
+	pool.parallelFor(0, numBlocks, [&](size_t b)
+	{
+		auto next = numOld + blockStart[b] * 3;
+		const auto end = std::min((b + 1) * BLOCK_SIZE, numTriangles);
+		for (auto t = b * BLOCK_SIZE; t < end; ++t)
+		{
+			if (!isFlat(t)) continue;
+			const auto normal = safeNormalize(faceNormals[t]);
+			for (size_t i = 0; i < 3; ++i)
+			{
+				auto& v = vertices[next];
+				v = vertices[indices[3 * t + i]];
+				v.normal = normal;
+				indices[3 * t + i] = uint32_t(next++);
+			}
+		}
+	});
+
+	// old vertices without normal are only referenced by the replaced triangles
+	std::vector<uint32_t> remap(vertices.size());
+	uint32_t numVertices = 0;
+	for (size_t v = 0; v < vertices.size(); ++v)
+	{
+		remap[v] = numVertices;
+		if (v >= numOld || !missing[v])
+			++numVertices;
+	}
+
+	std::vector<Vertex> compacted(numVertices);
+	pool.parallelFor(0, vertices.size(), [&](size_t v)
+	{
+		if (v >= numOld || !missing[v])
+			compacted[remap[v]] = vertices[v];
+	}, BLOCK_SIZE);
+	vertices.swap(compacted);
+
+	pool.parallelFor(0, numCorners, [&](size_t c)
+	{
+		indices[c] = remap[indices[c]];
+	}, BLOCK_SIZE);
+
+	return numFlat * 3;
+}
+
+void IndexedMesh::sortByMaterial(const ObjCache::Data& data, int defaultMaterialId, const std::vector<std::vector<uint8_t>>& triangleClasses)
+{
+	auto& pool = ThreadPool::get();
+
+	std::vector<size_t> shapeOffset(data.shapes.size() + 1, 0);
+	for (size_t s = 0; s < data.shapes.size(); ++s)
+		shapeOffset[s + 1] = shapeOffset[s] + data.shapes[s].mesh.indices.size();
+	if (shapeOffset.back() != indices.size())
+		throw std::runtime_error("indexed mesh does not match the obj data");
+
+	// sub meshes are identified by material and triangle class
+	const auto getKey = [&data, &triangleClasses, defaultMaterialId](size_t shape, size_t triangle)
+	{
+		const auto& materialIds = data.shapes[shape].mesh.material_ids;
+		auto id = triangle < materialIds.size() ? materialIds[triangle] : -1;
+		if (id < 0 || id >= defaultMaterialId)
+			id = defaultMaterialId;
+		return std::make_pair(id, triangleClasses[shape][triangle]);
+	};
+	using Key = std::pair<int, uint8_t>;
+
+	// count the indices per key for each shape
+	std::vector<std::map<Key, uint32_t>> shapeKeys(data.shapes.size());
+	pool.parallelFor(0, data.shapes.size(), [&](size_t s)
+	{
+		for (size_t t = 0, numTriangles = data.shapes[s].mesh.indices.size() / 3; t < numTriangles; ++t)
+			shapeKeys[s][getKey(s, t)] += 3;
+	});
+
+	// sub meshes are sorted by material to reduce state changes while drawing
+	subMeshes.clear();
+	for (size_t s = 0; s < data.shapes.size(); ++s)
+		for (const auto& k : shapeKeys[s])
+			subMeshes.push_back({ 0, k.second, k.first.first, k.first.second, uint32_t(s), glm::vec3(0.0f), glm::vec3(0.0f) });
+
+	std::stable_sort(subMeshes.begin(), subMeshes.end(), [](const SubMesh& a, const SubMesh& b)
+	{
+		return std::tie(a.materialId, a.triangleClass) < std::tie(b.materialId, b.triangleClass);
+	});
+
+	// the counters become the write offset of the sub mesh
+	uint32_t offset = 0;
+	for (auto& m : subMeshes)
+	{
+		m.firstIndex = offset;
+		shapeKeys[m.shape][{ m.materialId, m.triangleClass }] = offset;
+		offset += m.indexCount;
+	}
+
+	std::vector<uint32_t> sorted(indices.size());
+	pool.parallelFor(0, data.shapes.size(), [&](size_t s)
+	{
+		auto& offsets = shapeKeys[s];
+		for (size_t t = 0, numTriangles = data.shapes[s].mesh.indices.size() / 3; t < numTriangles; ++t)
+		{
+			auto& dst = offsets[getKey(s, t)];
+			for (size_t i = 0; i < 3; ++i)
+				sorted[dst++] = indices[shapeOffset[s] + t * 3 + i];
+		}
+	});
+	indices.swap(sorted);
+
+	pool.parallelFor(0, subMeshes.size(), [&](size_t i)
+	{
+		auto& m = subMeshes[i];
+		m.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+		m.bboxMax = glm::vec3(std::numeric_limits<float>::lowest());
+		for (auto idx = m.firstIndex, end = m.firstIndex + m.indexCount; idx < end; ++idx)
+		{
+			const auto& pos = vertices[indices[idx]].position;
+			m.bboxMin = glm::min(m.bboxMin, pos);
+			m.bboxMax = glm::max(m.bboxMax, pos);
+		}
+	});
+}
+
+std::vector<IndexedMesh::QuantizedVertex> IndexedMesh::quantize(const glm::vec3& bboxMin, const glm::vec3& bboxMax) const
+{
+	std::vector<QuantizedVertex> res(vertices.size());
+	const auto extent = bboxMax - bboxMin;
+	glm::vec3 scale;
+	for (int a = 0; a < 3; ++a)
+		scale[a] = extent[a] > 0.0f ? 1.0f / extent[a] : 0.0f;
+
+	ThreadPool::get().parallelFor(0, vertices.size(), [&](size_t i)
+	{
+		const auto& v = vertices[i];
+		auto& q = res[i];
+
+		const auto pos = glm::clamp((v.position - bboxMin) * scale, glm::vec3(0.0f), glm::vec3(1.0f));
+		for (int a = 0; a < 3; ++a)
+			q.position[a] = glm::packUnorm1x16(pos[a]);
+
+		// project the normal onto the octahedron and unfold the lower half
+		const auto length = std::abs(v.normal.x) + std::abs(v.normal.y) + std::abs(v.normal.z);
+		q.position[3] = length > 0.0f ? 0xFFFF : 0;
+		glm::vec2 oct(0.0f);
+		if (length > 0.0f)
+		{
+			oct = glm::vec2(v.normal) / length;
+			if (v.normal.z < 0.0f)
+				oct = (1.0f - glm::abs(glm::vec2(oct.y, oct.x))) * glm::vec2(oct.x >= 0.0f ? 1.0f : -1.0f, oct.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		q.normal[0] = int16_t(glm::packSnorm1x16(oct.x));
+		q.normal[1] = int16_t(glm::packSnorm1x16(oct.y));
+
+		q.texcoord[0] = glm::packHalf1x16(v.texcoord.x);
+		q.texcoord[1] = glm::packHalf1x16(v.texcoord.y);
+	}, BLOCK_SIZE);
+
+	return res;
+}
+
+IndexedMesh::Vertex IndexedMesh::dequantize(const QuantizedVertex& vertex, const glm::vec3& bboxMin, const glm::vec3& bboxMax)
+{
+	Vertex res;
+	for (int a = 0; a < 3; ++a)
+		res.position[a] = glm::unpackUnorm1x16(vertex.position[a]);
+	res.position = bboxMin + (bboxMax - bboxMin) * res.position;
+
+	glm::vec3 n(glm::unpackSnorm1x16(uint16_t(vertex.normal[0])), glm::unpackSnorm1x16(uint16_t(vertex.normal[1])), 0.0f);
+	n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+	if (n.z < 0.0f)
+	{
+		const glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+		n.x = folded.x;
+		n.y = folded.y;
+	}
+	res.normal = vertex.position[3] ? glm::normalize(n) : glm::vec3(0.0f);
+
+	res.texcoord = glm::vec2(glm::unpackHalf1x16(vertex.texcoord[0]), glm::unpackHalf1x16(vertex.texcoord[1]));
+	return res;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "ObjCache.h"
+
+/**
+ * \brief interleaved vertex buffer with a single element buffer that is sorted by material.
+ * Identical (position, normal, texcoord) tuples of the obj file share a single vertex.
+ */
+struct IndexedMesh
+{
+	struct Vertex
+	{
+		glm::vec3 position;
+		// zero if the obj has no normal for this corner
+		glm::vec3 normal;
+		glm::vec2 texcoord;
+	};
+	static_assert(sizeof(Vertex) == 8 * sizeof(float), "vertex must be tightly packed");
+
+	// compact vertex format (see Shader/uniforms/vertex.glsl)
+	struct QuantizedVertex
+	{
+		// unsigned normalized position inside the bounding box. w is zero if the vertex has no normal
+		uint16_t position[4];
+		// octahedral encoded signed normalized normal
+		int16_t normal[2];
+		// half floats
+		uint16_t texcoord[2];
+	};
+	static_assert(sizeof(QuantizedVertex) == 16, "quantized vertex must be tightly packed");
+
+	// triangles of one obj shape with the same material and triangle class
+	struct SubMesh
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int materialId;
+		// arbitrary classification of the triangles (see AlphaClassifier)
+		uint8_t triangleClass;
+		// index of the obj shape
+		uint32_t shape;
+		// bounding box of the referenced vertices
+		glm::vec3 bboxMin;
+		glm::vec3 bboxMax;
+	};
+
+	// simplified version of a sub mesh
+	struct Lod
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		// approximate distance between the simplified and the original surface
+		float error;
+	};
+
+	// spatially compact range of the triangles of a sub mesh
+	struct Cluster
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		glm::vec3 bboxMin;
+		glm::vec3 bboxMax;
+		// average face normal
+		glm::vec3 coneAxis;
+		// cosine of the largest angle between the axis and a face normal. Not positive if the cone is too wide for culling
+		float coneCutoff;
+	};
+
+	std::vector<Vertex> vertices;
+	// triangle list indices of all sub meshes
+	std::vector<uint32_t> indices;
+	// sorted by material, triangle class and shape
+	std::vector<SubMesh> subMeshes;
+	// coarser levels of detail of each sub mesh or empty (see MeshSimplifier).
+	// Their indices and additional vertices follow the ones of the sub meshes
+	std::vector<std::vector<Lod>> lods;
+	// clusters of each sub mesh or empty (see MeshOptimizer::buildClusters())
+	std::vector<std::vector<Cluster>> clusters;
+
+	/**
+	 * \brief deduplicates the attribute tuples of all shapes (multithreaded). Vertices are ordered by their first occurence.
+	 * The indices stay in the order of the obj faces until sortByMaterial() is called.
+	 */
+	static IndexedMesh build(const ObjCache::Data& data);
+
+	/**
+	 * \brief computes the normals of vertices without obj normals (multithreaded). Must be called before sortByMaterial()
+	 * \param data obj data that was passed to build()
+	 * \param smooth averages the face normals of all triangles that share the obj position.
+	 * Otherwise triangles with a missing normal get their own vertices with the face normal.
+	 * \return number of vertices that received a normal
+	 */
+	size_t generateNormals(const ObjCache::Data& data, bool smooth);
+
+	/**
+	 * \brief splits the shapes by their face materials and triangle classes, reorders the indices
+	 * and computes the bounding boxes of the sub meshes (multithreaded)
+	 * \param data obj data that was passed to build()
+	 * \param defaultMaterialId material for faces without a valid material
+	 * \param triangleClasses class of each triangle for each shape
+	 */
+	void sortByMaterial(const ObjCache::Data& data, int defaultMaterialId, const std::vector<std::vector<uint8_t>>& triangleClasses);
+
+	/**
+	 * \brief converts the vertices into the compact format (multithreaded)
+	 * \param bboxMin bounding box of all vertices
+	 * \param bboxMax bounding box of all vertices
+	 */
+	std::vector<QuantizedVertex> quantize(const glm::vec3& bboxMin, const glm::vec3& bboxMax) const;
+	// inverse of quantize() with the decoding of Shader/uniforms/vertex.glsl
+	static Vertex dequantize(const QuantizedVertex& vertex, const glm::vec3& bboxMin, const glm::vec3& bboxMax);
+};
@@ -0,0 +1,311 @@
+#include "MeshOptimizer.h"
+#include "../Framework/ThreadPool.h"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace
+{
+	// size of the lru cache of the optimization
+	const int CACHE_SIZE = 32;
+	const float LAST_TRIANGLE_SCORE = 0.75f;
+	const float CACHE_DECAY_POWER = 1.5f;
+	const float VALENCE_BOOST_SCALE = 2.0f;
+	const float VALENCE_BOOST_POWER = 0.5f;
+
+	float getVertexScore(int cachePosition, uint32_t numLiveTriangles)
+	{
+		if (numLiveTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// the vertices of the last triangle get a fixed score, so that the next triangle does not prefer them too much
+			if (cachePosition < 3)
+				score = LAST_TRIANGLE_SCORE;
+			else
+				score = std::pow(1.0f - float(cachePosition - 3) / float(CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+		// vertices with few remaining triangles should be finished first
+		return score + VALENCE_BOOST_SCALE * std::pow(float(numLiveTriangles), -VALENCE_BOOST_POWER);
+	}
+
+	// Forsyth's linear speed vertex cache optimization of a triangle list
+	void optimizeVertexCache(uint32_t* indices, size_t numIndices)
+	{
+		const auto numTriangles = numIndices / 3;
+		if (numTriangles < 2)
+			return;
+
+		// local vertex ids
+		std::vector<uint32_t> vertices(indices, indices + numIndices);
+		std::sort(vertices.begin(), vertices.end());
+		vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+		const auto numVertices = vertices.size();
+		std::vector<uint32_t> local(numIndices);
+		for (size_t i = 0; i < numIndices; ++i)
+			local[i] = uint32_t(std::lower_bound(vertices.begin(), vertices.end(), indices[i]) - vertices.begin());
+
+		// triangles of each vertex. The live triangles are at the front of each row
+		std::vector<uint32_t> numLive(numVertices, 0);
+		for (auto v : local)
+			++numLive[v];
+		std::vector<uint32_t> rowStart(numVertices + 1, 0);
+		for (size_t v = 0; v < numVertices; ++v)
+			rowStart[v + 1] = rowStart[v] + numLive[v];
+		std::vector<uint32_t> rows(numIndices);
+		{
+			auto cursor = rowStart;
+			for (size_t i = 0; i < numIndices; ++i)
+				rows[cursor[local[i]]++] = uint32_t(i / 3);
+		}
+
+		std::vector<int> cachePosition(numVertices, -1);
+		std::vector<float> vertexScore(numVertices);
+		for (size_t v = 0; v < numVertices; ++v)
+			vertexScore[v] = getVertexScore(-1, numLive[v]);
+
+		std::vector<float> triangleScore(numTriangles);
+		for (size_t t = 0; t < numTriangles; ++t)
+			triangleScore[t] = vertexScore[local[3 * t]] + vertexScore[local[3 * t + 1]] + vertexScore[local[3 * t + 2]];
+
+		std::vector<uint8_t> emitted(numTriangles, 0);
+		std::vector<uint32_t> result;
+		result.reserve(numIndices);
+
+		std::vector<uint32_t> cache, newCache;
+		cache.reserve(CACHE_SIZE + 3);
+		newCache.reserve(CACHE_SIZE + 3);
+
+		auto best = size_t(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+		// triangles before this index were emitted
+		size_t nextUnemitted = 0;
+		while (true)
+		{
+			emitted[best] = 1;
+			for (size_t i = 0; i < 3; ++i)
+			{
+				const auto v = local[3 * best + i];
+				result.push_back(indices[3 * best + i]);
+
+				// move the triangle out of the live part of the row
+				const auto row = rows.begin() + rowStart[v];
+				const auto last = row + --numLive[v];
+				std::iter_swap(std::find(row, last + 1, uint32_t(best)), last);
+			}
+
+			// the triangle vertices move to the front of the lru cache
+			newCache.assign(local.begin() + 3 * best, local.begin() + 3 * best + 3);
+			for (auto v : cache)
+				if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+					newCache.push_back(v);
+
+			for (size_t i = 0; i < newCache.size(); ++i)
+			{
+				const auto v = newCache[i];
+				cachePosition[v] = i < size_t(CACHE_SIZE) ? int(i) : -1;
+				vertexScore[v] = getVertexScore(cachePosition[v], numLive[v]);
+			}
+
+			// only the triangles of the changed vertices need new scores
+			float bestScore = -1.0f;
+			best = numTriangles;
+			for (auto v : newCache)
+			{
+				for (auto r = rowStart[v], end = rowStart[v] + numLive[v]; r < end; ++r)
+				{
+					const auto t = rows[r];
+					const auto score = vertexScore[local[3 * t]] + vertexScore[local[3 * t + 1]] + vertexScore[local[3 * t + 2]];
+					triangleScore[t] = score;
+					if (score > bestScore)
+					{
+						bestScore = score;
+						best = t;
+					}
+				}
+			}
+
+			newCache.resize(std::min(newCache.size(), size_t(CACHE_SIZE)));
+			std::swap(cache, newCache);
+
+			if (best == numTriangles)
+			{
+				// continue with the next triangle in the original order
+				while (nextUnemitted < numTriangles && emitted[nextUnemitted])
+					++nextUnemitted;
+				if (nextUnemitted == numTriangles)
+					break;
+				best = nextUnemitted;
+			}
+		}
+
+		std::copy(result.begin(), result.end(), indices);
+	}
+
+	// interleaves the lower 10 bits
+	uint32_t spreadBits(uint32_t v)
+	{
+		v &= 0x3FF;
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v << 8)) & 0x0300F00F;
+		v = (v | (v << 4)) & 0x030C30C3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	// sorts the triangles by the morton code of their centroids inside the bounding box
+	void sortSpatially(uint32_t* indices, size_t numIndices, const std::vector<IndexedMesh::Vertex>& vertices,
+		const glm::vec3& bboxMin, const glm::vec3& bboxMax)
+	{
+		const auto numTriangles = numIndices / 3;
+		const auto extent = bboxMax - bboxMin;
+		glm::vec3 scale;
+		for (int a = 0; a < 3; ++a)
+			scale[a] = extent[a] > 0.0f ? 1023.0f / extent[a] : 0.0f;
+
+		std::vector<std::pair<uint32_t, uint32_t>> keys(numTriangles);
+		for (size_t t = 0; t < numTriangles; ++t)
+		{
+			const auto centroid = (vertices[indices[3 * t]].position + vertices[indices[3 * t + 1]].position
+				+ vertices[indices[3 * t + 2]].position) / 3.0f;
+			const auto cell = glm::clamp((centroid - bboxMin) * scale, glm::vec3(0.0f), glm::vec3(1023.0f));
+			keys[t] = { spreadBits(uint32_t(cell.x)) | (spreadBits(uint32_t(cell.y)) << 1) | (spreadBits(uint32_t(cell.z)) << 2), uint32_t(t) };
+		}
+		std::sort(keys.begin(), keys.end());
+
+		std::vector<uint32_t> sorted(numIndices);
+		for (size_t t = 0; t < numTriangles; ++t)
+			for (size_t i = 0; i < 3; ++i)
+				sorted[3 * t + i] = indices[3 * keys[t].second + i];
+		std::copy(sorted.begin(), sorted.end(), indices);
+	}
+
+	// bounding box and normal cone of a range of triangles
+	IndexedMesh::Cluster computeCluster(const uint32_t* indices, uint32_t firstIndex, uint32_t indexCount,
+		const std::vector<IndexedMesh::Vertex>& vertices)
+	{
+		IndexedMesh::Cluster c;
+		c.firstIndex = firstIndex;
+		c.indexCount = indexCount;
+		c.bboxMin = c.bboxMax = vertices[indices[firstIndex]].position;
+
+		std::vector<glm::vec3> normals;
+		normals.reserve(indexCount / 3);
+		for (auto i = firstIndex; i < firstIndex + indexCount; i += 3)
+		{
+			const auto& p0 = vertices[indices[i]].position;
+			const auto& p1 = vertices[indices[i + 1]].position;
+			const auto& p2 = vertices[indices[i + 2]].position;
+			c.bboxMin = glm::min(c.bboxMin, glm::min(p0, glm::min(p1, p2)));
+			c.bboxMax = glm::max(c.bboxMax, glm::max(p0, glm::max(p1, p2)));
+
+			// counter clockwise front faces. Degenerate triangles are not drawn and do not widen the cone
+			const auto n = glm::cross(p1 - p0, p2 - p0);
+			const auto length = glm::length(n);
+			if (length > 0.0f)
+				normals.push_back(n / length);
+		}
+
+		// average normal and the cosine of the largest deviation. -1 if the normals do not fit into a hemisphere
+		c.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		c.coneCutoff = -1.0f;
+		glm::vec3 sum(0.0f);
+		for (const auto& n : normals)
+			sum += n;
+		const auto length = glm::length(sum);
+		if (normals.empty() || length <= 1e-4f * float(normals.size()))
+			return c;
+
+		c.coneAxis = sum / length;
+		c.coneCutoff = 1.0f;
+		for (const auto& n : normals)
+			c.coneCutoff = std::min(c.coneCutoff, glm::dot(c.coneAxis, n));
+		if (c.coneCutoff <= 0.0f)
+			c.coneCutoff = -1.0f;
+		return c;
+	}
+}
+
+size_t MeshOptimizer::buildClusters(IndexedMesh& mesh, int clusterClass)
+{
+	const auto& subMeshes = mesh.subMeshes;
+	mesh.clusters.assign(subMeshes.size(), {});
+	ThreadPool::get().parallelFor(0, subMeshes.size(), [&](size_t i)
+	{
+		const auto& m = subMeshes[i];
+		if (int(m.triangleClass) != clusterClass || m.indexCount == 0)
+			return;
+
+		sortSpatially(mesh.indices.data() + m.firstIndex, m.indexCount, mesh.vertices, m.bboxMin, m.bboxMax);
+		for (uint32_t first = 0; first < m.indexCount; first += uint32_t(CLUSTER_SIZE * 3))
+		{
+			const auto count = std::min(m.indexCount - first, uint32_t(CLUSTER_SIZE * 3));
+			mesh.clusters[i].push_back(computeCluster(mesh.indices.data(), m.firstIndex + first, count, mesh.vertices));
+		}
+	});
+
+	size_t numClusters = 0;
+	for (const auto& c : mesh.clusters)
+		numClusters += c.size();
+	return numClusters;
+}
+
+MeshOptimizer::Statistics MeshOptimizer::optimize(IndexedMesh& mesh)
+{
+	auto& pool = ThreadPool::get();
+	const auto& subMeshes = mesh.subMeshes;
+
+	// cache misses of each sub mesh before and after the optimization
+	std::vector<double> missesBefore(subMeshes.size());
+	std::vector<double> missesAfter(subMeshes.size());
+	pool.parallelFor(0, subMeshes.size(), [&](size_t i)
+	{
+		const auto& m = subMeshes[i];
+		const auto indices = mesh.indices.data() + m.firstIndex;
+		const auto numTriangles = double(m.indexCount / 3);
+		missesBefore[i] = computeAcmr(indices, m.indexCount) * numTriangles;
+
+		if (i < mesh.clusters.size() && !mesh.clusters[i].empty())
+		{
+			// the clusters are optimized separately to keep them compact
+			for (const auto& c : mesh.clusters[i])
+				optimizeVertexCache(mesh.indices.data() + c.firstIndex, c.indexCount);
+		}
+		else
+		{
+			optimizeVertexCache(indices, m.indexCount);
+		}
+
+		missesAfter[i] = computeAcmr(indices, m.indexCount) * numTriangles;
+	});
+
+	Statistics res;
+	const auto numTriangles = double(mesh.indices.size() / 3);
+	if (numTriangles > 0.0)
+	{
+		res.acmrBefore = std::accumulate(missesBefore.begin(), missesBefore.end(), 0.0) / numTriangles;
+		res.acmrAfter = std::accumulate(missesAfter.begin(), missesAfter.end(), 0.0) / numTriangles;
+	}
+	return res;
+}
+
+double MeshOptimizer::computeAcmr(const uint32_t* indices, size_t numIndices)
+{
+	if (numIndices < 3)
+		return 0.0;
+
+	uint32_t fifo[ACMR_CACHE_SIZE];
+	size_t fifoSize = 0, fifoNext = 0, misses = 0;
+	for (size_t i = 0; i < numIndices; ++i)
+	{
+		if (std::find(fifo, fifo + fifoSize, indices[i]) != fifo + fifoSize)
+			continue;
+
+		++misses;
+		fifo[fifoNext] = indices[i];
+		fifoNext = (fifoNext + 1) % ACMR_CACHE_SIZE;
+		fifoSize = std::min(fifoSize + 1, ACMR_CACHE_SIZE);
+	}
+	return double(misses) / double(numIndices / 3);
+}
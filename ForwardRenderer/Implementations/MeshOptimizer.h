@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "IndexedMesh.h"
+
+/**
+ * \brief load time reordering of the triangles inside each sub mesh.
+ * Triangles are ordered for the post transform vertex cache with the algorithm of Tom Forsyth.
+ * Sub meshes of one triangle class can be split into spatially compact clusters first (morton order of the centroids),
+ * so that the triangles in flight cover fewer distinct surfaces of the same pixel (less per pixel lock contention while blending).
+ * The clusters keep their own bounds and normal cones for culling and sorting at draw time.
+ */
+class MeshOptimizer
+{
+	MeshOptimizer() = default;
+public:
+	struct Statistics
+	{
+		// average cache miss ratio (vertex shader invocations per triangle)
+		double acmrBefore = 0.0;
+		double acmrAfter = 0.0;
+	};
+
+	/**
+	 * \brief sorts the triangles of the sub meshes of one triangle class spatially and fills mesh.clusters (multithreaded)
+	 * \param clusterClass triangle class of the sub meshes that are clustered
+	 * \return number of clusters
+	 */
+	static size_t buildClusters(IndexedMesh& mesh, int clusterClass);
+
+	/**
+	 * \brief reorders the indices of all sub meshes (multithreaded). The clusters of buildClusters() are optimized separately
+	 */
+	static Statistics optimize(IndexedMesh& mesh);
+
+	/**
+	 * \brief average cache miss ratio of a fifo cache with ACMR_CACHE_SIZE entries
+	 */
+	static double computeAcmr(const uint32_t* indices, size_t numIndices);
+
+	// size of the simulated fifo cache for the statistics
+	static const size_t ACMR_CACHE_SIZE = 16;
+	// triangles per spatial cluster
+	static const size_t CLUSTER_SIZE = 256;
+};
@@ -0,0 +1,508 @@
+#include "MeshSimplifier.h"
+#include "../Framework/ThreadPool.h"
+#include "../Framework/MappedFile.h"
+#include "CacheStream.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <iostream>
+#include <filesystem>
+#include <cmath>
+namespace fs = std::experimental::filesystem;
+
+namespace
+{
+	// increase the version if the layout of the cache or the simplification changes
+	const uint32_t CACHE_MAGIC = 0x444F4C43; // "CLOD"
+	const uint32_t CACHE_VERSION = 1;
+
+	// triangles of a level relative to the previous level
+	const float LEVEL_RATIO = 0.5f;
+	// a level is discarded if it removes less than this fraction of the triangles of the previous level
+	const float MIN_REDUCTION = 0.15f;
+	// vertex ids of the merged vertices of a sub mesh are marked with this bit until they are appended to the mesh
+	const uint32_t NEW_VERTEX = 0x80000000u;
+
+	// symmetric 4x4 matrix that sums the squared distances to planes
+	struct Quadric
+	{
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+		double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+		double a22 = 0.0, a23 = 0.0;
+		double a33 = 0.0;
+
+		void addPlane(const glm::dvec3& n, double d)
+		{
+			a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z; a03 += n.x * d;
+			a11 += n.y * n.y; a12 += n.y * n.z; a13 += n.y * d;
+			a22 += n.z * n.z; a23 += n.z * d;
+			a33 += d * d;
+		}
+
+		Quadric& operator+=(const Quadric& o)
+		{
+			a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+			a11 += o.a11; a12 += o.a12; a13 += o.a13;
+			a22 += o.a22; a23 += o.a23;
+			a33 += o.a33;
+			return *this;
+		}
+
+		double evaluate(const glm::dvec3& v) const
+		{
+			return a00 * v.x * v.x + 2.0 * a01 * v.x * v.y + 2.0 * a02 * v.x * v.z + 2.0 * a03 * v.x
+				+ a11 * v.y * v.y + 2.0 * a12 * v.y * v.z + 2.0 * a13 * v.y
+				+ a22 * v.z * v.z + 2.0 * a23 * v.z
+				+ a33;
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+
+		bool operator<(const Collapse& o) const
+		{
+			return cost < o.cost;
+		}
+	};
+
+	// levels of detail of one sub mesh before they are appended to the mesh
+	struct SubMeshLods
+	{
+		// merged vertices of the sub mesh
+		std::vector<IndexedMesh::Vertex> newVertices;
+		// triangle lists with mesh vertex ids or NEW_VERTEX | newVertices index
+		std::vector<std::vector<uint32_t>> levels;
+		std::vector<float> errors;
+	};
+
+	bool hasSameSurface(const IndexedMesh::Vertex& a, const IndexedMesh::Vertex& b)
+	{
+		return a.position == b.position && a.texcoord == b.texcoord;
+	}
+
+	bool isSurfaceLess(const IndexedMesh::Vertex& a, const IndexedMesh::Vertex& b)
+	{
+		for (int i = 0; i < 3; ++i)
+			if (a.position[i] != b.position[i])
+				return a.position[i] < b.position[i];
+		for (int i = 0; i < 2; ++i)
+			if (a.texcoord[i] != b.texcoord[i])
+				return a.texcoord[i] < b.texcoord[i];
+		return false;
+	}
+
+	/**
+	 * \brief simplifies the triangles of the sub mesh repeatedly.
+	 * The vertices that only differ in the normal are merged, the remaining (welded) vertices are collapsed
+	 * into neighbours with the smallest quadric error. Vertices with open edges are locked.
+	 * Texture seams are open edges of the welded vertices and stay locked as well
+	 */
+	SubMeshLods simplify(const IndexedMesh& mesh, const IndexedMesh::SubMesh& subMesh)
+	{
+		SubMeshLods res;
+		const auto indices = mesh.indices.data() + subMesh.firstIndex;
+		const auto numIndices = size_t(subMesh.indexCount);
+		const auto& vertices = mesh.vertices;
+
+		// mesh vertices of the sub mesh ordered by position and texcoord
+		std::vector<uint32_t> unique(indices, indices + numIndices);
+		std::sort(unique.begin(), unique.end());
+		unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+		std::vector<uint32_t> order(unique.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](uint32_t l, uint32_t r)
+		{
+			return isSurfaceLess(vertices[unique[l]], vertices[unique[r]]);
+		});
+
+		// welded vertex of each unique vertex and mesh vertex of each welded vertex
+		std::vector<uint32_t> welded(unique.size());
+		std::vector<uint32_t> weldedVertex;
+		std::vector<glm::vec3> positions;
+		for (size_t first = 0; first < order.size();)
+		{
+			const auto& v = vertices[unique[order[first]]];
+			auto last = first + 1;
+			glm::vec3 normal = v.normal;
+			while (last < order.size() && hasSameSurface(v, vertices[unique[order[last]]]))
+				normal += vertices[unique[order[last++]]].normal;
+
+			for (auto i = first; i < last; ++i)
+				welded[order[i]] = uint32_t(positions.size());
+			positions.push_back(v.position);
+
+			if (last - first == 1)
+			{
+				weldedVertex.push_back(unique[order[first]]);
+			}
+			else
+			{
+				// averaged normal (zero if the vertices have no normals)
+				const auto length = glm::length(normal);
+				weldedVertex.push_back(NEW_VERTEX | uint32_t(res.newVertices.size()));
+				res.newVertices.push_back({ v.position, length > 0.0f ? normal / length : glm::vec3(0.0f), v.texcoord });
+			}
+			first = last;
+		}
+		const auto numVertices = positions.size();
+
+		// triangles with welded vertices
+		const auto numTriangles = numIndices / 3;
+		std::vector<uint32_t> triangles(numIndices);
+		for (size_t i = 0; i < numIndices; ++i)
+			triangles[i] = welded[std::lower_bound(unique.begin(), unique.end(), indices[i]) - unique.begin()];
+
+		std::vector<uint8_t> alive(numTriangles, 1);
+		size_t numAlive = numTriangles;
+		for (size_t t = 0; t < numTriangles; ++t)
+		{
+			const auto v = &triangles[3 * t];
+			if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+			{
+				alive[t] = 0;
+				--numAlive;
+			}
+		}
+
+		// edges with one or more than two triangles lock their vertices
+		std::vector<uint8_t> locked(numVertices, 0);
+		{
+			std::vector<uint64_t> edges;
+			edges.reserve(numIndices);
+			for (size_t t = 0; t < numTriangles; ++t)
+			{
+				if (!alive[t]) continue;
+				for (size_t i = 0; i < 3; ++i)
+				{
+					const auto a = triangles[3 * t + i];
+					const auto b = triangles[3 * t + (i + 1) % 3];
+					edges.push_back((uint64_t(std::min(a, b)) << 32) | std::max(a, b));
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			for (size_t first = 0; first < edges.size();)
+			{
+				auto last = first + 1;
+				while (last < edges.size() && edges[last] == edges[first])
+					++last;
+				if (last - first != 2)
+				{
+					locked[uint32_t(edges[first] >> 32)] = 1;
+					locked[uint32_t(edges[first])] = 1;
+				}
+				first = last;
+			}
+		}
+
+		// squared distances to the planes of the adjacent triangles
+		std::vector<Quadric> quadrics(numVertices);
+		for (size_t t = 0; t < numTriangles; ++t)
+		{
+			if (!alive[t]) continue;
+			const auto v = &triangles[3 * t];
+			const glm::dvec3 p0 = positions[v[0]];
+			const auto n = glm::cross(glm::dvec3(positions[v[1]]) - p0, glm::dvec3(positions[v[2]]) - p0);
+			const auto length = glm::length(n);
+			if (length <= 0.0) continue;
+			const auto normal = n / length;
+			for (size_t i = 0; i < 3; ++i)
+				quadrics[v[i]].addPlane(normal, -glm::dot(normal, p0));
+		}
+
+		const auto contains = [&](size_t t, uint32_t vertex)
+		{
+			return triangles[3 * t] == vertex || triangles[3 * t + 1] == vertex || triangles[3 * t + 2] == vertex;
+		};
+		const auto faceNormal = [&](size_t t, uint32_t from, uint32_t to)
+		{
+			glm::vec3 p[3];
+			for (size_t i = 0; i < 3; ++i)
+				p[i] = positions[triangles[3 * t + i] == from ? to : triangles[3 * t + i]];
+			return glm::cross(p[1] - p[0], p[2] - p[0]);
+		};
+
+		// triangles of each vertex (rebuilt for every pass)
+		std::vector<uint32_t> rowStart(numVertices + 1);
+		std::vector<uint32_t> rows;
+		std::vector<Collapse> collapses;
+		std::vector<uint8_t> touched(numVertices);
+		double maxCost = 0.0;
+
+		// collapses the cheapest independent edges until the target is reached. Returns false if nothing was collapsed
+		const auto collapsePass = [&](size_t target)
+		{
+			std::fill(rowStart.begin(), rowStart.end(), 0);
+			for (size_t t = 0; t < numTriangles; ++t)
+				if (alive[t])
+					for (size_t i = 0; i < 3; ++i)
+						++rowStart[triangles[3 * t + i] + 1];
+			std::partial_sum(rowStart.begin(), rowStart.end(), rowStart.begin());
+			rows.resize(rowStart.back());
+			{
+				auto cursor = rowStart;
+				for (size_t t = 0; t < numTriangles; ++t)
+					if (alive[t])
+						for (size_t i = 0; i < 3; ++i)
+							rows[cursor[triangles[3 * t + i]]++] = uint32_t(t);
+			}
+
+			// cheaper direction of each edge. Shared edges are visited once if the triangles have the same winding
+			collapses.clear();
+			for (size_t t = 0; t < numTriangles; ++t)
+			{
+				if (!alive[t]) continue;
+				for (size_t i = 0; i < 3; ++i)
+				{
+					const auto a = triangles[3 * t + i];
+					const auto b = triangles[3 * t + (i + 1) % 3];
+					if (a > b || (locked[a] && locked[b])) continue;
+
+					auto q = quadrics[a];
+					q += quadrics[b];
+					const auto costA = locked[a] ? std::numeric_limits<double>::max() : q.evaluate(positions[b]);
+					const auto costB = locked[b] ? std::numeric_limits<double>::max() : q.evaluate(positions[a]);
+					if (costA <= costB)
+						collapses.push_back({ std::max(costA, 0.0), a, b });
+					else
+						collapses.push_back({ std::max(costB, 0.0), b, a });
+				}
+			}
+			std::sort(collapses.begin(), collapses.end());
+
+			std::fill(touched.begin(), touched.end(), 0);
+			size_t numCollapses = 0;
+			for (const auto& c : collapses)
+			{
+				if (numAlive <= target)
+					break;
+				if (touched[c.from] || touched[c.to])
+					continue;
+
+				// the remaining triangles may not flip
+				bool flips = false;
+				for (auto r = rowStart[c.from]; r < rowStart[c.from + 1] && !flips; ++r)
+				{
+					const auto t = rows[r];
+					if (!alive[t] || contains(t, c.to)) continue;
+					const auto before = faceNormal(t, c.from, c.from);
+					flips = glm::dot(before, faceNormal(t, c.from, c.to)) <= 0.0f && glm::dot(before, before) > 0.0f;
+				}
+				if (flips)
+					continue;
+
+				for (auto r = rowStart[c.from]; r < rowStart[c.from + 1]; ++r)
+				{
+					const auto t = rows[r];
+					if (!alive[t]) continue;
+					if (contains(t, c.to))
+					{
+						alive[t] = 0;
+						--numAlive;
+						continue;
+					}
+					for (size_t i = 0; i < 3; ++i)
+						if (triangles[3 * t + i] == c.from)
+							triangles[3 * t + i] = c.to;
+				}
+				quadrics[c.to] += quadrics[c.from];
+				touched[c.from] = touched[c.to] = 1;
+				maxCost = std::max(maxCost, c.cost);
+				++numCollapses;
+			}
+			return numCollapses != 0;
+		};
+
+		while (res.levels.size() < MeshSimplifier::MAX_LEVELS && numAlive >= MeshSimplifier::MIN_TRIANGLES)
+		{
+			const auto numBefore = numAlive;
+			const auto target = size_t(float(numBefore) * LEVEL_RATIO);
+			while (numAlive > target && collapsePass(target)) {}
+
+			if (float(numBefore - numAlive) < float(numBefore) * MIN_REDUCTION)
+				break;
+			// the shape of the sub mesh is lost
+			const auto error = float(std::sqrt(maxCost));
+			if (error > glm::length(subMesh.bboxMax - subMesh.bboxMin))
+				break;
+
+			std::vector<uint32_t> level;
+			level.reserve(numAlive * 3);
+			for (size_t t = 0; t < numTriangles; ++t)
+				if (alive[t])
+					for (size_t i = 0; i < 3; ++i)
+						level.push_back(weldedVertex[triangles[3 * t + i]]);
+			res.levels.push_back(std::move(level));
+			res.errors.push_back(error);
+		}
+
+		return res;
+	}
+
+	// FNV-1a over 8 byte words
+	uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+	{
+		const auto bytes = static_cast<const uint8_t*>(data);
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			memcpy(&word, bytes + i, 8);
+			hash = (hash ^ word) * 1099511628211ull;
+		}
+		for (; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return hash;
+	}
+
+	// identifies the processed mesh that the cached levels of detail belong to
+	uint64_t hashMesh(const IndexedMesh& mesh)
+	{
+		auto hash = 14695981039346656037ull;
+		hash = hashBytes(hash, mesh.vertices.data(), mesh.vertices.size() * sizeof(IndexedMesh::Vertex));
+		hash = hashBytes(hash, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+		for (const auto& m : mesh.subMeshes)
+		{
+			const uint32_t range[] = { m.firstIndex, m.indexCount };
+			hash = hashBytes(hash, range, sizeof(range));
+		}
+		return hash;
+	}
+
+	bool loadCache(const std::string& filename, uint64_t hash, IndexedMesh& mesh)
+	{
+		try
+		{
+			if (!fs::exists(filename))
+				return false;
+
+			MappedFile file(filename);
+			CacheReader r(file.data(), file.size());
+			if (r.read<uint32_t>() != CACHE_MAGIC || r.read<uint32_t>() != CACHE_VERSION)
+				return false;
+			// the mesh changes with the obj file and with the processing settings
+			if (r.read<uint64_t>() != hash)
+			{
+				std::cerr << "INF: level of detail cache is outdated\n";
+				return false;
+			}
+
+			std::vector<IndexedMesh::Vertex> vertices;
+			std::vector<uint32_t> indices;
+			std::vector<std::vector<IndexedMesh::Lod>> lods(mesh.subMeshes.size());
+			r.readArray(vertices);
+			r.readArray(indices);
+			for (auto& l : lods)
+				r.readArray(l);
+
+			mesh.vertices.insert(mesh.vertices.end(), vertices.begin(), vertices.end());
+			mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+			mesh.lods = std::move(lods);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "ERR: could not read level of detail cache " << filename << ": " << e.what() << '\n';
+			return false;
+		}
+		return true;
+	}
+
+	void saveCache(const std::string& filename, uint64_t hash, const IndexedMesh& mesh, size_t numBaseVertices, size_t numBaseIndices)
+	{
+		const auto tmpFilename = filename + ".tmp";
+		{
+			std::ofstream file(tmpFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				std::cerr << "ERR: could not create level of detail cache " << filename << '\n';
+				return;
+			}
+
+			CacheWriter w(file);
+			w.write(CACHE_MAGIC);
+			w.write(CACHE_VERSION);
+			w.write(hash);
+			w.writeArray(std::vector<IndexedMesh::Vertex>(mesh.vertices.begin() + numBaseVertices, mesh.vertices.end()));
+			w.writeArray(std::vector<uint32_t>(mesh.indices.begin() + numBaseIndices, mesh.indices.end()));
+			for (const auto& l : mesh.lods)
+				w.writeArray(l);
+
+			if (!file.good())
+			{
+				std::cerr << "ERR: could not write level of detail cache " << filename << '\n';
+				file.close();
+				fs::remove(tmpFilename);
+				return;
+			}
+		}
+
+		try
+		{
+			if (fs::exists(filename))
+				fs::remove(filename);
+			fs::rename(tmpFilename, filename);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "ERR: could not save level of detail cache " << filename << ": " << e.what() << '\n';
+		}
+	}
+}
+
+MeshSimplifier::Statistics MeshSimplifier::buildLods(IndexedMesh& mesh, const std::string& objFilename)
+{
+	Statistics stats;
+	const auto numBaseVertices = mesh.vertices.size();
+	const auto numBaseIndices = mesh.indices.size();
+	const auto cacheFilename = objFilename.empty() ? std::string() : getCacheFilename(objFilename);
+	const auto hash = hashMesh(mesh);
+
+	// the cache is outdated if the obj was modified after the cache was written
+	if (!cacheFilename.empty() && (!fs::exists(objFilename) || !fs::exists(cacheFilename) ||
+		fs::last_write_time(cacheFilename) >= fs::last_write_time(objFilename)))
+		stats.cached = loadCache(cacheFilename, hash, mesh);
+
+	if (!stats.cached)
+	{
+		std::vector<SubMeshLods> results(mesh.subMeshes.size());
+		ThreadPool::get().parallelFor(0, mesh.subMeshes.size(), [&](size_t i)
+		{
+			const auto clustered = i < mesh.clusters.size() && !mesh.clusters[i].empty();
+			if (mesh.subMeshes[i].indexCount / 3 >= MIN_TRIANGLES && !clustered)
+				results[i] = simplify(mesh, mesh.subMeshes[i]);
+		});
+
+		// the merged vertices get their final ids
+		mesh.lods.assign(mesh.subMeshes.size(), {});
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			auto& r = results[i];
+			if (r.levels.empty()) continue;
+			const auto firstNewVertex = uint32_t(mesh.vertices.size());
+			mesh.vertices.insert(mesh.vertices.end(), r.newVertices.begin(), r.newVertices.end());
+			for (size_t l = 0; l < r.levels.size(); ++l)
+			{
+				mesh.lods[i].push_back({ uint32_t(mesh.indices.size()), uint32_t(r.levels[l].size()), r.errors[l] });
+				for (const auto v : r.levels[l])
+					mesh.indices.push_back(v & NEW_VERTEX ? firstNewVertex + (v & ~NEW_VERTEX) : v);
+			}
+			r = SubMeshLods();
+		}
+
+		if (!cacheFilename.empty())
+			saveCache(cacheFilename, hash, mesh, numBaseVertices, numBaseIndices);
+	}
+
+	for (const auto& l : mesh.lods)
+		stats.numLevels += l.size();
+	stats.numTriangles = (mesh.indices.size() - numBaseIndices) / 3;
+	return stats;
+}
+
+std::string MeshSimplifier::getCacheFilename(const std::string& objFilename)
+{
+	return objFilename + ".lod";
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include "IndexedMesh.h"
+
+/**
+ * \brief load time generation of the levels of detail of each sub mesh.
+ * Every level has about half the triangles of the previous one and is created with quadric error half edge collapses.
+ * Vertices on texture seams and open borders are locked, vertices that only differ in the normal are merged into new vertices.
+ * The result is cached next to the obj file, because the simplification takes longer than the other processing steps.
+ * Clustered sub meshes are culled per cluster instead and get no levels of detail.
+ */
+class MeshSimplifier
+{
+	MeshSimplifier() = default;
+public:
+	struct Statistics
+	{
+		size_t numLevels = 0;
+		// triangles of all levels of detail
+		size_t numTriangles = 0;
+		bool cached = false;
+	};
+
+	/**
+	 * \brief fills mesh.lods and appends the simplified indices and the merged vertices to the mesh (multithreaded).
+	 * Must be called after the last modification of the sub mesh indices
+	 * \param objFilename filename of the obj file for the cache. Empty disables the cache
+	 */
+	static Statistics buildLods(IndexedMesh& mesh, const std::string& objFilename);
+
+	static std::string getCacheFilename(const std::string& objFilename);
+
+	// sub meshes with fewer triangles do not get levels of detail
+	static const size_t MIN_TRIANGLES = 128;
+	static const size_t MAX_LEVELS = 8;
+};
@@ -0,0 +1,219 @@
+#include "ObjCache.h"
+#include "../Framework/MappedFile.h"
+#include "../ScriptEngine/ScriptEngine.h"
+#include "CacheStream.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+namespace fs = std::experimental::filesystem;
+
+// increase this number if the layout of the cache changes
+static const uint32_t CACHE_MAGIC = 0x4A424F43; // "COBJ"
+static const uint32_t CACHE_VERSION = 2;
+
+static bool s_useCache = true;
+
+// zero if the file does not exist
+static int64_t getWriteTime(const std::string& filename)
+{
+	std::error_code ec;
+	const auto time = fs::last_write_time(filename, ec);
+	return ec ? 0 : int64_t(time.time_since_epoch().count());
+}
+
+std::string ObjCache::getCacheFilename(const std::string& objFilename)
+{
+	return objFilename + ".cache";
+}
+
+bool ObjCache::isEnabled()
+{
+	return s_useCache;
+}
+
+bool ObjCache::load(const std::string& objFilename, Data& dst)
+{
+	if (!s_useCache)
+		return false;
+
+	const auto cacheFilename = getCacheFilename(objFilename);
+	try
+	{
+		if (!fs::exists(cacheFilename))
+			return false;
+		// the cache is outdated if the obj was modified after the cache was written
+		if (fs::exists(objFilename) && fs::last_write_time(cacheFilename) < fs::last_write_time(objFilename))
+		{
+			std::cerr << "INF: obj cache is outdated\n";
+			return false;
+		}
+
+		MappedFile file(cacheFilename);
+		CacheReader r(file.data(), file.size());
+
+		if (r.read<uint32_t>() != CACHE_MAGIC)
+			throw std::runtime_error("invalid cache file");
+		if (r.read<uint32_t>() != CACHE_VERSION)
+		{
+			std::cerr << "INF: obj cache has an old version\n";
+			return false;
+		}
+
+		// the materials are baked into the cache as well
+		dst.materialFiles.resize(size_t(r.read<uint64_t>()));
+		for (auto& m : dst.materialFiles)
+		{
+			m = r.readString();
+			const auto writeTime = r.read<int64_t>();
+			if (getWriteTime(m) != writeTime)
+			{
+				std::cerr << "INF: obj cache is outdated (" << m << " was modified)\n";
+				dst = Data();
+				return false;
+			}
+		}
+
+		dst.bboxMin = r.read<glm::vec3>();
+		dst.bboxMax = r.read<glm::vec3>();
+
+		r.readArray(dst.attrib.vertices);
+		r.readArray(dst.attrib.normals);
+		r.readArray(dst.attrib.texcoords);
+
+		dst.shapes.resize(size_t(r.read<uint64_t>()));
+		for (auto& s : dst.shapes)
+		{
+			s.name = r.readString();
+			r.readArray(s.mesh.indices);
+			r.readArray(s.mesh.material_ids);
+			r.readArray(s.mesh.num_face_vertices);
+		}
+
+		dst.materials.resize(size_t(r.read<uint64_t>()));
+		for (auto& m : dst.materials)
+		{
+			m.name = r.readString();
+			r.readFloats(m.ambient);
+			r.readFloats(m.diffuse);
+			r.readFloats(m.specular);
+			r.readFloats(m.transmittance);
+			r.readFloats(m.emission);
+			m.shininess = r.read<tinyobj::real_t>();
+			m.ior = r.read<tinyobj::real_t>();
+			m.dissolve = r.read<tinyobj::real_t>();
+			m.illum = r.read<int>();
+			m.roughness = r.read<tinyobj::real_t>();
+			m.metallic = r.read<tinyobj::real_t>();
+			m.ambient_texname = r.readString();
+			m.diffuse_texname = r.readString();
+			m.specular_texname = r.readString();
+			m.alpha_texname = r.readString();
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERR: could not read obj cache " << cacheFilename << ": " << e.what() << '\n';
+		dst = Data();
+		return false;
+	}
+
+	return true;
+}
+
+void ObjCache::save(const std::string& objFilename, const Data& src)
+{
+	if (!s_useCache)
+		return;
+
+	const auto cacheFilename = getCacheFilename(objFilename);
+	// write into a temporary file first to avoid half written caches
+	const auto tmpFilename = cacheFilename + ".tmp";
+	{
+		std::ofstream file(tmpFilename, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			std::cerr << "ERR: could not create obj cache " << cacheFilename << '\n';
+			return;
+		}
+
+		CacheWriter w(file);
+		w.write(CACHE_MAGIC);
+		w.write(CACHE_VERSION);
+
+		w.write(uint64_t(src.materialFiles.size()));
+		for (const auto& m : src.materialFiles)
+		{
+			w.writeString(m);
+			w.write(getWriteTime(m));
+		}
+
+		w.write(src.bboxMin);
+		w.write(src.bboxMax);
+
+		w.writeArray(src.attrib.vertices);
+		w.writeArray(src.attrib.normals);
+		w.writeArray(src.attrib.texcoords);
+
+		w.write(uint64_t(src.shapes.size()));
+		for (const auto& s : src.shapes)
+		{
+			w.writeString(s.name);
+			w.writeArray(s.mesh.indices);
+			w.writeArray(s.mesh.material_ids);
+			w.writeArray(s.mesh.num_face_vertices);
+		}
+
+		w.write(uint64_t(src.materials.size()));
+		for (const auto& m : src.materials)
+		{
+			w.writeString(m.name);
+			w.writeFloats(m.ambient);
+			w.writeFloats(m.diffuse);
+			w.writeFloats(m.specular);
+			w.writeFloats(m.transmittance);
+			w.writeFloats(m.emission);
+			w.write(m.shininess);
+			w.write(m.ior);
+			w.write(m.dissolve);
+			w.write(m.illum);
+			w.write(m.roughness);
+			w.write(m.metallic);
+			w.writeString(m.ambient_texname);
+			w.writeString(m.diffuse_texname);
+			w.writeString(m.specular_texname);
+			w.writeString(m.alpha_texname);
+		}
+
+		if (!file.good())
+		{
+			std::cerr << "ERR: could not write obj cache " << cacheFilename << '\n';
+			file.close();
+			fs::remove(tmpFilename);
+			return;
+		}
+	}
+
+	try
+	{
+		if (fs::exists(cacheFilename))
+			fs::remove(cacheFilename);
+		fs::rename(tmpFilename, cacheFilename);
+		std::cerr << "INF: saved obj cache " << cacheFilename << '\n';
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERR: could not save obj cache " << cacheFilename << ": " << e.what() << '\n';
+	}
+}
+
+void ObjCache::initScripts()
+{
+	ScriptEngine::addProperty("objCache", []()
+	{
+		return std::to_string(s_useCache);
+	}, [](const std::vector<Token>& args)
+	{
+		s_useCache = args.at(0).getBool();
+	});
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "../Dependencies/tiny_obj_loader.h"
+
+/**
+ * \brief versioned binary cache for parsed obj files.
+ * The cache is stored next to the obj file and contains the attributes, shapes, materials and the bounding box.
+ * It is outdated if the obj file is newer or one of the material files was modified.
+ */
+class ObjCache
+{
+	ObjCache() = default;
+public:
+	struct Data
+	{
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		// mtl files of the materials
+		std::vector<std::string> materialFiles;
+		glm::vec3 bboxMin = glm::vec3(0.0f);
+		glm::vec3 bboxMax = glm::vec3(0.0f);
+	};
+
+	/**
+	 * \brief tries to load the cache for the obj file
+	 * \param objFilename filename of the original obj file
+	 * \param dst destination for the cached data
+	 * \return true if a valid cache that is newer than the obj file and its material files was found
+	 */
+	static bool load(const std::string& objFilename, Data& dst);
+
+	/**
+	 * \brief writes the cache file for the obj file (errors are reported but not thrown)
+	 * \param objFilename filename of the original obj file
+	 * \param src data that should be cached
+	 */
+	static void save(const std::string& objFilename, const Data& src);
+
+	static std::string getCacheFilename(const std::string& objFilename);
+	// objCache script property
+	static bool isEnabled();
+
+	static void initScripts();
+};
@@ -5,7 +5,46 @@
 #include <chrono>
 #include "ObjShape.h"
 #include "../Graphics/SamplerCache.h"
-#include <future>
+#include "ObjCache.h"
+#include "ObjParser.h"
+#include "IndexedMesh.h"
+#include "AlphaClassifier.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "../Graphics/IRenderer.h"
+#include "../ScriptEngine/ScriptEngine.h"
+#include "../Framework/ThreadPool.h"
+#include <algorithm>
+#include <cstddef>
+#include <cassert>
+#include <limits>
+
+// normals for vertices without obj normal are smooth or flat
+static bool s_smoothNormals = false;
+// triangles of each sub mesh are reordered for the vertex cache
+static bool s_optimizeVertexCache = true;
+// transparent triangles are split into spatially compact clusters that are culled and sorted separately
+static bool s_clusterTransparent = false;
+// the visible clusters of a transparent shape are drawn back to front
+static bool s_sortClusters = true;
+// clusters that only contain faces pointing away from the camera are culled (single sided transparency)
+static bool s_cullBackfacingClusters = false;
+// size of the parsed obj text windows in MB. Zero loads the whole file at once.
+// This bounds the triangle data of a window, the obj attributes of the whole file stay in host memory
+static int s_streamingWindow = 0;
+// sub meshes get simplified levels of detail at load time
+static bool s_generateLods = true;
+// maximum projected simplification error as fraction of the viewport. Zero always draws the full detail
+static float s_lodThreshold = 0.0005f;
+
+// layout of Shader/uniforms/vertex.glsl
+struct VertexFormat
+{
+	glm::vec3 positionOffset;
+	uint32_t octahedralNormals;
+	glm::vec3 positionScale;
+	uint32_t padding;
+};
 
 // attempts to retrieve the file directory
 static std::string GetDirectory(const std::string &filepath) {
@@ -14,30 +53,293 @@ static std::string GetDirectory(const std::string &filepath) {
 	return "";
 }
 
-ObjModel::ObjModel(const std::string& filename)
+static std::vector<std::string> getTextureNames(const std::vector<tinyobj::material_t>& materials, const std::string& directory)
+{
+	std::vector<std::string> textureNames;
+	for (const auto& m : materials)
+		for (const auto name : { &m.diffuse_texname, &m.ambient_texname, &m.specular_texname, &m.alpha_texname })
+			if (name->length())
+				textureNames.push_back(directory + *name);
+	return textureNames;
+}
+
+// bounding box of the box transformed by all instances
+static DrawCommandBounds transformBounds(const DrawCommandBounds& bounds, const std::vector<glm::mat4>& transforms)
+{
+	const auto center = (bounds.min + bounds.max) * 0.5f;
+	const auto extent = (bounds.max - bounds.min) * 0.5f;
+	DrawCommandBounds res = { glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()) };
+	for (const auto& m : transforms)
+	{
+		const auto c = glm::vec3(m * glm::vec4(center, 1.0f));
+		// extent of the rotated and scaled box
+		const auto e = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y + glm::abs(glm::vec3(m[2])) * extent.z;
+		res.min = glm::min(res.min, c - e);
+		res.max = glm::max(res.max, c + e);
+	}
+	return res;
+}
+
+// appends the data behind the first count elements. The capacity of the buffer is doubled if it is too small
+template<class TBuffer, class T>
+static void appendToBuffer(TBuffer& buffer, GLsizei& count, const std::vector<T>& data)
+{
+	const auto newCount = count + GLsizei(data.size());
+	if (buffer.empty())
+		buffer = TBuffer(GLsizei(sizeof(T)), std::max(newCount, 1));
+	else if (newCount > buffer.getNumElements())
+		buffer.reserve(std::max(newCount, buffer.getNumElements() * 2));
+
+	if (!data.empty())
+		buffer.update(data.data(), count * GLsizei(sizeof(T)), GLsizei(data.size() * sizeof(T)));
+	count = newCount;
+}
+
+ObjModel::ObjModel(const std::string& filename, bool quantizeVertices)
+{
+	if (s_streamingWindow > 0)
+		loadStreamed(filename, GetDirectory(filename), quantizeVertices);
+	else
+		Loader(*this, filename, quantizeVertices).update(std::numeric_limits<size_t>::max(), true);
+}
+
+ObjModel::ObjModel(ObjCache::Data data, const std::string& name)
+{
+	Loader(*this, std::move(data), name).update(std::numeric_limits<size_t>::max(), true);
+}
+
+static double getMilliseconds(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static void printAttributeCounts(const ObjCache::Data& data)
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	const auto directory = GetDirectory(filename);
+	printf("# of vertices  = %d\n", int(data.attrib.vertices.size() / 3));
+	printf("# of normals   = %d\n", int(data.attrib.normals.size() / 3));
+	printf("# of texcoords = %d\n", int(data.attrib.texcoords.size() / 2));
+	printf("# of materials = %d\n", int(data.materials.size()));
+}
 
-	auto time_load_start = std::chrono::high_resolution_clock::now();
+void ObjModel::LoadStatistics::printMesh() const
+{
+	printf("# of transparent triangles = %d\n", int(numTransparent));
+	printf("# of cutout triangles = %d\n", int(numCutout));
+	if (numClusters)
+		printf("# of clusters = %d\n", int(numClusters));
+	if (numOptimizedTriangles)
+		printf("vertex cache ACMR = %.3f -> %.3f\n", acmrBefore / double(numOptimizedTriangles), acmrAfter / double(numOptimizedTriangles));
+}
 
-	std::string err;
-	bool res = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str(), directory.c_str(), true);
-	if (!res)
-		throw std::runtime_error(err.c_str());
-	if (err.length())
-		std::cerr << err << std::endl;
+void ObjModel::LoadStatistics::printTimings() const
+{
+	std::cerr << "INF: load phases: read " << timings.read << " ms, parse " << timings.parse
+		<< " ms, merge " << timings.merge << " ms, materials " << materialTime
+		<< " ms, classification " << classifyTime << " ms, indexing " << indexTime << " ms, optimization " << optimizeTime << " ms, lod " << lodTime << " ms, gpu upload " << uploadTime
+		<< " ms, bvh " << bvhTime << " ms" << std::endl;
+}
 
-	std::cerr << "loading took " << std::chrono::duration_cast<std::chrono::milliseconds>(
-		std::chrono::high_resolution_clock::now() - time_load_start
+std::vector<std::vector<uint8_t>> ObjModel::classifyTriangles(const ObjCache::Data& data, int defaultMaterialId, LoadStatistics& stats) const
+{
+	const auto time_start = std::chrono::high_resolution_clock::now();
+	auto triangleClasses = AlphaClassifier::classify(data, m_materials, defaultMaterialId);
+	stats.classifyTime += getMilliseconds(time_start);
+	for (const auto& classes : triangleClasses)
+	{
+		stats.numTransparent += std::count(classes.begin(), classes.end(), AlphaClassifier::TRANSPARENT_TRIANGLE);
+		stats.numCutout += std::count(classes.begin(), classes.end(), AlphaClassifier::CUTOUT_TRIANGLE);
+	}
+	return triangleClasses;
+}
+
+void ObjModel::processMesh(IndexedMesh& mesh, const ObjCache::Data& data, int defaultMaterialId,
+	const std::vector<std::vector<uint8_t>>& triangleClasses, int clusterClass, bool optimizeVertexCache, LoadStatistics& stats)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	// sort the faces by material
+	auto time_start = Clock::now();
+	mesh.sortByMaterial(data, defaultMaterialId, triangleClasses);
+	stats.indexTime += getMilliseconds(time_start);
+
+	if (clusterClass >= 0)
+	{
+		time_start = Clock::now();
+		stats.numClusters += MeshOptimizer::buildClusters(mesh, clusterClass);
+		stats.optimizeTime += getMilliseconds(time_start);
+	}
+
+	if (optimizeVertexCache)
+	{
+		time_start = Clock::now();
+		const auto result = MeshOptimizer::optimize(mesh);
+		const auto numTriangles = mesh.indices.size() / 3;
+		stats.acmrBefore += result.acmrBefore * double(numTriangles);
+		stats.acmrAfter += result.acmrAfter * double(numTriangles);
+		stats.numOptimizedTriangles += numTriangles;
+		stats.optimizeTime += getMilliseconds(time_start);
+	}
+}
+
+ObjModel::Loader::Loader(const std::string& filename, bool quantizeVertices)
+	:
+m_ownedModel(new ObjModel()),
+m_model(*m_ownedModel),
+m_filename(filename),
+m_directory(GetDirectory(filename)),
+m_quantizeVertices(quantizeVertices)
+{
+	start();
+}
+
+ObjModel::Loader::Loader(ObjModel& model, const std::string& filename, bool quantizeVertices)
+	:
+m_model(model),
+m_filename(filename),
+m_directory(GetDirectory(filename)),
+m_quantizeVertices(quantizeVertices)
+{
+	start();
+}
+
+ObjModel::Loader::Loader(ObjModel& model, ObjCache::Data data, const std::string& name)
+	:
+m_model(model),
+m_filename(name),
+m_quantizeVertices(false),
+m_generated(true),
+m_data(std::move(data))
+{
+	start();
+}
+
+ObjModel::Loader::~Loader()
+{
+	// the background task references the loader
+	if (m_task.valid())
+		m_task.wait();
+}
+
+void ObjModel::Loader::start()
+{
+	// the script properties may change while the model is loading
+	m_generateNormals = !IRenderer::s_useGeometryShader;
+	m_smoothNormals = s_smoothNormals;
+	m_optimizeVertexCache = s_optimizeVertexCache;
+	m_generateLods = s_generateLods;
+	m_clusterClass = s_clusterTransparent ? int(AlphaClassifier::TRANSPARENT_TRIANGLE) : -1;
+
+	m_task = ThreadPool::get().enqueue([this]()
+	{
+		parse();
+	});
+}
+
+bool ObjModel::Loader::update(size_t uploadBudget, bool wait)
+{
+	while (m_stage != Stage::DONE)
+	{
+		// the gl work of a stage starts after its background task
+		if (m_task.valid())
+		{
+			if (!wait && m_task.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+				return false;
+			// rethrows the exceptions of the task
+			m_task.get();
+		}
+
+		switch (m_stage)
+		{
+		case Stage::PARSE:
+			// decode the textures on the thread pool while the vertices are merged
+			m_decodedTextures = CachedTexture2D::decodeAsync(getTextureNames(m_data.materials, m_directory));
+			m_task = ThreadPool::get().enqueue([this]()
+			{
+				index();
+			});
+			m_stage = Stage::INDEX;
+			break;
+		case Stage::INDEX:
+			if (!wait)
+				for (const auto& t : m_decodedTextures)
+					if (t.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+						return false;
+			createMaterials();
+			m_task = ThreadPool::get().enqueue([this]()
+			{
+				process();
+			});
+			m_stage = Stage::PROCESS;
+			// the classification took a while
+			if (!wait)
+				return false;
+			break;
+		case Stage::PROCESS:
+			beginUpload();
+			m_stage = Stage::UPLOAD;
+			break;
+		case Stage::UPLOAD:
+			if (!uploadSlice(uploadBudget))
+				return false;
+			finish();
+			m_stage = Stage::DONE;
+			break;
+		case Stage::DONE:
+			break;
+		}
+	}
+	return true;
+}
+
+float ObjModel::Loader::getProgress() const
+{
+	switch (m_stage)
+	{
+	case Stage::PARSE: return 0.0f;
+	case Stage::INDEX: return 0.3f;
+	case Stage::PROCESS: return 0.5f;
+	case Stage::UPLOAD:
+	{
+		const auto total = m_mesh.indices.size() * sizeof(uint32_t) + (m_quantizeVertices ?
+			m_quantized.size() * sizeof(IndexedMesh::QuantizedVertex) : m_mesh.vertices.size() * sizeof(IndexedMesh::Vertex));
+		return 0.7f + 0.3f * float(m_uploadedVertexBytes + m_uploadedIndexBytes) / float(std::max(total, size_t(1)));
+	}
+	case Stage::DONE: return 1.0f;
+	}
+	return 0.0f;
+}
+
+std::unique_ptr<ObjModel> ObjModel::Loader::release()
+{
+	assert(m_stage == Stage::DONE);
+	return std::move(m_ownedModel);
+}
+
+void ObjModel::Loader::parse()
+{
+	auto& attrib = m_data.attrib;
+	auto& shapes = m_data.shapes;
+	auto& materials = m_data.materials;
+
+	auto time_load_start = Clock::now();
+
+	// the binary cache skips the text parsing. Generated data is complete already
+	if (!m_generated)
+		m_cached = ObjCache::load(m_filename, m_data);
+	if(m_cached || m_generated)
+	{
+		m_stats.timings.read = getMilliseconds(time_load_start);
+	}
+	else
+	{
+		m_stats.timings = ObjParser::load(m_filename, m_directory, m_data);
+	}
+
+	std::cerr << (m_cached ? "loading from cache took " : "loading took ") << std::chrono::duration_cast<std::chrono::milliseconds>(
+		Clock::now() - time_load_start
 		).count() << " ms" << std::endl;
 
-	printf("# of vertices  = %d\n", (int)(attrib.vertices.size()) / 3);
-	printf("# of normals   = %d\n", (int)(attrib.normals.size()) / 3);
-	printf("# of texcoords = %d\n", (int)(attrib.texcoords.size()) / 2);
-	printf("# of materials = %d\n", (int)materials.size());
+	printAttributeCounts(m_data);
 	printf("# of shapes    = %d\n", (int)shapes.size());
 
 	// count triangels
@@ -49,54 +351,311 @@ ObjModel::ObjModel(const std::string& filename)
 	printf("# of indices   = %d\n", int(numIndices));
 	printf("# of triangles = %d\n", int(numIndices / 3));
 
-	// determine bbox on seperate thread
-	auto bbox = std::async(std::launch::async, [this](const std::vector<tinyobj::real_t>& vertices)
+	// the bbox is computed by the parser or stored in the cache
+	m_model.m_bboxMin = m_data.bboxMin;
+	m_model.m_bboxMax = m_data.bboxMax;
+
+	// make attribute buffer
+	if (!attrib.vertices.size())
+		throw std::runtime_error("no vertices found");
+
+	// `default` material will be appended after the obj materials
+	m_defaultMaterialId = int(materials.size());
+}
+
+void ObjModel::Loader::index()
+{
+	// merge the obj index triples into unique vertices
+	const auto time_index_start = Clock::now();
+	m_mesh = IndexedMesh::build(m_data);
+	m_stats.indexTime += getMilliseconds(time_index_start);
+	printf("# of unique vertices = %d\n", int(m_mesh.vertices.size()));
+
+	// the old geometry shader path generates flat normals for each frame instead
+	if (m_generateNormals)
 	{
-		m_bboxMin = glm::vec3(std::numeric_limits<float>::max());
-		m_bboxMax = glm::vec3(std::numeric_limits<float>::min());
+		const auto time_normal_start = Clock::now();
+		const auto numGenerated = m_mesh.generateNormals(m_data, m_smoothNormals);
+		m_stats.indexTime += getMilliseconds(time_normal_start);
+		if (numGenerated)
+			printf("# of generated %s normals = %d\n", m_smoothNormals ? "smooth" : "flat", int(numGenerated));
+	}
+}
 
-		for(auto i = 0; i + 2 < vertices.size(); i += 3)
-		{
-			m_bboxMin.x = std::min(m_bboxMin.x, vertices[i]);
-			m_bboxMin.y = std::min(m_bboxMin.y, vertices[i + 1]);
-			m_bboxMin.z = std::min(m_bboxMin.z, vertices[i + 2]);
+void ObjModel::Loader::createMaterials()
+{
+	const auto time_material_start = Clock::now();
+	m_model.createMaterials(m_data.materials, m_directory, m_decodedTextures);
+	m_stats.materialTime = getMilliseconds(time_material_start);
+
+	m_triangleClasses = m_model.classifyTriangles(m_data, m_defaultMaterialId, m_stats);
+}
+
+void ObjModel::Loader::process()
+{
+	auto& mesh = m_mesh;
+
+	processMesh(mesh, m_data, m_defaultMaterialId, m_triangleClasses, m_clusterClass, m_optimizeVertexCache, m_stats);
+	std::vector<std::vector<uint8_t>>().swap(m_triangleClasses);
+	m_stats.printMesh();
+
+	// the full detail indices are not modified after this point
+	const auto numBaseIndices = mesh.indices.size();
+	if (m_generateLods)
+	{
+		const auto time_lod_start = Clock::now();
+		const auto stats = MeshSimplifier::buildLods(mesh, ObjCache::isEnabled() && !m_generated ? m_filename : std::string());
+		m_stats.lodTime = getMilliseconds(time_lod_start);
+		printf("# of lod levels = %d (%d triangles%s)\n", int(stats.numLevels), int(stats.numTriangles), stats.cached ? ", cached" : "");
+	}
 
-			m_bboxMax.x = std::max(m_bboxMax.x, vertices[i]);
-			m_bboxMax.y = std::max(m_bboxMax.y, vertices[i + 1]);
-			m_bboxMax.z = std::max(m_bboxMax.z, vertices[i + 2]);
+	const auto time_quantize_start = Clock::now();
+	if (m_quantizeVertices)
+		m_quantized = mesh.quantize(m_model.m_bboxMin, m_model.m_bboxMax);
+	m_stats.uploadTime += getMilliseconds(time_quantize_start);
+
+	// the bvh references the triangles of the element buffer
+	std::cerr << "INF: building bvh" << std::endl;
+	const auto time_bvh_start = Clock::now();
+	{
+		// same grouping as createShapes()
+		std::vector<uint32_t> triangleShapes(numBaseIndices / 3);
+		uint32_t shape = 0;
+		for (size_t i = 0; i < mesh.subMeshes.size(); ++i)
+		{
+			const auto& m = mesh.subMeshes[i];
+			if (i && (m.materialId != mesh.subMeshes[i - 1].materialId || m.triangleClass != mesh.subMeshes[i - 1].triangleClass))
+				++shape;
+			std::fill_n(triangleShapes.begin() + m.firstIndex / 3, m.indexCount / 3, shape);
 		}
-	}, attrib.vertices);
+		std::vector<glm::vec3> positions(mesh.vertices.size());
+		std::transform(mesh.vertices.begin(), mesh.vertices.end(), positions.begin(), [](const IndexedMesh::Vertex& v)
+		{
+			return v.position;
+		});
+		if (m_quantizeVertices)
+			std::vector<IndexedMesh::Vertex>().swap(mesh.vertices);
 
-	// make attribute buffer
-	if (!attrib.vertices.size())
-		throw std::runtime_error("no vertices found");
+		// only the full detail triangles
+		if (numBaseIndices == mesh.indices.size())
+			m_model.m_bvh = Bvh(std::move(positions), mesh.indices, triangleShapes);
+		else
+			m_model.m_bvh = Bvh(std::move(positions), std::vector<uint32_t>(mesh.indices.begin(), mesh.indices.begin() + numBaseIndices), triangleShapes);
+	}
+	m_stats.bvhTime = getMilliseconds(time_bvh_start);
+	printf("# of bvh nodes = %d\n", int(m_model.m_bvh.getNodes().size()));
 
-	m_vao.addAttribute(0, 0, gl::VertexType::INT32, 1, 0);
-	m_vao.addAttribute(1, 0, gl::VertexType::INT32, 1, sizeof(int));
-	m_vao.addAttribute(2, 0, gl::VertexType::INT32, 1, sizeof(int) * 2);
+	if(!m_cached && !m_generated)
+		ObjCache::save(m_filename, m_data);
+	m_data = ObjCache::Data();
+}
+
+void ObjModel::Loader::beginUpload()
+{
+	const auto time_upload_start = Clock::now();
+	auto& model = m_model;
 
-	m_vertices = gl::StaticShaderStorageBuffer(sizeof(attrib.vertices[0]), GLsizei(attrib.vertices.size()), attrib.vertices.data());
-	m_verticesTextureView = gl::TextureBuffer(gl::TextureBufferFormat::RGB32F, m_vertices);
+	VertexFormat format = { glm::vec3(0.0f), 0, glm::vec3(1.0f), 0 };
 
-	if (!attrib.normals.empty())
+	// the buffers are filled by uploadSlice()
+	if(m_quantizeVertices)
 	{
-		m_normals = gl::StaticShaderStorageBuffer(sizeof(attrib.normals[0]), GLsizei(attrib.normals.size()), attrib.normals.data());
-		m_normalsTextureView = gl::TextureBuffer(gl::TextureBufferFormat::RGB32F, m_normals);
+		model.m_vao.addAttribute(0, 0, gl::VertexType::UINT16, 4, offsetof(IndexedMesh::QuantizedVertex, position), 0, true);
+		model.m_vao.addAttribute(1, 0, gl::VertexType::INT16, 2, offsetof(IndexedMesh::QuantizedVertex, normal), 0, true);
+		model.m_vao.addAttribute(2, 0, gl::VertexType::HALF, 2, offsetof(IndexedMesh::QuantizedVertex, texcoord));
+
+		model.m_vertices = gl::DynamicArrayBuffer(GLsizei(sizeof(IndexedMesh::QuantizedVertex)), GLsizei(std::max(m_quantized.size(), size_t(1))));
+		format = { model.m_bboxMin, 1, model.m_bboxMax - model.m_bboxMin, 0 };
+		model.m_isQuantized = true;
+
+		const auto floatSize = m_quantized.size() * sizeof(IndexedMesh::Vertex);
+		const auto quantizedSize = m_quantized.size() * sizeof(IndexedMesh::QuantizedVertex);
+		printf("vertex buffer = %.2f MB (quantized, saved %.2f MB)\n", quantizedSize / 1048576.0, (floatSize - quantizedSize) / 1048576.0);
 	}
-	if (!attrib.texcoords.empty())
+	else
 	{
-		m_texcoords = gl::StaticShaderStorageBuffer(sizeof(attrib.texcoords[0]), GLsizei(attrib.texcoords.size()), attrib.texcoords.data());
-		m_texcoordsTextureView = gl::TextureBuffer(gl::TextureBufferFormat::RG32F, m_texcoords);
+		model.m_vao.addAttribute(0, 0, gl::VertexType::FLOAT, 3, offsetof(IndexedMesh::Vertex, position));
+		model.m_vao.addAttribute(1, 0, gl::VertexType::FLOAT, 3, offsetof(IndexedMesh::Vertex, normal));
+		model.m_vao.addAttribute(2, 0, gl::VertexType::FLOAT, 2, offsetof(IndexedMesh::Vertex, texcoord));
+
+		model.m_vertices = gl::DynamicArrayBuffer(GLsizei(sizeof(IndexedMesh::Vertex)), GLsizei(std::max(m_mesh.vertices.size(), size_t(1))));
+		printf("vertex buffer = %.2f MB\n", m_mesh.vertices.size() * sizeof(IndexedMesh::Vertex) / 1048576.0);
 	}
-	
+	model.m_vertexFormat = gl::StaticUniformBuffer(sizeof(VertexFormat), 1, &format);
+	model.m_indices = gl::DynamicElementBuffer(GLsizei(sizeof(uint32_t)), GLsizei(std::max(m_mesh.indices.size(), size_t(1))));
+	m_stats.uploadTime += getMilliseconds(time_upload_start);
+}
+
+bool ObjModel::Loader::uploadSlice(size_t budget)
+{
+	const auto time_upload_start = Clock::now();
+	const auto upload = [&budget](auto& buffer, const void* data, size_t size, size_t& uploaded)
+	{
+		const auto count = std::min(size - uploaded, budget);
+		if (count)
+			buffer.update(static_cast<const char*>(data) + uploaded, GLintptr(uploaded), GLsizei(count));
+		uploaded += count;
+		budget -= count;
+	};
+
+	if (m_quantizeVertices)
+		upload(m_model.m_vertices, m_quantized.data(), m_quantized.size() * sizeof(IndexedMesh::QuantizedVertex), m_uploadedVertexBytes);
+	else
+		upload(m_model.m_vertices, m_mesh.vertices.data(), m_mesh.vertices.size() * sizeof(IndexedMesh::Vertex), m_uploadedVertexBytes);
+	upload(m_model.m_indices, m_mesh.indices.data(), m_mesh.indices.size() * sizeof(uint32_t), m_uploadedIndexBytes);
+	m_stats.uploadTime += getMilliseconds(time_upload_start);
+
+	return m_uploadedIndexBytes == m_mesh.indices.size() * sizeof(uint32_t);
+}
+
+void ObjModel::Loader::finish()
+{
+	std::cerr << "INF: creating shapes" << std::endl;
+	const auto time_shapes_start = Clock::now();
+	m_model.createShapes(m_mesh);
+	m_stats.uploadTime += getMilliseconds(time_shapes_start);
+	m_mesh = IndexedMesh();
+	std::vector<IndexedMesh::QuantizedVertex>().swap(m_quantized);
+
+	m_stats.printTimings();
+}
+
+void ObjModel::loadStreamed(const std::string& filename, const std::string& directory, bool quantizeVertices)
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	// the bounding box is only known after the last window
+	if (quantizeVertices)
+		std::cerr << "WARN: streamed models use the float vertex format\n";
+	// smooth normals would need the triangles of all windows
+	if (s_smoothNormals && !IRenderer::s_useGeometryShader)
+		std::cerr << "WARN: streamed models generate flat normals\n";
+
+	m_vao.addAttribute(0, 0, gl::VertexType::FLOAT, 3, offsetof(IndexedMesh::Vertex, position));
+	m_vao.addAttribute(1, 0, gl::VertexType::FLOAT, 3, offsetof(IndexedMesh::Vertex, normal));
+	m_vao.addAttribute(2, 0, gl::VertexType::FLOAT, 2, offsetof(IndexedMesh::Vertex, texcoord));
+
+	m_isStreamed = true;
+	const auto time_load_start = Clock::now();
+	// the attributes of all windows are kept because the faces may reference any previous attribute
+	ObjCache::Data data;
+	// sub meshes of all windows (the vertices and indices are on the gpu)
+	IndexedMesh streamed;
+	GLsizei numVertices = 0;
+	GLsizei numIndices = 0;
+	// the materials are created when the first triangles arrive
+	int defaultMaterialId = -1;
+	size_t numWindows = 0;
+	LoadStatistics stats;
+
+	stats.timings = ObjParser::stream(filename, directory, size_t(s_streamingWindow) * 1024 * 1024, data, [&](float progress)
+	{
+		++numWindows;
+		if (!data.shapes.empty())
+		{
+			if (defaultMaterialId < 0)
+			{
+				const auto time_material_start = Clock::now();
+				auto decodedTextures = CachedTexture2D::decodeAsync(getTextureNames(data.materials, directory));
+				createMaterials(data.materials, directory, decodedTextures);
+				defaultMaterialId = int(data.materials.size());
+				stats.materialTime = getMilliseconds(time_material_start);
+			}
+
+			auto time_start = Clock::now();
+			auto mesh = IndexedMesh::build(data);
+			if (!IRenderer::s_useGeometryShader)
+				mesh.generateNormals(data, false);
+			stats.indexTime += getMilliseconds(time_start);
+
+			// materials of later material libraries are not available and use the default material instead
+			const auto triangleClasses = classifyTriangles(data, defaultMaterialId, stats);
+			// the windows are only ordered by cluster. Their sub meshes are merged and drawn without cluster culling
+			processMesh(mesh, data, defaultMaterialId, triangleClasses, s_clusterTransparent ? int(AlphaClassifier::TRANSPARENT_TRIANGLE) : -1,
+				s_optimizeVertexCache, stats);
+
+			// the indices of the window follow the vertices of the previous windows
+			time_start = Clock::now();
+			for (auto& i : mesh.indices)
+				i += uint32_t(numVertices);
+			for (auto m : mesh.subMeshes)
+			{
+				m.firstIndex += uint32_t(numIndices);
+				streamed.subMeshes.push_back(m);
+			}
+			appendToBuffer(m_vertices, numVertices, mesh.vertices);
+			appendToBuffer(m_indices, numIndices, mesh.indices);
+			stats.uploadTime += getMilliseconds(time_start);
+		}
+
+		std::cerr << "INF: streamed " << int(progress * 100.0f) << "% (" << numIndices / 3 << " triangles, "
+			<< numVertices << " vertices, attributes " << (data.attrib.vertices.size() + data.attrib.normals.size()
+			+ data.attrib.texcoords.size()) * sizeof(tinyobj::real_t) / (1024 * 1024) << " MB)" << std::endl;
+	});
+
+	std::cerr << "streaming took " << std::chrono::duration_cast<std::chrono::milliseconds>(
+		Clock::now() - time_load_start
+		).count() << " ms (" << numWindows << " windows)" << std::endl;
+
+	if (data.attrib.vertices.empty())
+		throw std::runtime_error("no vertices found");
+
+	printAttributeCounts(data);
+	printf("# of triangles = %d\n", int(numIndices / 3));
+	printf("# of unique vertices = %d\n", int(numVertices));
+	stats.printMesh();
+	printf("vertex buffer = %.2f MB (%.2f MB allocated)\n", numVertices * sizeof(IndexedMesh::Vertex) / 1048576.0, m_vertices.size() / 1048576.0);
+
+	// a file without triangles still needs the materials
+	if (defaultMaterialId < 0)
+	{
+		std::vector<std::future<CachedTexture2D::Image>> noTextures;
+		createMaterials(data.materials, directory, noTextures);
+	}
+	else if (data.materials.size() > size_t(defaultMaterialId))
+		std::cerr << "WARN: materials of libraries after the first triangles were replaced by the default material\n";
+	if (m_vertices.empty())
+		appendToBuffer(m_vertices, numVertices, std::vector<IndexedMesh::Vertex>(1));
+	if (m_indices.empty())
+		appendToBuffer(m_indices, numIndices, std::vector<uint32_t>(3, 0));
+
+	m_bboxMin = data.bboxMin;
+	m_bboxMax = data.bboxMax;
+
+	const auto time_shapes_start = Clock::now();
+	// the sub meshes of all windows with the same material and triangle class form one shape
+	std::stable_sort(streamed.subMeshes.begin(), streamed.subMeshes.end(), [](const IndexedMesh::SubMesh& a, const IndexedMesh::SubMesh& b)
+	{
+		return std::make_pair(a.materialId, a.triangleClass) < std::make_pair(b.materialId, b.triangleClass);
+	});
+	createShapes(streamed);
+
+	const VertexFormat format = { glm::vec3(0.0f), 0, glm::vec3(1.0f), 0 };
+	m_vertexFormat = gl::StaticUniformBuffer(sizeof(VertexFormat), 1, &format);
+	stats.uploadTime += getMilliseconds(time_shapes_start);
+
+	// the bvh would need the triangles of all windows in host memory
+	std::cerr << "INF: no bvh for streamed models" << std::endl;
+
+	stats.printTimings();
+}
+
+void ObjModel::createMaterials(const std::vector<tinyobj::material_t>& materials, const std::string& directory,
+	std::vector<std::future<CachedTexture2D::Image>>& decodedTextures)
+{
+	// `default` material will be appended after the obj materials
+	const int defaultMaterialId = int(materials.size());
+
+	std::cerr << "INF: uploading " << decodedTextures.size() << " textures" << std::endl;
+	CachedTexture2D::uploadDecoded(decodedTextures);
 	std::cerr << "INF: creating material" << std::endl;
 	
-	// Append `default` material
-	materials.push_back(tinyobj::material_t());
+	const tinyobj::material_t defaultMaterial;
 	// load material
-	m_materials.reserve(materials.size());
-	for(const auto& m : materials)
+	m_materials.reserve(materials.size() + 1);
+	for(int i = 0; i <= defaultMaterialId; ++i)
 	{
+		const auto& m = i < defaultMaterialId ? materials[i] : defaultMaterial;
 		auto mat = ParamSet();
 
 		mat.add("name", m.name);
@@ -127,27 +686,71 @@ ObjModel::ObjModel(const std::string& filename)
 		m_materials.addMaterial(std::move(mat));
 	}
 	m_materials.upload();
+}
 
-	std::cerr << "INF: creating shapes" << std::endl;
-	// load shapes
-	m_shapes.reserve(shapes.size());
-	for (const auto& s : shapes)
+void ObjModel::createShapes(const IndexedMesh& mesh)
+{
+	// one shape per material and triangle class. The sub meshes of a shape are drawn with a single multi draw call
+	m_commands.reserve(mesh.subMeshes.size());
+	m_localCommandBounds.reserve(mesh.subMeshes.size());
+	m_lods.reserve(mesh.subMeshes.size());
+	m_normalCones.reserve(mesh.subMeshes.size());
+	size_t numClusters = 0;
+	for (size_t first = 0; first < mesh.subMeshes.size();)
 	{
-		int materialId = int(materials.size()) - 1;
-		if (!s.mesh.material_ids.empty())
+		const auto materialId = mesh.subMeshes[first].materialId;
+		const auto triangleClass = mesh.subMeshes[first].triangleClass;
+		const auto firstCommand = m_commands.size();
+		bool clustered = false;
+		auto bboxMin = mesh.subMeshes[first].bboxMin;
+		auto bboxMax = mesh.subMeshes[first].bboxMax;
+		auto last = first;
+		for (; last < mesh.subMeshes.size() && mesh.subMeshes[last].materialId == materialId
+			&& mesh.subMeshes[last].triangleClass == triangleClass; ++last)
 		{
-			materialId = s.mesh.material_ids[0];
-			if(materialId < 0)
-				materialId = int(materials.size()) - 1;
-		}
+			const auto& m = mesh.subMeshes[last];
+			bboxMin = glm::min(bboxMin, m.bboxMin);
+			bboxMax = glm::max(bboxMax, m.bboxMax);
+			if (last < mesh.clusters.size() && !mesh.clusters[last].empty())
+			{
+				// one command per cluster without levels of detail
+				for (const auto& c : mesh.clusters[last])
+				{
+					m_commands.push_back({ c.indexCount, 1, c.firstIndex, 0, 0 });
+					m_localCommandBounds.push_back({ c.bboxMin, c.bboxMax });
+					m_lods.push_back({ { c.firstIndex, c.indexCount, 0.0f } });
+					m_normalCones.emplace_back(c.coneAxis, c.coneCutoff);
+				}
+				numClusters += mesh.clusters[last].size();
+				clustered = true;
+				continue;
+			}
 
+			m_commands.push_back({ m.indexCount, 1, m.firstIndex, 0, 0 });
+			m_localCommandBounds.push_back({ m.bboxMin, m.bboxMax });
+			// the full detail is the first level
+			m_lods.push_back({ { m.firstIndex, m.indexCount, 0.0f } });
+			if (last < mesh.lods.size())
+				m_lods.back().insert(m_lods.back().end(), mesh.lods[last].begin(), mesh.lods[last].end());
+			// never culled as back facing
+			m_normalCones.emplace_back(0.0f, 0.0f, 1.0f, -1.0f);
+		}
 
-		m_shapes.push_back(std::make_unique<ObjShape>(
-			gl::StaticArrayBuffer(s.mesh.indices), *this, materialId));
+		const auto transparent = triangleClass == AlphaClassifier::TRANSPARENT_TRIANGLE;
+		m_shapes.push_back(std::make_unique<ObjShape>(*this, materialId, transparent, triangleClass == AlphaClassifier::CUTOUT_TRIANGLE,
+			transparent && clustered, GLsizei(firstCommand), GLsizei(m_commands.size() - firstCommand), bboxMin, bboxMax));
+		first = last;
 	}
+	m_drawCommands = gl::DynamicIndirectDrawBuffer(m_commands);
+
+	// the columns of the instance transformations advance once per instance
+	for (GLuint column = 0; column < 4; ++column)
+		m_vao.addAttribute(3 + column, 1, gl::VertexType::FLOAT, 4, column * sizeof(glm::vec4));
+	m_vao.setBindingDivisor(1, 1);
+	m_localBounds = { m_bboxMin, m_bboxMax };
+	setInstances({ glm::mat4(1.0f) });
 
-	// wait for bbox computation to finish
-	bbox.get();
+	printf("# of draw groups = %d (%d draw commands, %d clusters)\n", int(m_shapes.size()), int(m_commands.size()), int(numClusters));
 }
 
 ObjModel::~ObjModel()
@@ -158,16 +761,11 @@ void ObjModel::prepareDrawing(IShader& shader) const
 {
 	// bind the vertex format
 	m_vao.bind();
-	m_verticesTextureView.bind(4);
-	if (!m_normals.empty())
-		m_normalsTextureView.bind(5);
-	// workaround for texture usage stage warning
-	else m_verticesTextureView.bind(5);
-
-	if (!m_texcoords.empty())
-		m_texcoordsTextureView.bind(6);
-	// workaround for texture usage stage warning
-	else m_verticesTextureView.bind(6);
+	m_vertices.bindAsVertexBuffer(0);
+	m_vertexFormat.bind(3);
+	m_instances.bindAsVertexBuffer(1);
+	m_indices.bind();
+	m_drawCommands.bind();
 }
 
 const std::vector<std::unique_ptr<IShape>>& ObjModel::getShapes() const
@@ -180,6 +778,272 @@ const IMaterials& ObjModel::getMaterial() const
 	return m_materials;
 }
 
+void ObjModel::getGeometry(Geometry& geometry) const
+{
+	// the element buffer also contains the levels of detail and the vertex buffer of streamed models may have unused capacity
+	const auto indices = m_indices.getData<uint32_t>();
+	const auto instances = m_instances.getData<glm::mat4>();
+	std::vector<IndexedMesh::Vertex> vertices;
+	if (m_isQuantized)
+	{
+		const auto quantized = m_vertices.getData<IndexedMesh::QuantizedVertex>();
+		vertices.resize(quantized.size());
+		ThreadPool::get().parallelFor(0, quantized.size(), [&](size_t i)
+		{
+			vertices[i] = IndexedMesh::dequantize(quantized[i], m_localBounds.min, m_localBounds.max);
+		}, 4096);
+	}
+	else vertices = m_vertices.getData<IndexedMesh::Vertex>();
+
+	size_t numIndices = 0;
+	for (const auto& lods : m_lods)
+		numIndices += lods[0].indexCount;
+	geometry.vertices.reserve(geometry.vertices.size() + numIndices * instances.size());
+	geometry.triangleShapes.reserve(geometry.triangleShapes.size() + numIndices / 3 * instances.size());
+
+	// the shapes of previous models come first
+	const auto firstShape = uint32_t(geometry.shapeMaterials.size());
+	for (size_t s = 0; s < m_shapes.size(); ++s)
+	{
+		const auto& shape = static_cast<const ObjShape&>(*m_shapes[s]);
+		geometry.shapeMaterials.push_back(&m_materials.getMaterial(shape.getMaterialId()));
+		for (const auto& transform : instances)
+		{
+			for (auto c = size_t(shape.getFirstCommand()), end = c + size_t(shape.getNumCommands()); c < end; ++c)
+			{
+				const auto& lod = m_lods[c][0];
+				for (auto i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; ++i)
+				{
+					// same transformation as DefaultShader.vs
+					const auto& v = vertices[indices[i]];
+					geometry.vertices.push_back({ glm::vec3(transform * glm::vec4(v.position, 1.0f)), glm::vec3(transform * glm::vec4(v.normal, 0.0f)), v.texcoord });
+				}
+				geometry.triangleShapes.insert(geometry.triangleShapes.end(), lod.indexCount / 3, firstShape + uint32_t(s));
+			}
+		}
+	}
+}
+
+size_t ObjModel::cull(const Frustum& frustum) const
+{
+	size_t numVisible = 0;
+	bool changed = false;
+	m_triangleStatistics = TriangleStatistics();
+
+	// writes a level of detail of the command into a slot of the same shape
+	const auto setCommand = [&](size_t slot, size_t command, GLuint instances, size_t level)
+	{
+		const auto& lod = m_lods[command][level];
+		auto& c = m_commands[slot];
+		changed |= c.instanceCount != instances || c.firstIndex != lod.firstIndex;
+		c.instanceCount = instances;
+		c.firstIndex = lod.firstIndex;
+		c.count = lod.indexCount;
+
+		m_triangleStatistics.drawn += size_t(instances) * lod.indexCount / 3;
+		m_triangleStatistics.saved += size_t(instances) * (m_lods[command][0].indexCount - lod.indexCount) / 3;
+	};
+
+	for (const auto& s : m_shapes)
+	{
+		// all shapes of the model are obj shapes
+		auto& shape = static_cast<ObjShape&>(*s);
+		const auto first = size_t(shape.getFirstCommand());
+		const auto end = first + size_t(shape.getNumCommands());
+		// the commands of culled shapes are not drawn and keep their values
+		const auto inFrustum = frustum.isVisible(shape.getBoundingMin(), shape.getBoundingMax());
+		bool visible = false;
+		if (inFrustum && shape.isSorted())
+		{
+			// the visible clusters move to the front of the command range (far clusters first)
+			m_visibleClusters.clear();
+			for (auto i = first; i < end; ++i)
+				if (isVisible(i, frustum))
+					m_visibleClusters.emplace_back(frustum.getDepth((m_commandBounds[i].min + m_commandBounds[i].max) * 0.5f), i);
+			if (s_sortClusters)
+				std::sort(m_visibleClusters.begin(), m_visibleClusters.end(), [](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b)
+				{
+					return a.first > b.first;
+				});
+
+			for (size_t i = 0; i < m_visibleClusters.size(); ++i)
+				setCommand(first + i, m_visibleClusters[i].second, m_numInstances, 0);
+			for (auto i = first + m_visibleClusters.size(); i < end; ++i)
+				setCommand(i, i, 0, 0);
+			visible = !m_visibleClusters.empty();
+		}
+		else if (inFrustum)
+		{
+			// culled sub meshes are skipped by the multi draw call
+			for (auto i = first; i < end; ++i)
+			{
+				const GLuint instances = isVisible(i, frustum) ? m_numInstances : 0;
+				setCommand(i, i, instances, instances ? selectLod(i, frustum) : 0);
+				visible |= instances != 0;
+			}
+		}
+		shape.setVisible(visible);
+		if (visible)
+			++numVisible;
+	}
+
+	if (changed)
+		m_drawCommands.update(m_commands);
+	return numVisible;
+}
+
+bool ObjModel::isVisible(size_t command, const Frustum& frustum) const
+{
+	const auto& bounds = m_commandBounds[command];
+	if (!frustum.isVisible(bounds.min, bounds.max))
+		return false;
+
+	// the normal cones are only valid without instance transformations
+	if (!s_cullBackfacingClusters || !m_isUntransformed)
+		return true;
+	const auto& cone = m_normalCones[command];
+	return !frustum.isBackfacing((bounds.min + bounds.max) * 0.5f, glm::length(bounds.max - bounds.min) * 0.5f, glm::vec3(cone), cone.w);
+}
+
+size_t ObjModel::selectLod(size_t command, const Frustum& frustum) const
+{
+	const auto& lods = m_lods[command];
+	// all instances share one level, and the union of their bounds does not tell the distance of the nearest instance
+	if (lods.size() == 1 || s_lodThreshold <= 0.0f || m_numInstances > 1)
+		return 0;
+
+	// the simplification error relative to the size of the sub mesh is projected with the screen size of the sub mesh
+	const auto& bounds = m_localCommandBounds[command];
+	const auto diagonal = glm::length(bounds.max - bounds.min);
+	if (diagonal <= 0.0f)
+		return 0;
+	const auto scale = frustum.getScreenSize(m_commandBounds[command].min, m_commandBounds[command].max) / diagonal;
+
+	// coarsest level below the threshold
+	size_t level = 0;
+	while (level + 1 < lods.size() && lods[level + 1].error * scale <= s_lodThreshold)
+		++level;
+	return level;
+}
+
+void ObjModel::setInstances(const std::vector<glm::mat4>& transforms)
+{
+	if (transforms.empty())
+		throw std::runtime_error("ObjModel::setInstances requires at least one transformation");
+
+	m_instances = gl::StaticArrayBuffer(transforms);
+	m_numInstances = GLuint(transforms.size());
+	m_isUntransformed = transforms.size() == 1 && transforms[0] == glm::mat4(1.0f);
+	++m_geometryVersion;
+
+	// the bounding boxes enclose all instances
+	m_commandBounds.resize(m_localCommandBounds.size());
+	ThreadPool::get().parallelFor(0, m_localCommandBounds.size(), [&](size_t i)
+	{
+		m_commandBounds[i] = transformBounds(m_localCommandBounds[i], transforms);
+	});
+	const auto bounds = transformBounds(m_localBounds, transforms);
+	m_bboxMin = bounds.min;
+	m_bboxMax = bounds.max;
+
+	for (const auto& s : m_shapes)
+	{
+		auto& shape = static_cast<ObjShape&>(*s);
+		auto bboxMin = m_commandBounds[shape.getFirstCommand()].min;
+		auto bboxMax = m_commandBounds[shape.getFirstCommand()].max;
+		for (auto i = shape.getFirstCommand(), end = i + shape.getNumCommands(); i < end; ++i)
+		{
+			bboxMin = glm::min(bboxMin, m_commandBounds[i].min);
+			bboxMax = glm::max(bboxMax, m_commandBounds[i].max);
+		}
+		shape.setBounds(bboxMin, bboxMax);
+	}
+
+	resetCulling();
+}
+
+void ObjModel::resetCulling() const
+{
+	bool changed = false;
+	m_triangleStatistics = TriangleStatistics();
+	for (size_t i = 0; i < m_commands.size(); ++i)
+	{
+		const auto& lod = m_lods[i][0];
+		auto& c = m_commands[i];
+		changed |= c.instanceCount != m_numInstances || c.firstIndex != lod.firstIndex;
+		c.instanceCount = m_numInstances;
+		c.firstIndex = lod.firstIndex;
+		c.count = lod.indexCount;
+		m_triangleStatistics.drawn += size_t(m_numInstances) * lod.indexCount / 3;
+	}
+	// all shapes of the model are obj shapes
+	for (const auto& s : m_shapes)
+		static_cast<ObjShape&>(*s).setVisible(true);
+
+	if (changed)
+		m_drawCommands.update(m_commands);
+}
+
+void ObjModel::initScripts()
+{
+	ScriptEngine::addProperty("smoothNormals", []()
+	{
+		return std::to_string(s_smoothNormals);
+	}, [](const std::vector<Token>& args)
+	{
+		s_smoothNormals = args.at(0).getBool();
+	});
+	ScriptEngine::addProperty("optimizeVertexCache", []()
+	{
+		return std::to_string(s_optimizeVertexCache);
+	}, [](const std::vector<Token>& args)
+	{
+		s_optimizeVertexCache = args.at(0).getBool();
+	});
+	ScriptEngine::addProperty("streamingWindow", []()
+	{
+		return std::to_string(s_streamingWindow);
+	}, [](const std::vector<Token>& args)
+	{
+		s_streamingWindow = std::max(args.at(0).getInt(), 0);
+	});
+	ScriptEngine::addProperty("generateLods", []()
+	{
+		return std::to_string(s_generateLods);
+	}, [](const std::vector<Token>& args)
+	{
+		s_generateLods = args.at(0).getBool();
+	});
+	ScriptEngine::addProperty("lodThreshold", []()
+	{
+		return std::to_string(s_lodThreshold);
+	}, [](const std::vector<Token>& args)
+	{
+		s_lodThreshold = std::max(args.at(0).getFloat(), 0.0f);
+	});
+	ScriptEngine::addProperty("clusterTransparent", []()
+	{
+		return std::to_string(s_clusterTransparent);
+	}, [](const std::vector<Token>& args)
+	{
+		s_clusterTransparent = args.at(0).getBool();
+	});
+	ScriptEngine::addProperty("sortClusters", []()
+	{
+		return std::to_string(s_sortClusters);
+	}, [](const std::vector<Token>& args)
+	{
+		s_sortClusters = args.at(0).getBool();
+	});
+	ScriptEngine::addProperty("cullBackfacingClusters", []()
+	{
+		return std::to_string(s_cullBackfacingClusters);
+	}, [](const std::vector<Token>& args)
+	{
+		s_cullBackfacingClusters = args.at(0).getBool();
+	});
+}
+
 void ObjModel::tryAddingTexture(ParamSet& material, const std::string& attrName, const std::string& textureName)
 {
 	try
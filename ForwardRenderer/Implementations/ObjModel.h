@@ -6,13 +6,47 @@
 #include "../Dependencies/gl/vertexarrayobject.hpp"
 #include "../Framework/ParamSet.h"
 #include "SimpleMaterial.h"
+#include "../Dependencies/tiny_obj_loader.h"
+#include "IndexedMesh.h"
+#include "ObjParser.h"
+#include <future>
+#include <chrono>
 
 class SimpleMaterial;
 
+// layout of the glMultiDrawElementsIndirect commands
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	// signed in the specification
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// world space bounding box of a draw command
+struct DrawCommandBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
 class ObjModel : public IModel
 {
 public:
-	explicit ObjModel(const std::string& filename);
+	class Loader;
+
+	/**
+	 * \brief loads the whole obj file at once or streams it in windows if the streamingWindow script property is set
+	 * \param quantizeVertices use the compact vertex format (16 bit positions, octahedral normals and half float texcoords)
+	 */
+	explicit ObjModel(const std::string& filename, bool quantizeVertices = false);
+	/**
+	 * \brief creates the model from generated obj data (see ProceduralScene). No files are read or written
+	 * \param name name of the model for the log
+	 */
+	ObjModel(ObjCache::Data data, const std::string& name);
 	~ObjModel();
 
 	void prepareDrawing(IShader& shader) const override;
@@ -20,6 +54,33 @@ public:
 
 	const IMaterials& getMaterial() const override;
 
+	size_t cull(const Frustum& frustum) const override;
+	void resetCulling() const override;
+	TriangleStatistics getTriangleStatistics() const override
+	{
+		return m_triangleStatistics;
+	}
+
+	void setInstances(const std::vector<glm::mat4>& transforms) override;
+	size_t getNumInstances() const override
+	{
+		return m_numInstances;
+	}
+
+	// throws for streamed models because they have no bvh
+	const Bvh& getBvh() const override
+	{
+		if (m_isStreamed)
+			throw std::runtime_error("streamed models have no bvh for cpu queries (set streamingWindow = 0 before loading)");
+		return m_bvh;
+	}
+	void getGeometry(Geometry& geometry) const override;
+	size_t getGeometryVersion() const override
+	{
+		return m_geometryVersion;
+	}
+
+	static void initScripts();
 
 	const glm::vec3& getBoundingMin() const override
 	{
@@ -30,26 +91,208 @@ public:
 		return m_bboxMax;
 	}
 private:
+	// empty model that is filled by a Loader
+	ObjModel() = default;
+	/**
+	 * \brief parses the file in windows of streamingWindow MB. The triangles of each window are indexed
+	 * and appended to the gpu buffers before the next window is parsed.
+	 * Only the triangle data is bounded by the window size, the obj attributes of the whole file stay in host memory.
+	 * No bvh is built for streamed models
+	 */
+	void loadStreamed(const std::string& filename, const std::string& directory, bool quantizeVertices);
+	/**
+	 * \brief uploads the decoded textures and creates the obj materials and the default material
+	 */
+	void createMaterials(const std::vector<tinyobj::material_t>& materials, const std::string& directory,
+		std::vector<std::future<CachedTexture2D::Image>>& decodedTextures);
+	/**
+	 * \brief creates the draw commands and groups the consecutive sub meshes with the same material and triangle class into shapes
+	 */
+	void createShapes(const IndexedMesh& mesh);
+	/**
+	 * \brief level of detail of the draw command with a projected error below the lodThreshold.
+	 * All instances of a command share one level and the command bounds enclose all instances.
+	 * Models with multiple instances therefore always draw the full detail
+	 */
+	size_t selectLod(size_t command, const Frustum& frustum) const;
+	// frustum culling and (for clusters) back face culling of a draw command
+	bool isVisible(size_t command, const Frustum& frustum) const;
 	static void tryAddingTexture(ParamSet& material, const std::string& attrName, const std::string& textureName);
-private:
-	//gl::StaticShaderStorageBuffer m_vertices;
-	//gl::StaticShaderStorageBuffer m_normals;
-	//gl::StaticShaderStorageBuffer m_texcoords;
-	gl::StaticShaderStorageBuffer m_vertices;
-	gl::TextureBuffer m_verticesTextureView;
 
-	gl::StaticShaderStorageBuffer m_normals;
-	gl::TextureBuffer m_normalsTextureView;
+	// durations of the load phases in milliseconds and the statistics of the mesh processing (Loader and loadStreamed)
+	struct LoadStatistics
+	{
+		ObjParser::Timings timings;
+		double materialTime = 0.0;
+		double classifyTime = 0.0;
+		double indexTime = 0.0;
+		double optimizeTime = 0.0;
+		double lodTime = 0.0;
+		double uploadTime = 0.0;
+		double bvhTime = 0.0;
 
-	gl::StaticShaderStorageBuffer m_texcoords;
-	gl::TextureBuffer m_texcoordsTextureView;
+		size_t numTransparent = 0;
+		size_t numCutout = 0;
+		size_t numClusters = 0;
+		// vertex cache miss ratios weighted by the optimized triangles
+		double acmrBefore = 0.0;
+		double acmrAfter = 0.0;
+		size_t numOptimizedTriangles = 0;
+
+		// prints the triangle classes, clusters and the vertex cache efficiency
+		void printMesh() const;
+		void printTimings() const;
+	};
+	/**
+	 * \brief splits the triangles of the alpha textured materials into opaque, cutout and transparent ones (AlphaClassifier)
+	 * \return triangle classes of each shape of the data
+	 */
+	std::vector<std::vector<uint8_t>> classifyTriangles(const ObjCache::Data& data, int defaultMaterialId, LoadStatistics& stats) const;
+	/**
+	 * \brief sorts the triangles by material and triangle class, builds the clusters of the triangle class clusterClass
+	 * (none if negative) and optimizes the vertex cache order
+	 */
+	static void processMesh(IndexedMesh& mesh, const ObjCache::Data& data, int defaultMaterialId,
+		const std::vector<std::vector<uint8_t>>& triangleClasses, int clusterClass, bool optimizeVertexCache, LoadStatistics& stats);
+private:
+	// interleaved IndexedMesh::Vertex or IndexedMesh::QuantizedVertex. Dynamic storage for appending windows of streamed models
+	gl::DynamicArrayBuffer m_vertices;
+	// decoding parameters of the vertex format (binding 3)
+	gl::StaticUniformBuffer m_vertexFormat;
+	// m_vertices contains IndexedMesh::QuantizedVertex relative to m_localBounds
+	bool m_isQuantized = false;
+	// triangles sorted by material (per window for streamed models)
+	gl::DynamicElementBuffer m_indices;
+	// one command per sub mesh or cluster. The instance count of culled sub meshes is zero.
+	// The commands of sorted shapes are rewritten by every cull() with the visible clusters in drawing order
+	mutable gl::DynamicIndirectDrawBuffer m_drawCommands;
+	mutable std::vector<DrawElementsIndirectCommand> m_commands;
+	// bounds of the first instance and bounds of all instances
+	std::vector<DrawCommandBounds> m_localCommandBounds;
+	std::vector<DrawCommandBounds> m_commandBounds;
+	// levels of detail of each draw command, starting with the full detail
+	std::vector<std::vector<IndexedMesh::Lod>> m_lods;
+	// axis and cutoff of the normal cone of each draw command (cutoff -1 for sub meshes without clusters)
+	std::vector<glm::vec4> m_normalCones;
+	// depth and command of the visible clusters of a sorted shape
+	mutable std::vector<std::pair<float, size_t>> m_visibleClusters;
+	mutable TriangleStatistics m_triangleStatistics;
+	// per instance transformations (vertex binding 1)
+	gl::StaticArrayBuffer m_instances;
+	GLuint m_numInstances = 1;
+	// single identity instance
+	bool m_isUntransformed = true;
+	// loaded with loadStreamed (without bvh)
+	bool m_isStreamed = false;
+	// incremented by setInstances (the triangles are not changed after loading)
+	size_t m_geometryVersion = 0;
 
 	gl::VertexArrayObject m_vao;
 	std::vector<std::unique_ptr<IShape>> m_shapes;
 
 	SimpleMaterial m_materials;
+	Bvh m_bvh;
 
+	// bounding box of all instances
 	glm::vec3 m_bboxMin;
 	glm::vec3 m_bboxMax;
+	DrawCommandBounds m_localBounds;
 };
 
+/**
+ * \brief loads an obj model in stages. Parsing and mesh processing run on the thread pool,
+ * the gl work (materials, alpha classification and buffer uploads) is done by update() in small steps on the gl thread
+ */
+class ObjModel::Loader
+{
+public:
+	/**
+	 * \brief starts loading into a new model (see release())
+	 * \param quantizeVertices use the compact vertex format
+	 */
+	Loader(const std::string& filename, bool quantizeVertices);
+	/**
+	 * \brief starts loading into an empty model. The model may not be used before update() returned true
+	 */
+	Loader(ObjModel& model, const std::string& filename, bool quantizeVertices);
+	/**
+	 * \brief starts processing generated obj data into an empty model. The textures of the materials are loaded from the working directory
+	 */
+	Loader(ObjModel& model, ObjCache::Data data, const std::string& name);
+	// waits for the running background task
+	~Loader();
+	Loader(const Loader&) = delete;
+	Loader& operator=(const Loader&) = delete;
+
+	/**
+	 * \brief advances the loading. Does at most one expensive gl step unless wait is set. Must be called on the gl thread
+	 * \param uploadBudget maximum number of vertex and index bytes that are uploaded by this call
+	 * \param wait waits for the background tasks instead of returning early
+	 * \return true if the model is complete
+	 * \throws runtime_error if the model could not be loaded
+	 */
+	bool update(size_t uploadBudget, bool wait);
+	// approximate progress in [0, 1]
+	float getProgress() const;
+	/**
+	 * \brief transfers the complete model that was created by the loader
+	 */
+	std::unique_ptr<ObjModel> release();
+private:
+	using Clock = std::chrono::high_resolution_clock;
+
+	enum class Stage
+	{
+		// background: read and parse the obj file
+		PARSE,
+		// background: merge the vertices and generate normals
+		INDEX,
+		// background: sort by material, optimize, simplify, quantize and build the bvh
+		PROCESS,
+		// gl: upload the vertices and indices in slices
+		UPLOAD,
+		DONE
+	};
+
+	void start();
+	void parse();
+	void index();
+	// creates the materials and classifies the triangles (gl thread)
+	void createMaterials();
+	void process();
+	// creates the buffers (gl thread)
+	void beginUpload();
+	// returns true if all data was uploaded (gl thread)
+	bool uploadSlice(size_t budget);
+	// creates the shapes (gl thread)
+	void finish();
+private:
+	std::unique_ptr<ObjModel> m_ownedModel;
+	ObjModel& m_model;
+	std::string m_filename;
+	std::string m_directory;
+	bool m_quantizeVertices;
+	// the data was passed to the constructor instead of being loaded from m_filename
+	bool m_generated = false;
+	// script properties at the start of the loading
+	bool m_generateNormals = true;
+	bool m_smoothNormals = false;
+	bool m_optimizeVertexCache = true;
+	bool m_generateLods = true;
+	int m_clusterClass = -1;
+
+	Stage m_stage = Stage::PARSE;
+	std::future<void> m_task;
+
+	ObjCache::Data m_data;
+	bool m_cached = false;
+	std::vector<std::future<CachedTexture2D::Image>> m_decodedTextures;
+	int m_defaultMaterialId = 0;
+	std::vector<std::vector<uint8_t>> m_triangleClasses;
+	IndexedMesh m_mesh;
+	std::vector<IndexedMesh::QuantizedVertex> m_quantized;
+	size_t m_uploadedVertexBytes = 0;
+	size_t m_uploadedIndexBytes = 0;
+
+	ObjModel::LoadStatistics m_stats;
+};
@@ -0,0 +1,602 @@
+#include "ObjParser.h"
+#include "../Framework/MappedFile.h"
+#include "../Framework/ThreadPool.h"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	double getMilliseconds(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// minimum amount of bytes that is parsed by a single task
+	const size_t MIN_CHUNK_SIZE = 1024 * 1024;
+
+	enum class CommandType
+	{
+		Group,
+		Object,
+		UseMtl,
+		MtlLib
+	};
+
+	// statement that changes the shape or material state
+	struct Command
+	{
+		CommandType type;
+		// number of triangles that were emitted by the chunk before this command
+		size_t triangle;
+		std::string name;
+	};
+
+	struct Chunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+
+		std::vector<tinyobj::real_t> vertices;
+		std::vector<tinyobj::real_t> normals;
+		std::vector<tinyobj::real_t> texcoords;
+		// three indices per triangle
+		std::vector<tinyobj::index_t> indices;
+		// negative obj indices depend on the attribute count of the previous chunks.
+		// Stored as position in indices * 3 + (0 = vertex, 1 = normal, 2 = texcoord)
+		std::vector<size_t> relativeIndices;
+		std::vector<Command> commands;
+
+		glm::vec3 bboxMin = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 bboxMax = glm::vec3(-std::numeric_limits<float>::max());
+
+		size_t getNumTriangles() const { return indices.size() / 3; }
+	};
+
+	// range of chunk triangles that belong to a shape
+	struct Segment
+	{
+		size_t chunk;
+		size_t firstTriangle;
+		size_t lastTriangle;
+		size_t shape;
+		// triangle offset within the shape
+		size_t shapeOffset;
+		int material;
+	};
+
+	bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	const char* skipSpace(const char* cur, const char* end)
+	{
+		while (cur != end && isSpace(*cur))
+			++cur;
+		return cur;
+	}
+
+	const char* skipToken(const char* cur, const char* end)
+	{
+		while (cur != end && !isSpace(*cur))
+			++cur;
+		return cur;
+	}
+
+	bool startsWith(const char* cur, const char* end, const char* keyword)
+	{
+		const auto len = strlen(keyword);
+		return size_t(end - cur) > len && memcmp(cur, keyword, len) == 0 && isSpace(cur[len]);
+	}
+
+	double getPow10(int exponent)
+	{
+		// powers up to 1e22 are exact doubles
+		static const double s_table[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		if (exponent <= 22)
+			return s_table[exponent];
+		return std::pow(10.0, exponent);
+	}
+
+	/**
+	 * \brief locale independent float parsing. Missing numbers are set to the default value (like tinyobj)
+	 * \return position after the number
+	 */
+	const char* parseReal(const char* cur, const char* end, tinyobj::real_t& dst, tinyobj::real_t defaultValue = 0.0f)
+	{
+		cur = skipSpace(cur, end);
+		const auto start = cur;
+
+		bool negative = false;
+		if (cur != end && (*cur == '-' || *cur == '+'))
+			negative = *(cur++) == '-';
+
+		uint64_t mantissa = 0;
+		int exponent = 0;
+		int numDigits = 0;
+		for (; cur != end && isDigit(*cur); ++cur, ++numDigits)
+		{
+			if (mantissa < 100000000000000000ull)
+				mantissa = mantissa * 10 + uint64_t(*cur - '0');
+			else ++exponent;
+		}
+		if (cur != end && *cur == '.')
+		{
+			for (++cur; cur != end && isDigit(*cur); ++cur, ++numDigits)
+			{
+				if (mantissa < 100000000000000000ull)
+				{
+					mantissa = mantissa * 10 + uint64_t(*cur - '0');
+					--exponent;
+				}
+			}
+		}
+		if (numDigits == 0)
+		{
+			dst = defaultValue;
+			return skipToken(start, end);
+		}
+
+		if (cur != end && (*cur == 'e' || *cur == 'E'))
+		{
+			auto expCur = cur + 1;
+			bool expNegative = false;
+			if (expCur != end && (*expCur == '-' || *expCur == '+'))
+				expNegative = *(expCur++) == '-';
+			if (expCur != end && isDigit(*expCur))
+			{
+				int e = 0;
+				for (; expCur != end && isDigit(*expCur); ++expCur)
+					if (e < 10000) e = e * 10 + (*expCur - '0');
+				exponent += expNegative ? -e : e;
+				cur = expCur;
+			}
+		}
+
+		auto value = double(mantissa);
+		if (exponent < 0)
+			value /= getPow10(-exponent);
+		else if (exponent > 0)
+			value *= getPow10(exponent);
+
+		dst = tinyobj::real_t(negative ? -value : value);
+		return cur;
+	}
+
+	// returns false if there is no number at the current position
+	bool parseInt(const char*& cur, const char* end, int& dst)
+	{
+		bool negative = false;
+		auto it = cur;
+		if (it != end && (*it == '-' || *it == '+'))
+			negative = *(it++) == '-';
+		if (it == end || !isDigit(*it))
+			return false;
+
+		int value = 0;
+		for (; it != end && isDigit(*it); ++it)
+			value = value * 10 + (*it - '0');
+
+		dst = negative ? -value : value;
+		cur = it;
+		return true;
+	}
+
+	struct FaceVertex
+	{
+		tinyobj::index_t index;
+		// bit i is set if component i is relative to the chunk start
+		uint8_t relative = 0;
+	};
+
+	/**
+	 * \brief converts the obj index into a zero based index
+	 * \param count number of attributes that were parsed by the chunk so far
+	 */
+	int fixIndex(int idx, size_t count, int component, uint8_t& relative)
+	{
+		if (idx > 0)
+			return idx - 1;
+		if (idx == 0)
+			throw std::runtime_error("zero value for face index");
+		relative |= uint8_t(1 << component);
+		return int(count) + idx;
+	}
+
+	// parses v, v/vt, v//vn or v/vt/vn
+	const char* parseFaceVertex(const char* cur, const char* end, const Chunk& chunk, FaceVertex& dst)
+	{
+		int idx;
+		if (!parseInt(cur, end, idx))
+			throw std::runtime_error("invalid face index");
+		dst.index.vertex_index = fixIndex(idx, chunk.vertices.size() / 3, 0, dst.relative);
+		dst.index.normal_index = -1;
+		dst.index.texcoord_index = -1;
+
+		if (cur == end || *cur != '/')
+			return cur;
+		++cur;
+
+		// texcoord
+		if (parseInt(cur, end, idx))
+			dst.index.texcoord_index = fixIndex(idx, chunk.texcoords.size() / 2, 2, dst.relative);
+
+		if (cur == end || *cur != '/')
+			return cur;
+		++cur;
+
+		// normal
+		if (parseInt(cur, end, idx))
+			dst.index.normal_index = fixIndex(idx, chunk.normals.size() / 3, 1, dst.relative);
+
+		return cur;
+	}
+
+	void emitFaceVertex(Chunk& chunk, const FaceVertex& v)
+	{
+		if (v.relative)
+		{
+			const auto pos = chunk.indices.size() * 3;
+			for (size_t c = 0; c < 3; ++c)
+				if (v.relative & (1 << c))
+					chunk.relativeIndices.push_back(pos + c);
+		}
+		chunk.indices.push_back(v.index);
+	}
+
+	void parseChunk(Chunk& chunk)
+	{
+		std::vector<FaceVertex> face;
+		face.reserve(8);
+
+		auto lineStart = chunk.begin;
+		while (lineStart < chunk.end)
+		{
+			auto lineEnd = static_cast<const char*>(memchr(lineStart, '\n', chunk.end - lineStart));
+			if (!lineEnd) lineEnd = chunk.end;
+			const auto nextLine = lineEnd == chunk.end ? chunk.end : lineEnd + 1;
+			// trim trailing whitespace (including \r)
+			while (lineEnd != lineStart && isSpace(lineEnd[-1]))
+				--lineEnd;
+
+			const auto end = lineEnd;
+			auto cur = skipSpace(lineStart, end);
+			lineStart = nextLine;
+
+			if (cur == end || *cur == '#')
+				continue;
+
+			if (startsWith(cur, end, "v"))
+			{
+				tinyobj::real_t v[3];
+				cur += 2;
+				for (auto& c : v)
+					cur = parseReal(cur, end, c);
+				chunk.vertices.insert(chunk.vertices.end(), v, v + 3);
+				chunk.bboxMin = glm::min(chunk.bboxMin, glm::vec3(v[0], v[1], v[2]));
+				chunk.bboxMax = glm::max(chunk.bboxMax, glm::vec3(v[0], v[1], v[2]));
+			}
+			else if (startsWith(cur, end, "vn"))
+			{
+				tinyobj::real_t n[3];
+				cur += 3;
+				for (auto& c : n)
+					cur = parseReal(cur, end, c);
+				chunk.normals.insert(chunk.normals.end(), n, n + 3);
+			}
+			else if (startsWith(cur, end, "vt"))
+			{
+				tinyobj::real_t t[2];
+				cur += 3;
+				cur = parseReal(cur, end, t[0]);
+				cur = parseReal(cur, end, t[1]);
+				chunk.texcoords.insert(chunk.texcoords.end(), t, t + 2);
+			}
+			else if (startsWith(cur, end, "f"))
+			{
+				face.clear();
+				cur = skipSpace(cur + 2, end);
+				while (cur != end)
+				{
+					FaceVertex v;
+					cur = parseFaceVertex(cur, end, chunk, v);
+					face.push_back(v);
+					cur = skipSpace(cur, end);
+				}
+
+				// triangle fan (same as tinyobj)
+				for (size_t k = 2; k < face.size(); ++k)
+				{
+					emitFaceVertex(chunk, face[0]);
+					emitFaceVertex(chunk, face[k - 1]);
+					emitFaceVertex(chunk, face[k]);
+				}
+			}
+			else if (startsWith(cur, end, "usemtl"))
+			{
+				chunk.commands.push_back({ CommandType::UseMtl, chunk.getNumTriangles(), std::string(cur + 7, end) });
+			}
+			else if (startsWith(cur, end, "mtllib"))
+			{
+				chunk.commands.push_back({ CommandType::MtlLib, chunk.getNumTriangles(), std::string(cur + 7, end) });
+			}
+			else if (startsWith(cur, end, "g"))
+			{
+				// only the first group name is used
+				const auto nameStart = skipSpace(cur + 2, end);
+				chunk.commands.push_back({ CommandType::Group, chunk.getNumTriangles(), std::string(nameStart, skipToken(nameStart, end)) });
+			}
+			else if (startsWith(cur, end, "o"))
+			{
+				chunk.commands.push_back({ CommandType::Object, chunk.getNumTriangles(), std::string(cur + 2, end) });
+			}
+			// ignore unknown commands
+		}
+	}
+
+	void loadMaterialLibrary(const std::string& line, const std::string& directory,
+		std::vector<tinyobj::material_t>& materials, std::map<std::string, int>& materialMap, std::vector<std::string>& materialFiles)
+	{
+		// multiple filenames may be specified, the first one that can be loaded is used
+		tinyobj::MaterialFileReader reader(directory);
+		const char* cur = line.c_str();
+		const char* end = cur + line.size();
+		while((cur = skipSpace(cur, end)) != end)
+		{
+			const auto nameEnd = skipToken(cur, end);
+			std::string err;
+			const bool ok = reader(std::string(cur, nameEnd), &materials, &materialMap, &err);
+			if (err.length())
+				std::cerr << err;
+			if (ok)
+			{
+				materialFiles.push_back(directory + std::string(cur, nameEnd));
+				return;
+			}
+			cur = nameEnd;
+		}
+		std::cerr << "WARN: Failed to load material file(s). Use default material.\n";
+	}
+
+	// splits the text at line boundaries into chunks of at least chunkSize bytes
+	std::vector<Chunk> splitChunks(const char* begin, const char* end, size_t chunkSize)
+	{
+		std::vector<Chunk> chunks;
+		auto cur = begin;
+		while (cur < end)
+		{
+			Chunk c;
+			c.begin = cur;
+			c.end = end;
+			if (size_t(end - cur) > chunkSize)
+			{
+				const auto newline = static_cast<const char*>(memchr(cur + chunkSize, '\n', end - cur - chunkSize));
+				if (newline)
+					c.end = newline + 1;
+			}
+			cur = c.end;
+			chunks.push_back(std::move(c));
+		}
+		return chunks;
+	}
+
+	// shape and material state that carries over to the next chunks
+	struct MergeState
+	{
+		bool shapeOpen = false;
+		std::string name;
+		int material = -1;
+		std::map<std::string, int> materialMap;
+	};
+
+	/**
+	 * \brief appends the attributes of the parsed chunks to dst and the triangles as new shapes
+	 */
+	void mergeChunks(std::vector<Chunk>& chunks, const std::string& directory, MergeState& state, ObjCache::Data& dst)
+	{
+		auto& pool = ThreadPool::get();
+
+		// attribute offsets of the chunks
+		std::vector<size_t> vertexOffset(chunks.size() + 1, dst.attrib.vertices.size());
+		std::vector<size_t> normalOffset(chunks.size() + 1, dst.attrib.normals.size());
+		std::vector<size_t> texcoordOffset(chunks.size() + 1, dst.attrib.texcoords.size());
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			vertexOffset[i + 1] = vertexOffset[i] + chunks[i].vertices.size();
+			normalOffset[i + 1] = normalOffset[i] + chunks[i].normals.size();
+			texcoordOffset[i + 1] = texcoordOffset[i] + chunks[i].texcoords.size();
+			dst.bboxMin = glm::min(dst.bboxMin, chunks[i].bboxMin);
+			dst.bboxMax = glm::max(dst.bboxMax, chunks[i].bboxMax);
+		}
+
+		dst.attrib.vertices.resize(vertexOffset.back());
+		dst.attrib.normals.resize(normalOffset.back());
+		dst.attrib.texcoords.resize(texcoordOffset.back());
+
+		// walk through the commands to determine the shapes and materials
+		const auto firstShape = dst.shapes.size();
+		std::vector<Segment> segments;
+		std::vector<size_t> shapeTriangles;
+		{
+			const auto addSegment = [&](size_t chunk, size_t first, size_t last)
+			{
+				if (first >= last) return;
+				if (!state.shapeOpen)
+				{
+					dst.shapes.emplace_back();
+					dst.shapes.back().name = state.name;
+					shapeTriangles.push_back(0);
+					state.shapeOpen = true;
+				}
+				segments.push_back({ chunk, first, last, dst.shapes.size() - 1, shapeTriangles.back(), state.material });
+				shapeTriangles.back() += last - first;
+			};
+
+			for (size_t c = 0; c < chunks.size(); ++c)
+			{
+				size_t triangle = 0;
+				for (const auto& cmd : chunks[c].commands)
+				{
+					addSegment(c, triangle, cmd.triangle);
+					triangle = cmd.triangle;
+
+					switch (cmd.type)
+					{
+					case CommandType::Group:
+					case CommandType::Object:
+						// empty shapes are never created, therefore the next triangle starts a new shape
+						state.shapeOpen = false;
+						state.name = cmd.name;
+						break;
+					case CommandType::UseMtl:
+					{
+						const auto it = state.materialMap.find(cmd.name);
+						state.material = it != state.materialMap.end() ? it->second : -1;
+					}	break;
+					case CommandType::MtlLib:
+						loadMaterialLibrary(cmd.name, directory, dst.materials, state.materialMap, dst.materialFiles);
+						break;
+					}
+				}
+				addSegment(c, triangle, chunks[c].getNumTriangles());
+			}
+		}
+
+		for (size_t s = firstShape; s < dst.shapes.size(); ++s)
+		{
+			auto& mesh = dst.shapes[s].mesh;
+			const auto numTriangles = shapeTriangles[s - firstShape];
+			mesh.indices.resize(numTriangles * 3);
+			mesh.material_ids.resize(numTriangles);
+			mesh.num_face_vertices.assign(numTriangles, 3);
+		}
+
+		// copy attributes and resolve relative indices
+		pool.parallelFor(0, chunks.size(), [&](size_t c)
+		{
+			auto& chunk = chunks[c];
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), dst.attrib.vertices.begin() + vertexOffset[c]);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), dst.attrib.normals.begin() + normalOffset[c]);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), dst.attrib.texcoords.begin() + texcoordOffset[c]);
+
+			const int offsets[] = { int(vertexOffset[c] / 3), int(normalOffset[c] / 3), int(texcoordOffset[c] / 2) };
+			for (const auto rel : chunk.relativeIndices)
+			{
+				auto& idx = chunk.indices[rel / 3];
+				switch (rel % 3)
+				{
+				case 0: idx.vertex_index += offsets[0]; break;
+				case 1: idx.normal_index += offsets[1]; break;
+				case 2: idx.texcoord_index += offsets[2]; break;
+				}
+			}
+
+			// free memory early
+			std::vector<tinyobj::real_t>().swap(chunk.vertices);
+			std::vector<tinyobj::real_t>().swap(chunk.normals);
+			std::vector<tinyobj::real_t>().swap(chunk.texcoords);
+		});
+
+		// copy triangles into the shapes
+		pool.parallelFor(0, segments.size(), [&](size_t i)
+		{
+			const auto& seg = segments[i];
+			const auto& chunk = chunks[seg.chunk];
+			auto& mesh = dst.shapes[seg.shape].mesh;
+			std::copy(chunk.indices.begin() + seg.firstTriangle * 3, chunk.indices.begin() + seg.lastTriangle * 3,
+				mesh.indices.begin() + seg.shapeOffset * 3);
+			std::fill_n(mesh.material_ids.begin() + seg.shapeOffset, seg.lastTriangle - seg.firstTriangle, seg.material);
+		});
+	}
+}
+
+ObjParser::Timings ObjParser::load(const std::string& filename, const std::string& directory, ObjCache::Data& dst)
+{
+	Timings timings;
+	auto& pool = ThreadPool::get();
+
+	// read
+	auto start = Clock::now();
+	MappedFile file(filename);
+	const auto fileBegin = reinterpret_cast<const char*>(file.data());
+	const auto fileEnd = fileBegin + file.size();
+	timings.read = getMilliseconds(start);
+
+	// split into chunks at line boundaries. Use more chunks than threads for load balancing
+	start = Clock::now();
+	auto chunks = splitChunks(fileBegin, fileEnd, std::max(MIN_CHUNK_SIZE, file.size() / (pool.getNumThreads() * 4) + 1));
+
+	pool.parallelFor(0, chunks.size(), [&chunks](size_t i)
+	{
+		parseChunk(chunks[i]);
+	});
+	timings.parse = getMilliseconds(start);
+
+	// merge
+	start = Clock::now();
+	dst.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+	dst.bboxMax = glm::vec3(-std::numeric_limits<float>::max());
+	MergeState state;
+	mergeChunks(chunks, directory, state, dst);
+	timings.merge = getMilliseconds(start);
+
+	return timings;
+}
+
+ObjParser::Timings ObjParser::stream(const std::string& filename, const std::string& directory, size_t windowSize,
+	ObjCache::Data& dst, const std::function<void(float)>& onChunk)
+{
+	Timings timings;
+	auto& pool = ThreadPool::get();
+
+	auto start = Clock::now();
+	MappedFile file(filename);
+	const auto fileBegin = reinterpret_cast<const char*>(file.data());
+	const auto fileEnd = fileBegin + file.size();
+	timings.read = getMilliseconds(start);
+
+	dst.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+	dst.bboxMax = glm::vec3(-std::numeric_limits<float>::max());
+	MergeState state;
+
+	// the file is processed in windows of windowSize bytes. Each window is parsed in parallel like a whole file by load()
+	const auto windows = splitChunks(fileBegin, fileEnd, std::max(windowSize, MIN_CHUNK_SIZE));
+	for (const auto& window : windows)
+	{
+		start = Clock::now();
+		const auto windowSize = size_t(window.end - window.begin);
+		auto chunks = splitChunks(window.begin, window.end, std::max(MIN_CHUNK_SIZE, windowSize / (pool.getNumThreads() * 4) + 1));
+		pool.parallelFor(0, chunks.size(), [&chunks](size_t i)
+		{
+			parseChunk(chunks[i]);
+		});
+		timings.parse += getMilliseconds(start);
+
+		// only the triangles of the current window are kept
+		start = Clock::now();
+		std::vector<tinyobj::shape_t>().swap(dst.shapes);
+		// the next triangle starts a new shape (with the same name)
+		state.shapeOpen = false;
+		mergeChunks(chunks, directory, state, dst);
+		std::vector<Chunk>().swap(chunks);
+		timings.merge += getMilliseconds(start);
+
+		onChunk(float(window.end - fileBegin) / float(file.size()));
+	}
+	std::vector<tinyobj::shape_t>().swap(dst.shapes);
+
+	return timings;
+}
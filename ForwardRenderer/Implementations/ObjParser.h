@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <functional>
+#include "ObjCache.h"
+
+/**
+ * \brief multithreaded obj parser. The file is split into chunks at line boundaries
+ * which are parsed in parallel and merged afterwards. The output matches tinyobj::LoadObj with triangulation.
+ */
+class ObjParser
+{
+	ObjParser() = default;
+public:
+	// durations of the loading phases in milliseconds
+	struct Timings
+	{
+		double read = 0.0;
+		double parse = 0.0;
+		double merge = 0.0;
+	};
+
+	/**
+	 * \brief parses the obj file and the referenced material libraries
+	 * \param filename obj file
+	 * \param directory directory of the obj file (used to find the material libraries)
+	 * \param dst destination for attributes, shapes, materials and bounding box
+	 * \return timings of the single phases
+	 * \throws runtime_error if the file could not be read or contains invalid data
+	 */
+	static Timings load(const std::string& filename, const std::string& directory, ObjCache::Data& dst);
+
+	/**
+	 * \brief parses the obj file in windows of about windowSize bytes. Attributes, materials and the bounding box
+	 * accumulate in dst, while dst.shapes only contains the triangles of the current window
+	 * \param windowSize size of the text windows in bytes
+	 * \param onChunk called after each window with the processed fraction of the file
+	 * \throws runtime_error if the file could not be read or contains invalid data
+	 */
+	static Timings stream(const std::string& filename, const std::string& directory, size_t windowSize,
+		ObjCache::Data& dst, const std::function<void(float progress)>& onChunk);
+};
@@ -8,27 +8,35 @@
 class ObjShape : public IShape
 {
 public:
-	ObjShape(gl::StaticArrayBuffer& buffer, ObjModel& model, int materialId)
+	/**
+	 * \brief all triangles of the model with the same material and transparency
+	 * \param transparent true if the triangles belong into the transparent passes
+	 * \param cutout true if the triangles are alpha tested in the opaque passes
+	 * \param sorted true if the commands are clusters that are drawn in the order of the last cull()
+	 * \param firstCommand first draw command in the indirect buffer of the model
+	 * \param numCommands number of sub meshes or clusters
+	 * \param bboxMin bounding box of all sub meshes
+	 * \param bboxMax bounding box of all sub meshes
+	 */
+	ObjShape(ObjModel& model, int materialId, bool transparent, bool cutout, bool sorted, GLsizei firstCommand, GLsizei numCommands,
+		const glm::vec3& bboxMin, const glm::vec3& bboxMax)
 		:
 	m_model(model),
 	m_materialIndex(materialId),
-	m_elements(std::move(buffer))
-	{
-		const auto& mat = m_model.getMaterial().getMaterial(materialId);
-		// transparent
-		auto dissolve = mat.get<float>("dissolve");
-		if (dissolve && *dissolve < 1.0f)
-			m_isTransparent = true;
-		if (mat.getTexture("dissolve"))
-			m_isTransparent = true;
-		auto diffuseTex = mat.getTexture("diffuse");
-		if (diffuseTex && diffuseTex->isTransparent())
-			m_isTransparent = true;
-	}
+	m_firstCommand(firstCommand),
+	m_numCommands(numCommands),
+	m_isTransparent(transparent),
+	m_isCutout(cutout),
+	m_isSorted(sorted),
+	m_bboxMin(bboxMin),
+	m_bboxMax(bboxMax)
+	{}
 
 	void draw(IShader* shader) override
 	{
 		if (IRenderer::s_filterMaterial != -1 && IRenderer::s_filterMaterial > m_materialIndex) return;
+		// culled by the model
+		if (!m_isVisible) return;
 
 		if (shader)
 		{
@@ -36,17 +44,65 @@ public:
 			shader->bind();
 		}
 
-		m_elements.bind(0);
-		glDrawArrays(GL_TRIANGLES, 0, m_elements.getNumElements());
+		// element and indirect buffer were bound by the model
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+			reinterpret_cast<const void*>(size_t(m_firstCommand) * sizeof(DrawElementsIndirectCommand)), m_numCommands, 0);
 	}
 
 	bool isTransparent() const override
 	{
 		return m_isTransparent;
 	}
+
+	bool isCutout() const override
+	{
+		return m_isCutout;
+	}
+
+	const glm::vec3& getBoundingMin() const override
+	{
+		return m_bboxMin;
+	}
+	const glm::vec3& getBoundingMax() const override
+	{
+		return m_bboxMax;
+	}
+
+	int getMaterialId() const
+	{
+		return m_materialIndex;
+	}
+	GLsizei getFirstCommand() const
+	{
+		return m_firstCommand;
+	}
+	GLsizei getNumCommands() const
+	{
+		return m_numCommands;
+	}
+	bool isSorted() const
+	{
+		return m_isSorted;
+	}
+	void setVisible(bool visible)
+	{
+		m_isVisible = visible;
+	}
+	// bounding box of all instances
+	void setBounds(const glm::vec3& bboxMin, const glm::vec3& bboxMax)
+	{
+		m_bboxMin = bboxMin;
+		m_bboxMax = bboxMax;
+	}
 private:
 	ObjModel& m_model;
 	const int m_materialIndex;
-	gl::StaticArrayBuffer m_elements;
-	bool m_isTransparent = false;
+	const GLsizei m_firstCommand;
+	const GLsizei m_numCommands;
+	const bool m_isTransparent;
+	const bool m_isCutout;
+	const bool m_isSorted;
+	glm::vec3 m_bboxMin;
+	glm::vec3 m_bboxMax;
+	bool m_isVisible = true;
 };
@@ -0,0 +1,230 @@
+#include "ProceduralScene.h"
+#include "../Framework/Random.h"
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	const float PI = 3.14159265f;
+	// side length of the particles and width of the hair strands for size = 1
+	const float PARTICLE_SIZE = 0.1f;
+	const float HAIR_WIDTH = 0.01f;
+	// maximum horizontal offset of the hair tips
+	const float HAIR_BEND = 0.5f;
+	// tessellation for subdivisions = 1
+	const int HAIR_SEGMENTS = 8;
+	const int SHELL_RINGS = 16;
+	const int SHELL_SEGMENTS = 32;
+	const int MAX_SUBDIVISIONS = 64;
+
+	// appends triangles to a single obj shape
+	class Builder
+	{
+	public:
+		explicit Builder(ObjCache::Data& data)
+			:
+		m_data(data)
+		{
+			m_data.shapes.emplace_back();
+			m_data.shapes.back().name = "procedural";
+		}
+
+		int addVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texcoord)
+		{
+			auto& attrib = m_data.attrib;
+			attrib.vertices.insert(attrib.vertices.end(), { position.x, position.y, position.z });
+			attrib.normals.insert(attrib.normals.end(), { normal.x, normal.y, normal.z });
+			attrib.texcoords.insert(attrib.texcoords.end(), { texcoord.x, texcoord.y });
+			return int(attrib.vertices.size() / 3 - 1);
+		}
+
+		// counter clockwise front face
+		void addTriangle(int v0, int v1, int v2, int material)
+		{
+			auto& mesh = m_data.shapes.back().mesh;
+			for (auto v : { v0, v1, v2 })
+			{
+				tinyobj::index_t index;
+				index.vertex_index = index.normal_index = index.texcoord_index = v;
+				mesh.indices.push_back(index);
+			}
+			mesh.num_face_vertices.push_back(3);
+			mesh.material_ids.push_back(material);
+		}
+
+		// (n + 1)^2 vertices between origin and origin + u + v. The front faces point along cross(u, v)
+		void addGrid(const glm::vec3& origin, const glm::vec3& u, const glm::vec3& v, int n, int material)
+		{
+			const auto normal = glm::normalize(glm::cross(u, v));
+			const auto first = int(m_data.attrib.vertices.size() / 3);
+			for (int y = 0; y <= n; ++y)
+				for (int x = 0; x <= n; ++x)
+				{
+					const glm::vec2 uv(float(x) / float(n), float(y) / float(n));
+					addVertex(origin + u * uv.x + v * uv.y, normal, uv);
+				}
+
+			const auto vertex = [first, n](int x, int y)
+			{
+				return first + y * (n + 1) + x;
+			};
+			for (int y = 0; y < n; ++y)
+				for (int x = 0; x < n; ++x)
+				{
+					addTriangle(vertex(x, y), vertex(x + 1, y), vertex(x + 1, y + 1), material);
+					addTriangle(vertex(x, y), vertex(x + 1, y + 1), vertex(x, y + 1), material);
+				}
+		}
+	private:
+		ObjCache::Data& m_data;
+	};
+
+	void addLayers(Builder& builder, Random& random, const ProceduralScene::Params& p)
+	{
+		const auto s = p.size;
+		for (int i = 0; i < p.count; ++i)
+		{
+			const auto z = -1.0f + 2.0f * (float(i) + 0.5f) / float(p.count);
+			builder.addGrid(glm::vec3(-s, -s, z), glm::vec3(2.0f * s, 0.0f, 0.0f), glm::vec3(0.0f, 2.0f * s, 0.0f),
+				p.subdivisions, random.nextInt(ProceduralScene::NUM_MATERIALS));
+		}
+	}
+
+	void addParticles(Builder& builder, Random& random, const ProceduralScene::Params& p)
+	{
+		const auto side = PARTICLE_SIZE * p.size;
+		for (int i = 0; i < p.count; ++i)
+		{
+			const auto x = random.next(-1.0f, 1.0f);
+			const auto y = random.next(-1.0f, 1.0f);
+			const auto z = random.next(-1.0f, 1.0f);
+			builder.addGrid(glm::vec3(x, y, z) - glm::vec3(side, side, 0.0f) * 0.5f, glm::vec3(side, 0.0f, 0.0f), glm::vec3(0.0f, side, 0.0f),
+				p.subdivisions, random.nextInt(ProceduralScene::NUM_MATERIALS));
+		}
+	}
+
+	void addHair(Builder& builder, Random& random, const ProceduralScene::Params& p)
+	{
+		const auto halfWidth = 0.5f * HAIR_WIDTH * p.size;
+		const auto segments = HAIR_SEGMENTS * p.subdivisions;
+		for (int i = 0; i < p.count; ++i)
+		{
+			const glm::vec3 root(random.next(-1.0f, 1.0f), -1.0f, random.next(-1.0f, 1.0f));
+			const glm::vec3 bend(random.next(-HAIR_BEND, HAIR_BEND), 0.0f, random.next(-HAIR_BEND, HAIR_BEND));
+			const auto material = random.nextInt(ProceduralScene::NUM_MATERIALS);
+
+			// ribbon that faces +z and bends quadratically towards the tip
+			int left = 0, right = 0;
+			for (int k = 0; k <= segments; ++k)
+			{
+				const auto t = float(k) / float(segments);
+				const auto center = root + glm::vec3(0.0f, 2.0f * t, 0.0f) + bend * t * t;
+				const auto l = builder.addVertex(center - glm::vec3(halfWidth, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, t));
+				const auto r = builder.addVertex(center + glm::vec3(halfWidth, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, t));
+				if (k)
+				{
+					builder.addTriangle(left, right, r, material);
+					builder.addTriangle(left, r, l, material);
+				}
+				left = l;
+				right = r;
+			}
+		}
+	}
+
+	void addShells(Builder& builder, Random& random, const ProceduralScene::Params& p)
+	{
+		const auto rings = SHELL_RINGS * p.subdivisions;
+		const auto segments = SHELL_SEGMENTS * p.subdivisions;
+		for (int i = 0; i < p.count; ++i)
+		{
+			const auto radius = p.size * float(i + 1) / float(p.count);
+			const auto material = random.nextInt(ProceduralScene::NUM_MATERIALS);
+
+			// uv sphere. The pole vertices are duplicated per segment
+			int first = 0;
+			for (int r = 0; r <= rings; ++r)
+			{
+				const auto theta = PI * float(r) / float(rings);
+				for (int s = 0; s <= segments; ++s)
+				{
+					const auto phi = 2.0f * PI * float(s) / float(segments);
+					const glm::vec3 normal(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+					const auto v = builder.addVertex(normal * radius, normal, glm::vec2(float(s) / float(segments), float(r) / float(rings)));
+					if (r == 0 && s == 0)
+						first = v;
+				}
+			}
+
+			const auto vertex = [first, segments](int r, int s)
+			{
+				return first + r * (segments + 1) + s;
+			};
+			for (int r = 0; r < rings; ++r)
+				for (int s = 0; s < segments; ++s)
+				{
+					// the triangles at the poles would be degenerate
+					if (r != rings - 1)
+						builder.addTriangle(vertex(r, s), vertex(r + 1, s + 1), vertex(r + 1, s), material);
+					if (r != 0)
+						builder.addTriangle(vertex(r, s), vertex(r, s + 1), vertex(r + 1, s + 1), material);
+				}
+		}
+	}
+}
+
+ProceduralScene::Type ProceduralScene::parseType(const std::string& name)
+{
+	if (name == "layers") return Type::LAYERS;
+	if (name == "particles") return Type::PARTICLES;
+	if (name == "hair") return Type::HAIR;
+	if (name == "shells") return Type::SHELLS;
+	throw std::runtime_error("unknown scene type " + name + " (expected layers, particles, hair or shells)");
+}
+
+ObjCache::Data ProceduralScene::generate(const Params& params)
+{
+	if (params.count < 1)
+		throw std::runtime_error("ProceduralScene::generate count must be positive");
+	if (params.subdivisions < 1 || params.subdivisions > MAX_SUBDIVISIONS)
+		throw std::runtime_error("ProceduralScene::generate subdivisions must be in [1, " + std::to_string(MAX_SUBDIVISIONS) + "]");
+	if (params.size <= 0.0f)
+		throw std::runtime_error("ProceduralScene::generate size must be positive");
+
+	ObjCache::Data data;
+	Random random(params.seed);
+
+	// the materials consume the first random numbers, therefore they only depend on the seed
+	for (int i = 0; i < NUM_MATERIALS; ++i)
+	{
+		auto m = tinyobj::material_t();
+		m.name = "procedural" + std::to_string(i);
+		for (auto& c : m.diffuse)
+			c = random.next(0.2f, 1.0f);
+		m.shininess = 1.0f;
+		m.ior = 1.0f;
+		m.dissolve = glm::clamp(params.alpha + params.alphaSpread * random.next(-1.0f, 1.0f), 0.0f, 1.0f);
+		data.materials.push_back(m);
+	}
+
+	Builder builder(data);
+	switch (params.type)
+	{
+	case Type::LAYERS: addLayers(builder, random, params); break;
+	case Type::PARTICLES: addParticles(builder, random, params); break;
+	case Type::HAIR: addHair(builder, random, params); break;
+	case Type::SHELLS: addShells(builder, random, params); break;
+	}
+
+	data.bboxMin = glm::vec3(std::numeric_limits<float>::max());
+	data.bboxMax = glm::vec3(-std::numeric_limits<float>::max());
+	const auto& v = data.attrib.vertices;
+	for (size_t i = 0; i + 2 < v.size(); i += 3)
+	{
+		data.bboxMin = glm::min(data.bboxMin, glm::vec3(v[i], v[i + 1], v[i + 2]));
+		data.bboxMax = glm::max(data.bboxMax, glm::vec3(v[i], v[i + 1], v[i + 2]));
+	}
+	return data;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include "ObjCache.h"
+
+/**
+ * \brief generator of transparent stress scenes with independent control over depth complexity, triangle size and screen coverage.
+ * The scenes fill about the box [-1, 1]^3 and are returned as obj data, so that they are loaded like obj files (see ObjModel).
+ * The random numbers only use the mt19937 sequence (no standard distributions), therefore a seed produces the same scene with every compiler.
+ */
+class ProceduralScene
+{
+	ProceduralScene() = default;
+public:
+	enum class Type
+	{
+		// quads parallel to the xy plane that are stacked along z (the depth complexity is the number of layers)
+		LAYERS,
+		// randomly placed quads that face +z
+		PARTICLES,
+		// thin curved strips that grow from the bottom to the top of the box
+		HAIR,
+		// nested spheres around the origin
+		SHELLS
+	};
+
+	struct Params
+	{
+		Type type = Type::LAYERS;
+		// number of layers, particles, strands or shells
+		int count = 8;
+		// the dissolve of the materials is uniformly distributed in [alpha - alphaSpread, alpha + alphaSpread].
+		// Materials with a dissolve of one are opaque
+		float alpha = 0.5f;
+		float alphaSpread = 0.0f;
+		// scale of the primitives (layer and shell radius, particle size, hair width)
+		float size = 1.0f;
+		// each primitive is split into more triangles (smaller triangles with the same coverage)
+		int subdivisions = 1;
+		uint32_t seed = 0;
+	};
+
+	// layers, particles, hair or shells
+	static Type parseType(const std::string& name);
+
+	/**
+	 * \brief creates the triangles and NUM_MATERIALS materials. Every primitive has a random material
+	 */
+	static ObjCache::Data generate(const Params& params);
+
+	static const int NUM_MATERIALS = 8;
+};
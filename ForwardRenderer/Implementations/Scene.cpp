@@ -0,0 +1,232 @@
+#include "Scene.h"
+#include <stdexcept>
+#include <string>
+#include <cassert>
+
+// entry of the flattened draw list
+class Scene::Shape : public IShape
+{
+public:
+	Shape(const Scene& scene, size_t object, IShape& shape)
+		:
+	m_scene(scene),
+	m_object(object),
+	m_shape(shape)
+	{}
+
+	void draw(IShader* shader) override
+	{
+		if (m_scene.bindObject(m_object))
+			m_shape.draw(shader);
+	}
+
+	bool isTransparent() const override
+	{
+		return m_shape.isTransparent();
+	}
+
+	bool isCutout() const override
+	{
+		return m_shape.isCutout();
+	}
+
+	const glm::vec3& getBoundingMin() const override
+	{
+		return m_shape.getBoundingMin();
+	}
+	const glm::vec3& getBoundingMax() const override
+	{
+		return m_shape.getBoundingMax();
+	}
+private:
+	const Scene& m_scene;
+	const size_t m_object;
+	IShape& m_shape;
+};
+
+size_t Scene::addObject(std::unique_ptr<IModel> model, const glm::mat4& transform)
+{
+	if (!model)
+		throw std::runtime_error("Scene::addObject model is null");
+
+	m_objects.push_back({ std::move(model), transform, 0 });
+	updateInstances(m_objects.back());
+	updateObjects();
+	return m_objects.size() - 1;
+}
+
+void Scene::removeObject(size_t index)
+{
+	if (index >= m_objects.size())
+		throw std::runtime_error("invalid object index " + std::to_string(index));
+
+	m_objects.erase(m_objects.begin() + index);
+	updateObjects();
+}
+
+void Scene::clear()
+{
+	m_objects.clear();
+	updateObjects();
+}
+
+void Scene::setTransform(size_t index, const glm::mat4& transform)
+{
+	if (index >= m_objects.size())
+		throw std::runtime_error("invalid object index " + std::to_string(index));
+
+	m_objects[index].transform = transform;
+	updateInstances(m_objects[index]);
+	updateObjects();
+}
+
+const IModel& Scene::getObject(size_t index) const
+{
+	if (index >= m_objects.size())
+		throw std::runtime_error("invalid object index " + std::to_string(index));
+	return *m_objects[index].model;
+}
+
+void Scene::prepareDrawing(IShader& shader) const
+{
+	m_shader = &shader;
+	m_boundObject = m_objects.size();
+}
+
+const IMaterials& Scene::getMaterial() const
+{
+	return getObject(0).getMaterial();
+}
+
+size_t Scene::cull(const Frustum& frustum) const
+{
+	size_t numVisible = 0;
+	m_triangleStatistics = TriangleStatistics();
+	for (size_t i = 0; i < m_objects.size(); ++i)
+	{
+		const auto& model = *m_objects[i].model;
+		m_isVisible[i] = frustum.isVisible(model.getBoundingMin(), model.getBoundingMax());
+		if (!m_isVisible[i]) continue;
+
+		numVisible += model.cull(frustum);
+		m_triangleStatistics.drawn += model.getTriangleStatistics().drawn;
+		m_triangleStatistics.saved += model.getTriangleStatistics().saved;
+	}
+	return numVisible;
+}
+
+const Bvh& Scene::getBvh() const
+{
+	if (m_objects.size() == 1 && m_instances.size() == 1 && m_objects[0].transform * m_instances[0] == glm::mat4(1.0f))
+		return m_objects[0].model->getBvh();
+
+	if (m_bvhChanged)
+	{
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		std::vector<uint32_t> triangleShapes;
+		for (const auto& o : m_objects)
+		{
+			const auto& bvh = o.model->getBvh();
+			// every instance gets its own copy of the triangles (same transformation order as updateInstances)
+			for (const auto& instance : m_instances)
+			{
+				const auto transform = o.transform * instance;
+				const auto firstVertex = uint32_t(positions.size());
+				for (const auto& p : bvh.getPositions())
+					positions.emplace_back(transform * glm::vec4(p, 1.0f));
+
+				for (const auto& t : bvh.getTriangles())
+				{
+					for (auto v : t.vertex)
+						indices.push_back(firstVertex + v);
+					triangleShapes.push_back(uint32_t(o.firstShape) + t.shape);
+				}
+			}
+		}
+		m_bvh = positions.empty() ? Bvh() : Bvh(std::move(positions), indices, triangleShapes);
+		m_bvhChanged = false;
+	}
+	return m_bvh;
+}
+
+void Scene::getGeometry(Geometry& geometry) const
+{
+	// the object transformations are part of the instances
+	for (const auto& o : m_objects)
+		o.model->getGeometry(geometry);
+}
+
+void Scene::setInstances(const std::vector<glm::mat4>& transforms)
+{
+	if (transforms.empty())
+		throw std::runtime_error("Scene::setInstances requires at least one transformation");
+
+	m_instances = transforms;
+	for (auto& o : m_objects)
+		updateInstances(o);
+	updateObjects();
+	m_bvhChanged = true;
+}
+
+void Scene::resetCulling() const
+{
+	m_triangleStatistics = TriangleStatistics();
+	for (size_t i = 0; i < m_objects.size(); ++i)
+	{
+		m_isVisible[i] = 1;
+		m_objects[i].model->resetCulling();
+		m_triangleStatistics.drawn += m_objects[i].model->getTriangleStatistics().drawn;
+	}
+}
+
+bool Scene::bindObject(size_t index) const
+{
+	if (!m_isVisible[index])
+		return false;
+
+	if (m_boundObject != index)
+	{
+		assert(m_shader);
+		m_objects[index].model->prepareDrawing(*m_shader);
+		m_boundObject = index;
+	}
+	return true;
+}
+
+void Scene::updateInstances(Object& object) const
+{
+	std::vector<glm::mat4> transforms;
+	transforms.reserve(m_instances.size());
+	for (const auto& i : m_instances)
+		transforms.push_back(object.transform * i);
+	object.model->setInstances(transforms);
+}
+
+void Scene::updateObjects()
+{
+	m_drawList.clear();
+	for (size_t i = 0; i < m_objects.size(); ++i)
+	{
+		auto& o = m_objects[i];
+		o.firstShape = m_drawList.size();
+		for (const auto& s : o.model->getShapes())
+			m_drawList.push_back(std::make_unique<Shape>(*this, i, *s));
+	}
+	m_isVisible.assign(m_objects.size(), 1);
+	m_boundObject = m_objects.size();
+	m_bvhChanged = true;
+	++m_geometryVersion;
+
+	m_bboxMin = m_bboxMax = glm::vec3(0.0f);
+	if (m_objects.empty())
+		return;
+
+	m_bboxMin = m_objects[0].model->getBoundingMin();
+	m_bboxMax = m_objects[0].model->getBoundingMax();
+	for (const auto& o : m_objects)
+	{
+		m_bboxMin = glm::min(m_bboxMin, o.model->getBoundingMin());
+		m_bboxMax = glm::max(m_bboxMax, o.model->getBoundingMax());
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "../Graphics/IModel.h"
+#include <memory>
+#include <vector>
+
+/**
+ * \brief collection of models with their own transformations that is drawn like a single model.
+ * The object transformations are applied with the instance transformations of the models, therefore the
+ * model matrix of the shaders stays the identity. The shapes of all objects form one flattened draw list
+ * that is ordered by object, so that the vertex buffers of every object are bound at most once per pass.
+ */
+class Scene : public IModel
+{
+public:
+	Scene() = default;
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	/**
+	 * \brief appends the model to the scene
+	 * \return object index
+	 */
+	size_t addObject(std::unique_ptr<IModel> model, const glm::mat4& transform = glm::mat4(1.0f));
+	// the indices of the following objects are decremented
+	void removeObject(size_t index);
+	void clear();
+	void setTransform(size_t index, const glm::mat4& transform);
+
+	const IModel& getObject(size_t index) const;
+	size_t getNumObjects() const
+	{
+		return m_objects.size();
+	}
+	bool empty() const
+	{
+		return m_objects.empty();
+	}
+
+	// resets the bound object. The objects are bound by the first visible shape of the draw list
+	void prepareDrawing(IShader& shader) const override;
+	const std::vector<std::unique_ptr<IShape>>& getShapes() const override
+	{
+		return m_drawList;
+	}
+	// materials of the first object
+	const IMaterials& getMaterial() const override;
+
+	// objects outside of the frustum are skipped entirely, the other objects cull their own shapes
+	size_t cull(const Frustum& frustum) const override;
+	void resetCulling() const override;
+	// sum over the visible objects
+	TriangleStatistics getTriangleStatistics() const override
+	{
+		return m_triangleStatistics;
+	}
+
+	/**
+	 * \brief bvh of the first object (if it is the only untransformed instance) or a bvh over the triangles of all objects
+	 * and instances (object transformation * instance transformation) that is built on the first request.
+	 * The shape indices of the hits refer to the draw list
+	 */
+	const Bvh& getBvh() const override;
+	// the objects are appended in the order of the draw list
+	void getGeometry(Geometry& geometry) const override;
+	size_t getGeometryVersion() const override
+	{
+		return m_geometryVersion;
+	}
+
+	// the instances are the same for every object (object transformation * instance transformation)
+	void setInstances(const std::vector<glm::mat4>& transforms) override;
+	size_t getNumInstances() const override
+	{
+		return m_instances.size();
+	}
+
+	const glm::vec3& getBoundingMin() const override
+	{
+		return m_bboxMin;
+	}
+	const glm::vec3& getBoundingMax() const override
+	{
+		return m_bboxMax;
+	}
+private:
+	class Shape;
+
+	struct Object
+	{
+		std::unique_ptr<IModel> model;
+		glm::mat4 transform;
+		// first shape of the object in the draw list
+		size_t firstShape;
+	};
+
+	// returns false if the object was culled. Binds the vertex format of the object if another object was bound
+	bool bindObject(size_t index) const;
+	// applies the object transformation to the instances of the model
+	void updateInstances(Object& object) const;
+	// rebuilds the draw list and the bounding box after the objects changed
+	void updateObjects();
+
+	std::vector<Object> m_objects;
+	std::vector<glm::mat4> m_instances = { glm::mat4(1.0f) };
+	std::vector<std::unique_ptr<IShape>> m_drawList;
+
+	// culling result of each object
+	mutable std::vector<uint8_t> m_isVisible;
+	mutable TriangleStatistics m_triangleStatistics;
+	mutable IShader* m_shader = nullptr;
+	// number of objects if no object is bound
+	mutable size_t m_boundObject = 0;
+
+	mutable Bvh m_bvh;
+	mutable bool m_bvhChanged = true;
+	// incremented by updateObjects (objects, transformations or instances changed)
+	size_t m_geometryVersion = 0;
+
+	glm::vec3 m_bboxMin = glm::vec3(0.0f);
+	glm::vec3 m_bboxMax = glm::vec3(0.0f);
+};
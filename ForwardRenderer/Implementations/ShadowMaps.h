@@ -7,6 +7,7 @@
 #include "../Graphics/HotReloadShader.h"
 #include "SimpleShader.h"
 #include "EnvmapCamera.h"
+#include "../Framework/Profiler.h"
 
 class ShadowMaps : public IShadows
 {
@@ -29,6 +30,16 @@ public:
 
 		m_dirShader = std::make_unique<SimpleShader>(HotReloadShader::loadProgram({ vertDir, fragDir }));
 		m_pointShader = std::make_unique<SimpleShader>(HotReloadShader::loadProgram({ vertPoint, fragPoint }));
+
+		// alpha tested variants for cutout shapes
+		auto vertDirCutout = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/ShadowMap.vs", 430, "#define ALPHA_TEST");
+		auto fragDirCutout = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/ShadowMap.fs", 430, "#define ALPHA_TEST");
+
+		auto vertPointCutout = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/ShadowMapPoint.vs", 430, "#define ALPHA_TEST");
+		auto fragPointCutout = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/ShadowMapPoint.fs", 430, "#define ALPHA_TEST");
+
+		m_dirCutoutShader = std::make_unique<SimpleShader>(HotReloadShader::loadProgram({ vertDirCutout, fragDirCutout }));
+		m_pointCutoutShader = std::make_unique<SimpleShader>(HotReloadShader::loadProgram({ vertPointCutout, fragPointCutout }));
 	}
 
 	void update(
@@ -36,6 +47,8 @@ public:
 		const std::vector<DirectionalLight>& dirLights,
 		const IModel& model, ITransforms& transforms) override
 	{
+		m_numVisibleShapes = 0;
+		m_triangles = IModel::TriangleStatistics();
 		m_numPointLights = int(pointLights.size());
 		if(pointLights.size())
 		{
@@ -67,8 +80,14 @@ public:
 			m_textures = gl::Texture2DArray(gl::InternalFormat::DEPTH_COMPONENT32F, 16, 16, 1, 1);
 		}
 
-		// restore framebuffer
+		// restore framebuffer and the visibility for the following passes
 		gl::Framebuffer::unbind();
+		model.resetCulling();
+
+		// sum over all shadow map faces
+		Profiler::set("visible_shadow", double(m_numVisibleShapes));
+		Profiler::set("triangles_shadow", double(m_triangles.drawn));
+		Profiler::set("lod_saved_shadow", double(m_triangles.saved));
 	}
 
 	void bind() const override
@@ -101,7 +120,7 @@ public:
 		m_framebuffer.validate();
 		
 		transforms.bind();
-		render(model, m_dirResolution, m_dirShader.get());
+		m_numVisibleShapes += render(model, Frustum(light.camera.getProjection()), m_dirResolution, m_dirShader.get(), m_dirCutoutShader.get());
 	}
 
 	void renderPointLight(const PointLight& light, int index, ITransforms& transforms, const IModel& model)
@@ -109,9 +128,12 @@ public:
 		auto cam = EnvmapCamera(light.position);
 
 		transforms.setModelTransform(glm::mat4(1.0));
-		m_pointShader->bind();
-		// light position
-		glUniform3f(0, light.position.x, light.position.y, light.position.z);
+		for (const auto shader : { m_pointShader.get(), m_pointCutoutShader.get() })
+		{
+			shader->bind();
+			// light position
+			glUniform3f(0, light.position.x, light.position.y, light.position.z);
+		}
 
 		for(int face = 0; face < 6; ++face)
 		{
@@ -124,12 +146,17 @@ public:
 			transforms.upload();
 			transforms.bind();
 			
-			render(model, m_pointResolution, m_pointShader.get());
+			m_numVisibleShapes += render(model, Frustum(cam.getProjection()), m_pointResolution, m_pointShader.get(), m_pointCutoutShader.get());
 		}
 	}
 
-	static void render(const IModel& model, int resolution, IShader* shader)
+	// returns the number of visible shapes
+	size_t render(const IModel& model, const Frustum& frustum, int resolution, IShader* shader, IShader* cutoutShader)
 	{
+		const auto numVisible = model.cull(frustum);
+		const auto triangles = model.getTriangleStatistics();
+		m_triangles.drawn += triangles.drawn;
+		m_triangles.saved += triangles.saved;
 		glViewport(0, 0, resolution, resolution);
 		glEnable(GL_DEPTH_TEST);
 		glClear(GL_DEPTH_BUFFER_BIT);
@@ -137,9 +164,17 @@ public:
 		model.prepareDrawing(*shader);
 		for (const auto& shape : model.getShapes())
 		{
-			if (!shape->isTransparent())
+			if (!shape->isTransparent() && !shape->isCutout())
 				shape->draw(shader);
 		}
+
+		// cutout shapes discard their transparent texels
+		for (const auto& shape : model.getShapes())
+		{
+			if (shape->isCutout())
+				shape->draw(cutoutShader);
+		}
+		return numVisible;
 	}
 
 private:
@@ -148,6 +183,8 @@ private:
 	gl::Framebuffer m_framebuffer;
 
 	int m_numPointLights = 0;
+	size_t m_numVisibleShapes = 0;
+	IModel::TriangleStatistics m_triangles;
 	int m_numDirLights = 0;
 	gl::TextureCubeMapArray m_cubeMaps;
 	gl::Texture2DArray m_textures;
@@ -160,4 +197,6 @@ private:
 
 	std::unique_ptr<IShader> m_dirShader;
 	std::unique_ptr<IShader> m_pointShader;
+	std::unique_ptr<IShader> m_dirCutoutShader;
+	std::unique_ptr<IShader> m_pointCutoutShader;
 };
@@ -43,6 +43,11 @@ public:
 		m_hasChanges = true;
 	}
 
+	void invalidate() override
+	{
+		m_hasChanges = true;
+	}
+
 	std::string displayLights() override
 	{
 		int index = 0;
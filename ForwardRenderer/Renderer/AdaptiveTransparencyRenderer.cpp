@@ -70,10 +70,11 @@ void AdaptiveTransparencyRenderer::init()
 
 		// build the shaders
 		auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-		auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+		auto geometry = loadGeometryShader();
 		auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs");
 		m_defaultShader = std::make_unique<SimpleShader>(
 			HotReloadShader::loadProgram({ vertex, geometry, fragment }));
+		m_cutoutShader = loadCutoutShader(vertex, geometry);
 
 		auto buildVisz = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/AdaptiveBuildVisibility.fs", 450,
 			shaderParams
@@ -205,6 +206,7 @@ void AdaptiveTransparencyRenderer::render(const RenderArgs& args)
 		return;
 	
 	args.bindLightData();
+	args.cullToCamera();
 
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_OPAQUE]);
@@ -220,11 +222,13 @@ void AdaptiveTransparencyRenderer::render(const RenderArgs& args)
 		args.model->prepareDrawing(*m_defaultShader);
 		for (const auto& s : args.model->getShapes())
 		{
-			if (!s->isTransparent())
+			if (!s->isTransparent() && !s->isCutout())
 				s->draw(m_defaultShader.get());
 		}
 	}
 
+	drawCutoutShapes(args, *m_cutoutShader, m_timer[T_CUTOUT]);
+
 	auto bindFunctionReadWrite = [this]()
 	{
 		if (s_useTextureBuffer)
@@ -20,6 +20,7 @@ public:
 	void onSizeChange(int width, int height) override;
 private:
 	std::unique_ptr<IShader> m_defaultShader;
+	std::unique_ptr<IShader> m_cutoutShader;
 	std::unique_ptr<IShader> m_shaderBuildVisz;
 	std::unique_ptr<IShader> m_shaderApplyVisz;
 	gl::Texture3D m_visibilityTex;
@@ -35,6 +36,7 @@ private:
 	{
 		T_CLEAR,
 		T_OPAQUE,
+		T_CUTOUT,
 		T_BUILD_VIS,
 		T_DARKEN_BG,
 		T_USE_VIS,
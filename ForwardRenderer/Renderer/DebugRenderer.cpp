@@ -17,7 +17,7 @@ static Type s_type = Type::Normal;
 DebugRenderer::DebugRenderer()
 {
 	auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-	auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+	auto geometry = loadGeometryShader();
 	auto normal = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/NormalColor.fs", 430, "#define DEBUG_NORMAL");
 	auto texcoord = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/NormalColor.fs");
 	auto mesh = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/NormalColor.fs", 430, "#define DEBUG_MESH");
@@ -54,6 +54,8 @@ void DebugRenderer::render(const RenderArgs& args)
 	if(!args.camera || !args.transforms || !args.model)
 		return;
 
+	args.cullToCamera();
+
 	// clear color
 	if (s_type == Type::Mesh || s_type == Type::SolidMesh || s_type == Type::Depth)
 	{
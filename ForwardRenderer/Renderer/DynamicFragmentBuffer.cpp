@@ -13,11 +13,12 @@ DynamicFragmentBufferRenderer::DynamicFragmentBufferRenderer()
 {
 	// build the shaders
 	auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-	auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+	auto geometry = loadGeometryShader();
 	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs");
 
 	m_defaultShader = std::make_unique<SimpleShader>(
 		HotReloadShader::loadProgram({vertex, geometry, fragment}));
+	m_cutoutShader = loadCutoutShader(vertex, geometry);
 
 	auto countFragments = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DynamicCountFragment.fs");
 	auto storeFragments = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DynamicStoreFragment.fs");
@@ -67,6 +68,7 @@ void DynamicFragmentBufferRenderer::render(const RenderArgs& args)
 		return;
 
 	args.bindLightData();
+	args.cullToCamera();
 
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_OPAQUE]);
@@ -79,11 +81,13 @@ void DynamicFragmentBufferRenderer::render(const RenderArgs& args)
 		args.model->prepareDrawing(*m_defaultShader);
 		for (const auto& s : args.model->getShapes())
 		{
-			if (!s->isTransparent())
+			if (!s->isTransparent() && !s->isCutout())
 				s->draw(m_defaultShader.get());
 		}
 	}
 
+	drawCutoutShapes(args, *m_cutoutShader, m_timer[T_CUTOUT]);
+
 	// reset visibility function data
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_CLEAR]);
@@ -21,6 +21,7 @@ private:
 
 private:
 	std::unique_ptr<IShader> m_defaultShader;
+	std::unique_ptr<IShader> m_cutoutShader;
 	std::unique_ptr<IShader> m_shaderCountFragments;
 	std::unique_ptr<IShader> m_shaderStoreFragments;
 	std::unique_ptr<IShader> m_shaderSortFragments;
@@ -43,6 +44,7 @@ private:
 	{
 		T_CLEAR,
 		T_OPAQUE,
+		T_CUTOUT,
 		T_COUNT_FRAGMENTS,
 		T_SCAN,
 		T_RESIZE,
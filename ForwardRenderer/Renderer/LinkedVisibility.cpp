@@ -11,11 +11,12 @@ LinkedVisibility::LinkedVisibility()
 {
 	// build the shaders
 	auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-	auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+	auto geometry = loadGeometryShader();
 	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs");
 	
 	m_defaultShader = std::make_unique<SimpleShader>(
 		HotReloadShader::loadProgram({vertex, geometry, fragment}));
+	m_cutoutShader = loadCutoutShader(vertex, geometry);
 
 	auto buildVisz = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/LinkedBuildVisibility.fs");
 	auto useVisz = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/LinkedUseVisibility.fs");
@@ -39,6 +40,7 @@ void LinkedVisibility::render(const RenderArgs& args)
 		return;
 	
 	args.bindLightData();
+	args.cullToCamera();
 
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_CLEAR]);
@@ -56,11 +58,13 @@ void LinkedVisibility::render(const RenderArgs& args)
 		args.model->prepareDrawing(*m_defaultShader);
 		for (const auto& s : args.model->getShapes())
 		{
-			if (!s->isTransparent())
+			if (!s->isTransparent() && !s->isCutout())
 				s->draw(m_defaultShader.get());
 		}
 	}
 
+	drawCutoutShapes(args, *m_cutoutShader, m_timer[T_CUTOUT]);
+
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_BUILD_VIS]);
 		// disable colors
@@ -17,6 +17,7 @@ public:
 
 private:
 	std::unique_ptr<IShader> m_defaultShader;
+	std::unique_ptr<IShader> m_cutoutShader;
 	std::unique_ptr<IShader> m_shaderBuildVisz;
 	std::unique_ptr<IShader> m_shaderApplyVisz;
 	std::unique_ptr<FullscreenQuadShader> m_shaderAdjustBackground;
@@ -27,6 +28,7 @@ private:
 	{
 		T_CLEAR,
 		T_OPAQUE,
+		T_CUTOUT,
 		T_BUILD_VIS,
 		T_USE_VIS,
 		SIZE
@@ -25,10 +25,11 @@ void MultiLayerAlphaRenderer::init()
 	{
 		// build the shaders
 		auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-		auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+		auto geometry = loadGeometryShader();
 		auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs");
 		m_opaqueShader = std::make_unique<SimpleShader>(
 			HotReloadShader::loadProgram({ vertex, geometry, fragment }));
+		m_cutoutShader = loadCutoutShader(vertex, geometry);
 
 		std::string additionalShaderParams;
 		if (!s_useTextureBuffer)
@@ -87,6 +88,7 @@ void MultiLayerAlphaRenderer::render(const RenderArgs& args)
 		return;
 
 	args.bindLightData();
+	args.cullToCamera();
 
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_OPAQUE]);
@@ -100,10 +102,12 @@ void MultiLayerAlphaRenderer::render(const RenderArgs& args)
 		args.model->prepareDrawing(*m_opaqueShader);
 		for (const auto& s : args.model->getShapes())
 		{
-			if (!s->isTransparent())
+			if (!s->isTransparent() && !s->isCutout())
 				s->draw(m_opaqueShader.get());
 		}
 	}
+
+	drawCutoutShapes(args, *m_cutoutShader, m_timer[T_CUTOUT]);
 	
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_CLEAR]);
@@ -19,6 +19,7 @@ public:
 
 private:
 	std::unique_ptr<IShader> m_opaqueShader;
+	std::unique_ptr<IShader> m_cutoutShader;
 	std::unique_ptr<IShader> m_transparentShader;
 	std::unique_ptr<FullscreenQuadShader> m_resolveShader;
 
@@ -30,6 +31,7 @@ private:
 	{
 		T_CLEAR,
 		T_OPAQUE,
+		T_CUTOUT,
 		T_TRANSPARENT,
 		T_RESOLVE,
 		SIZE
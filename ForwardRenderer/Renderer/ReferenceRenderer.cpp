@@ -0,0 +1,651 @@
+#include "ReferenceRenderer.h"
+#include "../Framework/Profiler.h"
+#include "../Framework/ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <glm/gtc/type_precision.hpp>
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	double getMilliseconds(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// number of input triangles that are clipped by one task
+	const size_t SETUP_GRAIN = 4096;
+
+	// triangle classes in drawing order (opaque, cutout and transparent pass)
+	enum Pass : uint8_t
+	{
+		P_OPAQUE,
+		P_CUTOUT,
+		P_TRANSPARENT
+	};
+
+	// Shader/uniforms/material.glsl with the textures
+	struct Material
+	{
+		glm::vec3 ambient;
+		glm::vec3 diffuse;
+		glm::vec4 specular;
+		float dissolve;
+		int illum;
+		const ReferenceRenderer::Texture* ambientTex;
+		const ReferenceRenderer::Texture* dissolveTex;
+		const ReferenceRenderer::Texture* diffuseTex;
+		const ReferenceRenderer::Texture* specularTex;
+		Pass pass;
+	};
+
+	// Shader/uniforms/lights.glsl without the shadow map data
+	struct Light
+	{
+		// point light (w = 1) or direction (w = 0)
+		glm::vec4 position;
+		glm::vec3 color;
+		// x = linear, y = quadratic
+		glm::vec2 attenuation;
+	};
+
+	struct ClipVertex
+	{
+		glm::vec4 position;
+		// barycentric coordinates in the input triangle
+		glm::vec3 barycentric;
+	};
+
+	// triangle in window coordinates (counter clockwise)
+	struct ScreenTriangle
+	{
+		glm::vec2 position[3];
+		// depth range [0, 1]
+		float depth[3];
+		// 1 / clip w
+		float invW[3];
+		// barycentric coordinates in the input triangle divided by clip w (perspective correct interpolation)
+		glm::vec3 barycentric[3];
+		float area;
+		// covered pixel range (inclusive)
+		glm::ivec2 min;
+		glm::ivec2 max;
+		uint32_t source;
+		Pass pass;
+	};
+
+	struct Fragment
+	{
+		// pixel index inside the tile
+		uint32_t pixel;
+		float depth;
+		glm::vec4 color;
+	};
+
+	// position and attributes of a fragment (the inputs of light.glsl)
+	struct Surface
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 texcoord;
+	};
+
+	float edgeFunction(const glm::vec2& a, const glm::vec2& b, const glm::vec2& p)
+	{
+		return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+	}
+
+	// top left fill rule for counter clockwise triangles (pixels on shared edges are covered exactly once)
+	bool isInside(float e, const glm::vec2& a, const glm::vec2& b)
+	{
+		if (e != 0.0f) return e > 0.0f;
+		const auto edge = b - a;
+		return edge.y < 0.0f || (edge.y == 0.0f && edge.x < 0.0f);
+	}
+
+	// clips the polygon against the plane dot(plane, position) >= 0
+	size_t clipPolygon(const ClipVertex* in, size_t count, const glm::vec4& plane, ClipVertex* out)
+	{
+		size_t res = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			const auto& a = in[i];
+			const auto& b = in[(i + 1) % count];
+			const auto da = glm::dot(plane, a.position);
+			const auto db = glm::dot(plane, b.position);
+			if (da >= 0.0f)
+				out[res++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				const auto t = da / (da - db);
+				out[res++] = { glm::mix(a.position, b.position, t), glm::mix(a.barycentric, b.barycentric, t) };
+			}
+		}
+		return res;
+	}
+
+	/**
+	 * \brief clips the triangle against the near and far plane and appends the visible parts in window coordinates
+	 */
+	void setupTriangle(const glm::vec4 clip[3], uint32_t source, Pass pass, int width, int height, std::vector<ScreenTriangle>& out)
+	{
+		// trivial rejection if all vertices are outside of one frustum plane
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w) return;
+			if (clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w) return;
+		}
+
+		// a triangle gains at most one vertex per plane
+		std::array<ClipVertex, 5> polygon = { {
+			{ clip[0], glm::vec3(1.0f, 0.0f, 0.0f) },
+			{ clip[1], glm::vec3(0.0f, 1.0f, 0.0f) },
+			{ clip[2], glm::vec3(0.0f, 0.0f, 1.0f) } } };
+		std::array<ClipVertex, 5> temp;
+		auto count = clipPolygon(polygon.data(), 3, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), temp.data());
+		count = clipPolygon(temp.data(), count, glm::vec4(0.0f, 0.0f, -1.0f, 1.0f), polygon.data());
+
+		const auto viewport = glm::vec2(float(width), float(height));
+		for (size_t i = 1; i + 1 < count; ++i)
+		{
+			ScreenTriangle t;
+			const ClipVertex* v[3] = { &polygon[0], &polygon[i], &polygon[i + 1] };
+			for (int k = 0; k < 3; ++k)
+			{
+				const auto invW = 1.0f / v[k]->position.w;
+				const auto ndc = glm::vec3(v[k]->position) * invW;
+				t.position[k] = (glm::vec2(ndc) * 0.5f + 0.5f) * viewport;
+				t.depth[k] = ndc.z * 0.5f + 0.5f;
+				t.invW[k] = invW;
+				t.barycentric[k] = v[k]->barycentric * invW;
+			}
+
+			t.area = edgeFunction(t.position[0], t.position[1], t.position[2]);
+			if (t.area == 0.0f || !std::isfinite(t.area))
+				continue;
+			// back faces are not culled
+			if (t.area < 0.0f)
+			{
+				std::swap(t.position[1], t.position[2]);
+				std::swap(t.depth[1], t.depth[2]);
+				std::swap(t.invW[1], t.invW[2]);
+				std::swap(t.barycentric[1], t.barycentric[2]);
+				t.area = -t.area;
+			}
+
+			// pixel centers inside the bounding box
+			const auto bboxMin = glm::min(glm::min(t.position[0], t.position[1]), t.position[2]);
+			const auto bboxMax = glm::max(glm::max(t.position[0], t.position[1]), t.position[2]);
+			t.min = glm::max(glm::ivec2(glm::ceil(bboxMin - 0.5f)), glm::ivec2(0));
+			t.max = glm::min(glm::ivec2(glm::floor(bboxMax - 0.5f)), glm::ivec2(width - 1, height - 1));
+			if (t.min.x > t.max.x || t.min.y > t.max.y)
+				continue;
+
+			t.source = source;
+			t.pass = pass;
+			out.push_back(t);
+		}
+	}
+
+	float calcMaterialAlpha(const Material& m, const glm::vec2& texcoord)
+	{
+		return m.dissolve * m.dissolveTex->sample(texcoord).r * m.diffuseTex->sample(texcoord).a;
+	}
+
+	glm::vec3 toGamma(const glm::vec3& color)
+	{
+		return glm::pow(color, glm::vec3(1.0f / 2.2f));
+	}
+
+	glm::vec3 fromGamma(const glm::vec3& color)
+	{
+		return glm::pow(color, glm::vec3(2.2f));
+	}
+
+	// distance of the shadow ray origin from the surface (the normal offset of the directional shadows in light.glsl)
+	const float SHADOW_OFFSET = 0.05f;
+
+	// ray traced replacement of the shadow maps. Opaque and cutout shapes cast shadows like in ShadowMaps::update
+	struct ShadowRays
+	{
+		// model space bvh of the shadow casters
+		const Bvh* bvh;
+		// geometry triangle of each bvh triangle
+		const std::vector<uint32_t>* triangles;
+		// model space vertices of the geometry
+		const std::vector<IModel::Geometry::Vertex>* vertices;
+		const std::vector<Material>* materials;
+		glm::mat4 invModel;
+
+		// true if an opaque surface or a cutout texel with alpha >= 0.5 lies on the ray in [0, tMax] (world space)
+		bool isOccluded(const glm::vec3& origin, const glm::vec3& direction, float tMax) const
+		{
+			Ray ray;
+			ray.origin = glm::vec3(invModel * glm::vec4(origin, 1.0f));
+			ray.direction = glm::vec3(invModel * glm::vec4(direction, 0.0f));
+			ray.tMax = tMax;
+			thread_local std::vector<Bvh::Hit> hits;
+			bvh->intersectAll(ray, hits);
+			for (const auto& h : hits)
+			{
+				const auto& m = (*materials)[h.shape];
+				if (m.pass != P_CUTOUT)
+					return true;
+				const auto* v = &(*vertices)[3 * size_t((*triangles)[h.triangle])];
+				const auto texcoord = (1.0f - h.barycentric.x - h.barycentric.y) * v[0].texcoord +
+					h.barycentric.x * v[1].texcoord + h.barycentric.y * v[2].texcoord;
+				if (calcMaterialAlpha(m, texcoord) >= 0.5f)
+					return true;
+			}
+			return false;
+		}
+	};
+
+	// calcMaterialColor() of Shader/light/light.glsl with ray traced shadows and without environment reflections
+	glm::vec3 calcMaterialColor(const Material& m, const Surface& s, const glm::vec3& cameraPosition, const std::vector<Light>& lights, const ShadowRays& shadows)
+	{
+		const auto ambientCol = fromGamma(m.ambient * glm::vec3(m.ambientTex->sample(s.texcoord)));
+		const auto diffuseCol = fromGamma(m.diffuse * glm::vec3(m.diffuseTex->sample(s.texcoord)));
+		const auto specularCol = fromGamma(glm::vec3(m.specular) * glm::vec3(m.specularTex->sample(s.texcoord)));
+
+		auto normal = s.normal;
+		// face the camera
+		if (glm::dot(normal, cameraPosition - s.position) < 0.0f)
+			normal = -normal;
+
+		const auto viewDir = glm::normalize(s.position - cameraPosition);
+
+		glm::vec3 color(0.0f);
+		if (!lights.empty())
+		{
+			for (const auto& l : lights)
+			{
+				float shadow = 0.0f;
+				glm::vec3 direction;
+				auto lightColor = l.color;
+				float cosTheta;
+				if (l.position.w == 1.0f)
+				{
+					const auto dist = glm::distance(s.position, glm::vec3(l.position));
+					direction = (s.position - glm::vec3(l.position)) / dist;
+					lightColor *= 1.0f / (1.0f + l.attenuation.x * dist + l.attenuation.y * dist * dist);
+					cosTheta = glm::dot(-direction, normal);
+				}
+				else
+				{
+					direction = glm::normalize(glm::vec3(l.position));
+					cosTheta = glm::dot(-direction, normal) * 0.5f + 0.5f;
+				}
+
+				// the ray starts on the side of the surface that faces the light
+				const auto origin = s.position + (glm::dot(normal, direction) > 0.0f ? -normal : normal) * SHADOW_OFFSET;
+				if (l.position.w == 1.0f)
+				{
+					if (shadows.isOccluded(origin, glm::vec3(l.position) - origin, 1.0f))
+						shadow = 1.0f;
+				}
+				// light.glsl halves the directional shadows
+				else if (shadows.isOccluded(origin, -direction, std::numeric_limits<float>::max()))
+					shadow = 0.5f;
+
+				if (m.illum != 3)
+					color += glm::max(glm::vec3(0.0f), diffuseCol * lightColor * cosTheta * (1.0f - shadow));
+
+				const auto hDotN = glm::dot(glm::normalize(-viewDir - direction), normal);
+				if (m.illum != 0 && m.illum != 1)
+					color += glm::max(glm::vec3(0.0f), specularCol * lightColor * std::pow(std::max(0.0f, hDotN), m.specular.w) * (1.0f - shadow));
+			}
+		}
+		else
+		{
+			// light at the camera
+			const auto cosTheta = glm::dot(-viewDir, normal);
+			const auto hDotN = glm::dot(glm::normalize(-viewDir - viewDir), normal);
+			color = glm::max(glm::vec3(0.0f), ambientCol) +
+				glm::max(glm::vec3(0.0f), diffuseCol * cosTheta) +
+				glm::max(glm::vec3(0.0f), specularCol * std::pow(std::max(0.0f, hDotN), m.specular.w)) +
+				diffuseCol * 0.01f;
+		}
+
+		return glm::clamp(toGamma(color), glm::vec3(0.0f), glm::vec3(1.0f));
+	}
+}
+
+glm::vec4 ReferenceRenderer::Texture::sample(const glm::vec2& texcoord) const
+{
+	const auto x = texcoord.x * float(width) - 0.5f;
+	const auto y = texcoord.y * float(height) - 0.5f;
+	const auto x0 = std::floor(x);
+	const auto y0 = std::floor(y);
+	if (!std::isfinite(x0) || !std::isfinite(y0))
+		return texels[0];
+
+	const auto texel = [this](float fx, float fy)
+	{
+		// repeat
+		auto ix = int(std::fmod(fx, float(width)));
+		auto iy = int(std::fmod(fy, float(height)));
+		if (ix < 0) ix += width;
+		if (iy < 0) iy += height;
+		return texels[size_t(iy) * size_t(width) + size_t(ix)];
+	};
+	const auto fx = x - x0;
+	const auto fy = y - y0;
+	return glm::mix(
+		glm::mix(texel(x0, y0), texel(x0 + 1.0f, y0), fx),
+		glm::mix(texel(x0, y0 + 1.0f), texel(x0 + 1.0f, y0 + 1.0f), fx), fy);
+}
+
+ReferenceRenderer::ReferenceRenderer()
+{
+	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/ReferenceImage.fs");
+	m_quadShader = std::make_unique<FullscreenQuadShader>(fragment);
+
+	ReferenceRenderer::onSizeChange(Window::getWidth(), Window::getHeight());
+}
+
+void ReferenceRenderer::onSizeChange(int width, int height)
+{
+	m_width = std::max(width, 1);
+	m_height = std::max(height, 1);
+	m_image = gl::Texture2D(gl::InternalFormat::RGBA32F, m_width, m_height);
+	m_pixels.assign(size_t(m_width) * size_t(m_height), glm::vec4(0.0f));
+}
+
+void ReferenceRenderer::updateShadowBvh(const std::vector<std::unique_ptr<IShape>>& shapes)
+{
+	std::vector<glm::vec3> positions;
+	positions.reserve(m_geometry.vertices.size());
+	for (const auto& v : m_geometry.vertices)
+		positions.push_back(v.position);
+
+	std::vector<uint32_t> indices;
+	std::vector<uint32_t> triangleShapes;
+	m_shadowTriangles.clear();
+	for (size_t t = 0; t < m_geometry.triangleShapes.size(); ++t)
+	{
+		const auto shape = m_geometry.triangleShapes[t];
+		if (shapes[shape]->isTransparent())
+			continue;
+		for (uint32_t k = 0; k < 3; ++k)
+			indices.push_back(uint32_t(3 * t) + k);
+		triangleShapes.push_back(shape);
+		m_shadowTriangles.push_back(uint32_t(t));
+	}
+	m_shadowBvh = indices.empty() ? Bvh() : Bvh(std::move(positions), indices, triangleShapes);
+}
+
+const ReferenceRenderer::Texture& ReferenceRenderer::getTexture(const ParamSet& material, const std::string& name)
+{
+	const auto tex = material.getTexture(name);
+	if (!tex)
+		return m_white;
+
+	auto it = m_textures.find(tex.get());
+	if (it != m_textures.end())
+		return it->second.second;
+
+	Texture res;
+	res.width = tex->width();
+	res.height = tex->height();
+	const auto rgba = tex->getData<glm::u8vec4>(0, gl::SetDataFormat::RGBA, gl::SetDataType::UINT8);
+	res.texels.resize(rgba.size());
+	std::transform(rgba.begin(), rgba.end(), res.texels.begin(), [](const glm::u8vec4& t)
+	{
+		return glm::vec4(t) / 255.0f;
+	});
+	return m_textures.emplace(tex.get(), std::make_pair(tex, std::move(res))).first->second.second;
+}
+
+void ReferenceRenderer::render(const RenderArgs& args)
+{
+	if (args.hasNull())
+		return;
+
+	const auto time_start = Clock::now();
+	const auto width = m_width;
+	const auto height = m_height;
+
+	// read back the triangles of all instances (only after the scene changed)
+	const auto geometryChanged = m_geometryModel != args.model || m_geometryVersion != args.model->getGeometryVersion();
+	if (geometryChanged)
+	{
+		m_geometry = IModel::Geometry();
+		args.model->getGeometry(m_geometry);
+		m_geometryModel = args.model;
+		m_geometryVersion = args.model->getGeometryVersion();
+	}
+	const auto& geometry = m_geometry;
+	const auto& shapes = args.model->getShapes();
+	if (geometry.shapeMaterials.size() != shapes.size())
+		throw std::runtime_error("ReferenceRenderer: the geometry does not match the shapes of the model");
+	if (geometryChanged)
+		updateShadowBvh(shapes);
+
+	// textures that are not used by any material anymore
+	for (auto it = m_textures.begin(); it != m_textures.end();)
+		if (it->second.first.use_count() == 1) it = m_textures.erase(it);
+		else ++it;
+
+	std::vector<Material> materials;
+	materials.reserve(shapes.size());
+	for (size_t i = 0; i < shapes.size(); ++i)
+	{
+		const auto& p = *geometry.shapeMaterials[i];
+		Material m;
+		m.ambient = p.get("ambient", glm::vec3(0.0f));
+		m.diffuse = p.get("diffuse", glm::vec3(0.5f));
+		m.specular = p.get("specular", glm::vec4(0.0f));
+		m.dissolve = p.get("dissolve", 1.0f);
+		m.illum = int(p.get("illum", 1.0f));
+		m.ambientTex = &getTexture(p, "ambient");
+		m.dissolveTex = &getTexture(p, "dissolve");
+		m.diffuseTex = &getTexture(p, "diffuse");
+		m.specularTex = &getTexture(p, "specular");
+		m.pass = shapes[i]->isTransparent() ? P_TRANSPARENT : shapes[i]->isCutout() ? P_CUTOUT : P_OPAQUE;
+		materials.push_back(m);
+	}
+
+	// same light data as SimpleLights
+	std::vector<Light> lights;
+	for (size_t i = 0; i < std::min(args.lights->numLights(), size_t(64)); ++i)
+	{
+		const auto& p = args.lights->getLight(i);
+		Light l;
+		if (p.get<glm::vec4>("position"))
+			l.position = glm::vec4(glm::vec3(*p.get<glm::vec4>("position")), 1.0f);
+		else if (p.get<glm::vec4>("direction"))
+			l.position = glm::vec4(glm::vec3(*p.get<glm::vec4>("direction")), 0.0f);
+		else throw std::runtime_error("direction or position is required for light");
+		l.color = glm::vec3(p.get("color", glm::vec4(1.0f)));
+		l.attenuation.x = p.get("linearAttenuation", 0.0f);
+		l.attenuation.y = p.get("quadraticAttenuation", 0.0075f);
+		lights.push_back(l);
+	}
+
+	const auto model = args.transforms->getModelTransform();
+	const ShadowRays shadows = { &m_shadowBvh, &m_shadowTriangles, &geometry.vertices, &materials, glm::inverse(model) };
+	const auto viewProjection = args.camera->getProjection();
+	const auto cameraPosition = args.camera->getPosition();
+	const auto numTriangles = geometry.triangleShapes.size();
+
+	// world space (DefaultShader.vs) and clipping. The cached geometry stays in model space
+	auto& vertices = m_worldVertices;
+	vertices.resize(geometry.vertices.size());
+	const auto numChunks = (numTriangles + SETUP_GRAIN - 1) / SETUP_GRAIN;
+	std::vector<std::vector<ScreenTriangle>> chunks(numChunks);
+	ThreadPool::get().parallelFor(0, numChunks, [&](size_t chunk)
+	{
+		const auto end = std::min((chunk + 1) * SETUP_GRAIN, numTriangles);
+		for (auto t = chunk * SETUP_GRAIN; t < end; ++t)
+		{
+			glm::vec4 clip[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				const auto& src = geometry.vertices[3 * t + k];
+				auto& v = vertices[3 * t + k];
+				v.position = glm::vec3(model * glm::vec4(src.position, 1.0f));
+				v.normal = glm::vec3(model * glm::vec4(src.normal, 0.0f));
+				v.texcoord = src.texcoord;
+				clip[k] = viewProjection * glm::vec4(v.position, 1.0f);
+			}
+			setupTriangle(clip, uint32_t(t), materials[geometry.triangleShapes[t]].pass, width, height, chunks[chunk]);
+		}
+	});
+
+	// the bins keep the submission order of the triangles
+	const auto tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const auto tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	std::vector<ScreenTriangle> triangles;
+	for (auto& c : chunks)
+	{
+		triangles.insert(triangles.end(), c.begin(), c.end());
+		std::vector<ScreenTriangle>().swap(c);
+	}
+	std::vector<std::vector<uint32_t>> bins(size_t(tilesX) * size_t(tilesY));
+	for (size_t i = 0; i < triangles.size(); ++i)
+	{
+		const auto& t = triangles[i];
+		for (auto y = t.min.y / TILE_SIZE; y <= t.max.y / TILE_SIZE; ++y)
+			for (auto x = t.min.x / TILE_SIZE; x <= t.max.x / TILE_SIZE; ++x)
+				bins[size_t(y) * size_t(tilesX) + size_t(x)].push_back(uint32_t(i));
+	}
+	const auto setupTime = getMilliseconds(time_start);
+
+	const auto time_raster_start = Clock::now();
+	std::vector<size_t> tileFragments(bins.size(), 0);
+	ThreadPool::get().parallelFor(0, bins.size(), [&](size_t tile)
+	{
+		const glm::ivec2 tileMin(int(tile % size_t(tilesX)) * TILE_SIZE, int(tile / size_t(tilesX)) * TILE_SIZE);
+		const auto tileMax = glm::min(tileMin + TILE_SIZE, glm::ivec2(width, height)) - 1;
+		const auto tileWidth = tileMax.x - tileMin.x + 1;
+
+		// interpolates the attributes of the input triangle at the pixel center
+		const auto interpolate = [&](const ScreenTriangle& t, const glm::vec3& lambda)
+		{
+			const auto invW = lambda.x * t.invW[0] + lambda.y * t.invW[1] + lambda.z * t.invW[2];
+			const auto b = (lambda.x * t.barycentric[0] + lambda.y * t.barycentric[1] + lambda.z * t.barycentric[2]) / invW;
+			const auto* v = &vertices[3 * size_t(t.source)];
+			Surface s;
+			s.position = b.x * v[0].position + b.y * v[1].position + b.z * v[2].position;
+			s.normal = b.x * v[0].normal + b.y * v[1].normal + b.z * v[2].normal;
+			s.texcoord = b.x * v[0].texcoord + b.y * v[1].texcoord + b.z * v[2].texcoord;
+			// models without normals use flat normals (DefaultShader.gs)
+			if (glm::dot(s.normal, s.normal) == 0.0f)
+				s.normal = glm::cross(v[1].position - v[0].position, v[2].position - v[0].position);
+			if (glm::dot(s.normal, s.normal) > 0.0f)
+				s.normal = glm::normalize(s.normal);
+			return s;
+		};
+
+		// calls func(pixel, depth, lambda) for the covered pixels of the tile
+		const auto rasterize = [&](const ScreenTriangle& t, auto func)
+		{
+			const auto min = glm::max(t.min, tileMin);
+			const auto max = glm::min(t.max, tileMax);
+			for (auto y = min.y; y <= max.y; ++y)
+				for (auto x = min.x; x <= max.x; ++x)
+				{
+					const glm::vec2 p(float(x) + 0.5f, float(y) + 0.5f);
+					const auto e0 = edgeFunction(t.position[1], t.position[2], p);
+					const auto e1 = edgeFunction(t.position[2], t.position[0], p);
+					const auto e2 = edgeFunction(t.position[0], t.position[1], p);
+					if (!isInside(e0, t.position[1], t.position[2]) || !isInside(e1, t.position[2], t.position[0]) || !isInside(e2, t.position[0], t.position[1]))
+						continue;
+
+					const auto lambda = glm::vec3(e0, e1, e2) / t.area;
+					const auto depth = lambda.x * t.depth[0] + lambda.y * t.depth[1] + lambda.z * t.depth[2];
+					func(uint32_t((y - tileMin.y) * tileWidth + (x - tileMin.x)), depth, lambda);
+				}
+		};
+
+		const auto numPixels = size_t(tileWidth) * size_t(tileMax.y - tileMin.y + 1);
+		std::vector<float> depthBuffer(numPixels, 1.0f);
+		// nearest opaque triangle and its screen barycentrics (shaded after the depth test)
+		std::vector<uint32_t> opaqueTriangle(numPixels, uint32_t(-1));
+		std::vector<glm::vec3> opaqueLambda(numPixels);
+		std::vector<Fragment> fragments;
+		const auto& bin = bins[tile];
+
+		// opaque and cutout pass with depth test (GL_LESS)
+		for (const auto pass : { P_OPAQUE, P_CUTOUT })
+			for (const auto i : bin)
+			{
+				const auto& t = triangles[i];
+				if (t.pass != pass) continue;
+				const auto& m = materials[geometry.triangleShapes[t.source]];
+				rasterize(t, [&](uint32_t pixel, float depth, const glm::vec3& lambda)
+				{
+					if (!(depth < depthBuffer[pixel]) || depth < 0.0f)
+						return;
+					if (pass == P_CUTOUT && calcMaterialAlpha(m, interpolate(t, lambda).texcoord) < 0.5f)
+						return;
+					depthBuffer[pixel] = depth;
+					opaqueTriangle[pixel] = i;
+					opaqueLambda[pixel] = lambda;
+				});
+			}
+
+		// transparent pass without depth writes. All fragments are kept
+		for (const auto i : bin)
+		{
+			const auto& t = triangles[i];
+			if (t.pass != P_TRANSPARENT) continue;
+			const auto& m = materials[geometry.triangleShapes[t.source]];
+			rasterize(t, [&](uint32_t pixel, float depth, const glm::vec3& lambda)
+			{
+				if (!(depth < depthBuffer[pixel]) || depth < 0.0f)
+					return;
+				const auto s = interpolate(t, lambda);
+				fragments.push_back({ pixel, depth, glm::vec4(calcMaterialColor(m, s, cameraPosition, lights, shadows), calcMaterialAlpha(m, s.texcoord)) });
+			});
+		}
+
+		// back to front per pixel. Fragments with the same depth stay in submission order like the blending of the forward renderer
+		std::stable_sort(fragments.begin(), fragments.end(), [](const Fragment& a, const Fragment& b)
+		{
+			if (a.pixel != b.pixel) return a.pixel < b.pixel;
+			return a.depth > b.depth;
+		});
+
+		auto fragment = fragments.begin();
+		for (uint32_t pixel = 0; pixel < uint32_t(numPixels); ++pixel)
+		{
+			glm::vec3 color(s_clearColor);
+			if (opaqueTriangle[pixel] != uint32_t(-1))
+			{
+				const auto& t = triangles[opaqueTriangle[pixel]];
+				color = calcMaterialColor(materials[geometry.triangleShapes[t.source]], interpolate(t, opaqueLambda[pixel]), cameraPosition, lights, shadows);
+			}
+			for (; fragment != fragments.end() && fragment->pixel == pixel; ++fragment)
+			{
+				const auto alpha = glm::clamp(fragment->color.a, 0.0f, 1.0f);
+				color = glm::vec3(fragment->color) * alpha + color * (1.0f - alpha);
+			}
+
+			const auto x = tileMin.x + int(pixel % uint32_t(tileWidth));
+			const auto y = tileMin.y + int(pixel / uint32_t(tileWidth));
+			m_pixels[size_t(y) * size_t(width) + size_t(x)] = glm::vec4(color, 1.0f);
+		}
+		tileFragments[tile] = fragments.size();
+	});
+	const auto rasterTime = getMilliseconds(time_raster_start);
+
+	m_image.update(gl::SetDataFormat::RGBA, gl::SetDataType::FLOAT, m_pixels.data());
+	m_image.bind(0);
+	glDisable(GL_DEPTH_TEST);
+	m_quadShader->draw();
+	glEnable(GL_DEPTH_TEST);
+
+	Profiler::set("time", getMilliseconds(time_start));
+	Profiler::set("setup", setupTime);
+	Profiler::set("raster", rasterTime);
+	Profiler::set("triangles_reference", double(triangles.size()));
+	Profiler::set("transparent_fragments", double(std::accumulate(tileFragments.begin(), tileFragments.end(), size_t(0))));
+}
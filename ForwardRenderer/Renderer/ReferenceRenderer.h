@@ -0,0 +1,63 @@
+#pragma once
+#include "../Graphics/IRenderer.h"
+#include "../Framework/IWindowReceiver.h"
+#include "../Implementations/FullscreenQuadShader.h"
+#include "../Dependencies/gl/texture.hpp"
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \brief cpu rasterizer for ground truth images. Every fragment of a pixel is kept, the transparent fragments
+ * are sorted by depth and blended back to front without any approximation.
+ * The triangles are binned into screen tiles that are rasterized and shaded in parallel on the thread pool.
+ * Shading follows Shader/light/light.glsl without environment reflections. Instead of the shadow maps, a shadow ray
+ * is traced through a bvh of the opaque and cutout triangles for every light and shaded fragment.
+ */
+class ReferenceRenderer : public IRenderer, public IWindowReceiver
+{
+public:
+	ReferenceRenderer();
+	void render(const RenderArgs& args) override;
+
+	void onSizeChange(int width, int height) override;
+
+	// edge length of the screen tiles in pixels
+	static const int TILE_SIZE = 32;
+
+	// base level of a material texture in host memory
+	struct Texture
+	{
+		int width = 1;
+		int height = 1;
+		std::vector<glm::vec4> texels = { glm::vec4(1.0f) };
+
+		// bilinear filtering with repeat addressing (the material sampler without mip maps)
+		glm::vec4 sample(const glm::vec2& texcoord) const;
+	};
+private:
+	// builds m_shadowBvh over the opaque and cutout triangles of m_geometry (model space)
+	void updateShadowBvh(const std::vector<std::unique_ptr<IShape>>& shapes);
+	// reads the texture back from the gpu on the first use. Missing textures are white
+	const Texture& getTexture(const ParamSet& material, const std::string& name);
+
+	std::unique_ptr<FullscreenQuadShader> m_quadShader;
+	// final image (bottom row first)
+	std::vector<glm::vec4> m_pixels;
+	gl::Texture2D m_image;
+	int m_width = 0;
+	int m_height = 0;
+
+	// triangles of the last rendered model, read back again if the model or its version changed
+	IModel::Geometry m_geometry;
+	const IModel* m_geometryModel = nullptr;
+	size_t m_geometryVersion = 0;
+	// vertices of m_geometry with the model transformation of the current frame
+	std::vector<IModel::Geometry::Vertex> m_worldVertices;
+	Bvh m_shadowBvh;
+	// geometry triangle of each triangle of m_shadowBvh
+	std::vector<uint32_t> m_shadowTriangles;
+
+	const Texture m_white;
+	// the shared pointer keeps the texture address unique while it is cached
+	std::unordered_map<const CachedTexture2D*, std::pair<std::shared_ptr<CachedTexture2D>, Texture>> m_textures;
+};
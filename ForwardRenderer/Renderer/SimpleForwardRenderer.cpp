@@ -10,11 +10,12 @@
 SimpleForwardRenderer::SimpleForwardRenderer()
 {
 	auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-	auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+	auto geometry = loadGeometryShader();
 	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs");
 
 	m_defaultShader = std::make_unique<SimpleShader>(
 		HotReloadShader::loadProgram({vertex, geometry, fragment}));
+	m_cutoutShader = loadCutoutShader(vertex, geometry);
 }
 
 
@@ -28,6 +29,7 @@ void SimpleForwardRenderer::render(const RenderArgs& args)
 		return;
 
 	args.bindLightData();
+	args.cullToCamera();
 
 	auto hasAlpha = false;
 	{
@@ -38,11 +40,14 @@ void SimpleForwardRenderer::render(const RenderArgs& args)
 
 		args.model->prepareDrawing(*m_defaultShader);
 		for (const auto& s : args.model->getShapes())
-			if (!s->isTransparent())
+			if (s->isTransparent())
+				hasAlpha = true;
+			else if (!s->isCutout())
 				s->draw(m_defaultShader.get());
-			else hasAlpha = true;
 	}
 
+	drawCutoutShapes(args, *m_cutoutShader, m_timer[T_CUTOUT]);
+
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_TRANSPARENT]);
 		if (hasAlpha)
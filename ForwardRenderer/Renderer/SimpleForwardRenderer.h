@@ -14,10 +14,12 @@ public:
 
 private:
 	std::unique_ptr<IShader> m_defaultShader;
+	std::unique_ptr<IShader> m_cutoutShader;
 
 	enum Timer
 	{
 		T_OPAQUE,
+		T_CUTOUT,
 		T_TRANSPARENT,
 		SIZE
 	};
@@ -10,11 +10,12 @@ WeightedTransparency::WeightedTransparency()
 	m_quadShader = std::make_unique<FullscreenQuadShader>(combineShader);
 
 	auto vertex = HotReloadShader::loadShader(gl::Shader::Type::VERTEX, "Shader/DefaultShader.vs");
-	auto geometry = HotReloadShader::loadShader(gl::Shader::Type::GEOMETRY, "Shader/DefaultShader.gs");
+	auto geometry = loadGeometryShader();
 	auto fragment = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/DefaultShader.fs");
 	
 	m_defaultShader = std::make_unique<SimpleShader>(
 		HotReloadShader::loadProgram({vertex, geometry, fragment}));
+	m_cutoutShader = loadCutoutShader(vertex, geometry);
 
 	auto transShader = HotReloadShader::loadShader(gl::Shader::Type::FRAGMENT, "Shader/WeightedTransparent.fs");
 
@@ -30,6 +31,7 @@ void WeightedTransparency::render(const RenderArgs& args)
 		return;
 
 	args.bindLightData();
+	args.cullToCamera();
 
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_OPAQUE]);
@@ -42,11 +44,13 @@ void WeightedTransparency::render(const RenderArgs& args)
 		args.model->prepareDrawing(*m_defaultShader);
 		for (const auto& s : args.model->getShapes())
 		{
-			if (!s->isTransparent())
+			if (!s->isTransparent() && !s->isCutout())
 				s->draw(m_defaultShader.get());
 		}
 	}
 
+	drawCutoutShapes(args, *m_cutoutShader, m_timer[T_CUTOUT]);
+
 	{
 		std::lock_guard<GpuTimer> g(m_timer[T_BUILD_VIS]);
 
@@ -24,12 +24,14 @@ private:
 	gl::Framebuffer m_opaqueFramebuffer = gl::Framebuffer::empty();
 
 	std::unique_ptr<IShader> m_defaultShader;
+	std::unique_ptr<IShader> m_cutoutShader;
 	std::unique_ptr<FullscreenQuadShader> m_quadShader;
 	std::unique_ptr<IShader> m_transShader;
 
 	enum Timer
 	{
 		T_OPAQUE,
+		T_CUTOUT,
 		T_BUILD_VIS,
 		T_USE_VIS,
 		SIZE
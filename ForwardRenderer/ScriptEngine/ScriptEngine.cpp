@@ -13,7 +13,10 @@ static std::unordered_map<std::string, ScriptEngine::FunctionT> s_functions;
 static std::unordered_map<std::string, std::pair<ScriptEngine::GetterT, ScriptEngine::SetterT>> s_properties;
 static size_t s_curIteration = 0;
 static size_t s_waitIterations = 0;
+static std::function<bool()> s_waitCondition;
 static std::queue<std::pair<std::string, std::string>> s_commandQueue;
+// failed commands of the queue
+static size_t s_numErrors = 0;
 static std::unordered_map<std::string, Token> s_variables;
 static std::unordered_set<std::string> s_keywords;
 
@@ -267,7 +270,7 @@ static void s_executeCommand(const std::string& command, const std::string* cons
 		&& tokens[0].getType() != Token::Type::VARIABLE)
 		throw std::runtime_error("expected identifier or variable");
 
-	if (s_waitIterations)
+	if (s_waitIterations || s_waitCondition)
 	{
 		// just enqueue command
 		s_commandQueue.push(std::make_pair(prefix ? (*prefix) : ("script "), command));
@@ -362,8 +365,11 @@ void ScriptEngine::executeCommand(const std::string& prefix, const std::string&
 
 void ScriptEngine::iteration()
 {
+	if (s_waitCondition && s_waitCondition())
+		s_waitCondition = nullptr;
+
 	// execute enqueued commands
-	while (!s_commandQueue.empty() && !s_waitIterations)
+	while (!s_commandQueue.empty() && !s_waitIterations && !s_waitCondition)
 	{
 		try
 		{
@@ -375,6 +381,7 @@ void ScriptEngine::iteration()
 		catch (const std::exception& e)
 		{
 			std::cerr << "ERR script: " << e.what() << '\n';
+			++s_numErrors;
 		}
 	}
 	
@@ -395,6 +402,27 @@ size_t ScriptEngine::getWaitIteration()
 	return s_waitIterations;
 }
 
+bool ScriptEngine::isIdle()
+{
+	return s_commandQueue.empty() && !s_waitIterations && !s_waitCondition;
+}
+
+size_t ScriptEngine::getNumErrors()
+{
+	return s_numErrors;
+}
+
+void ScriptEngine::reportError(const std::string& source, const std::string& message)
+{
+	std::cerr << "ERR " << source << ": " << message << '\n';
+	++s_numErrors;
+}
+
+void ScriptEngine::waitUntil(std::function<bool()> condition)
+{
+	s_waitCondition = std::move(condition);
+}
+
 static void openScriptFile(const std::string& filename)
 {
 	std::ifstream file;
@@ -42,4 +42,12 @@ public:
 
 	static size_t getIteration();
 	static size_t getWaitIteration();
+	// enqueues the following commands until the condition is true (checked once per iteration)
+	static void waitUntil(std::function<bool()> condition);
+	// true if all commands were executed and nothing is waiting
+	static bool isIdle();
+	// number of enqueued commands that threw an exception
+	static size_t getNumErrors();
+	// prints and counts an error of a command that failed asynchronously (after it returned)
+	static void reportError(const std::string& source, const std::string& message);
 };
@@ -8,5 +8,11 @@ layout(location = 0) out vec4 out_fragColor;
 
 void main()
 {
+#ifdef ALPHA_TEST
+	// cutout materials are alpha tested instead of blended
+	if (calcMaterialAlpha() < 0.5) discard;
+	out_fragColor = vec4(calcMaterialColor(), 1.0);
+#else
 	out_fragColor = vec4(calcMaterialColor(), calcMaterialAlpha());
+#endif
 }
\ No newline at end of file
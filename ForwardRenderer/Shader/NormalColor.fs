@@ -4,10 +4,16 @@ layout(location = 2) in vec2 in_texcoord;
 
 layout(location = 0) out vec4 out_fragColor;
 
+#include "uniforms/transform.glsl"
+
 void main()
 {
 #ifdef DEBUG_NORMAL
-	out_fragColor = vec4((in_normal + vec3(1.0)) / vec3(2.0), 1.0);
+	// face the camera
+	vec3 normal = normalize(in_normal);
+	if(dot(normal, u_cameraPosition - in_position) < 0.0)
+		normal = -normal;
+	out_fragColor = vec4((normal + vec3(1.0)) / vec3(2.0), 1.0);
 #else
 #ifdef DEBUG_MESH
 	out_fragColor = vec4(0.0);
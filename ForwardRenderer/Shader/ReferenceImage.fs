@@ -0,0 +1,8 @@
+layout(binding = 0) uniform sampler2D tex_image;
+
+out vec4 out_color;
+
+void main()
+{
+	out_color = texelFetch(tex_image, ivec2(gl_FragCoord.xy), 0);
+}
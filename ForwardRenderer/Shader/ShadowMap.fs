@@ -1,4 +1,13 @@
+#ifdef ALPHA_TEST
+layout(location = 0) in vec2 in_texcoord;
+
+#define LIGHT_ONLY_TRANSPARENT
+#include "light/light.glsl"
+#endif
+
 void main()
 {
-	
+#ifdef ALPHA_TEST
+	if (calcMaterialAlpha() < 0.5) discard;
+#endif
 }
\ No newline at end of file
@@ -1,14 +1,17 @@
-layout(location = 0) in int in_positionIndex;
+layout(location = 0) in vec4 in_position;
 
 #include "uniforms/transform.glsl"
+#include "uniforms/vertex.glsl"
 
-// texture 0 - 3 occupied by fragment shader
-
-layout(binding = 4) uniform samplerBuffer buf_positions;
+#ifdef ALPHA_TEST
+layout(location = 2) in vec2 in_texcoord;
+layout(location = 0) out vec2 out_texcoord;
+#endif
 
 void main()
 {
-	vec3 position = vec3(texelFetch(buf_positions, in_positionIndex));
-
-	gl_Position = u_viewProjection * u_model * vec4(position, 1.0);
+#ifdef ALPHA_TEST
+	out_texcoord = in_texcoord;
+#endif
+	gl_Position = u_viewProjection * getModelMatrix() * vec4(decodePosition(in_position), 1.0);
 }
\ No newline at end of file
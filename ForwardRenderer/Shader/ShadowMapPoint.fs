@@ -4,8 +4,18 @@ layout(location = 0) in vec4 in_fragPos;
 
 layout(location = 0) uniform vec3 lightPos;
 
+#ifdef ALPHA_TEST
+layout(location = 1) in vec2 in_texcoord;
+
+#define LIGHT_ONLY_TRANSPARENT
+#include "light/light.glsl"
+#endif
+
 void main()
 {
+#ifdef ALPHA_TEST
+	if (calcMaterialAlpha() < 0.5) discard;
+#endif
 	float lightDistance = length(in_fragPos.xyz - lightPos);
 	
 	// map to [0, 1]
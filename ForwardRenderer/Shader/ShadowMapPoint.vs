@@ -1,17 +1,20 @@
-layout(location = 0) in int in_positionIndex;
+layout(location = 0) in vec4 in_position;
 
 #include "uniforms/transform.glsl"
-
-// texture 0 - 3 occupied by fragment shader
-
-layout(binding = 4) uniform samplerBuffer buf_positions;
+#include "uniforms/vertex.glsl"
 
 layout(location = 0) out vec4 out_fragPos;
 
+#ifdef ALPHA_TEST
+layout(location = 2) in vec2 in_texcoord;
+layout(location = 1) out vec2 out_texcoord;
+#endif
+
 void main()
 {
-	vec3 position = vec3(texelFetch(buf_positions, in_positionIndex));
-
-	out_fragPos = u_model * vec4(position, 1.0);
-	gl_Position = u_viewProjection * u_model * vec4(position, 1.0);
+#ifdef ALPHA_TEST
+	out_texcoord = in_texcoord;
+#endif
+	out_fragPos = getModelMatrix() * vec4(decodePosition(in_position), 1.0);
+	gl_Position = u_viewProjection * out_fragPos;
 }
\ No newline at end of file
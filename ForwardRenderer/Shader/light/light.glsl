@@ -51,6 +51,9 @@ vec3 calcMaterialColor()
 	vec3 specular_col = fromGamma( m_specular.rgb * texture(tex_specular, in_texcoord).rgb);
 	
 	vec3 normal = normalize(in_normal);
+	// face the camera
+	if(dot(normal, u_cameraPosition - in_position) < 0.0)
+		normal = -normal;
 	
 	const vec3 viewDir = normalize(in_position - u_cameraPosition);
 	
@@ -0,0 +1,35 @@
+// decoding of the quantized vertex formats (see ObjModel)
+layout(binding = 3, std140) uniform ubo_vertex
+{
+	// position = u_positionOffset + u_positionScale * in_position
+	vec3 u_positionOffset;
+	// normals are octahedral encoded
+	uint u_octahedralNormals;
+	vec3 u_positionScale;
+};
+
+// per instance transformation (identity for models without instances)
+layout(location = 3) in mat4 in_instanceTransform;
+
+// object to world transformation of the current instance
+mat4 getModelMatrix()
+{
+	return u_model * in_instanceTransform;
+}
+
+vec3 decodePosition(vec4 position)
+{
+	return u_positionOffset + u_positionScale * position.xyz;
+}
+
+// the w component of the quantized position is zero if the vertex has no normal
+vec3 decodeNormal(vec3 normal, vec4 position)
+{
+	if(u_octahedralNormals == 0)
+		return normal;
+
+	vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+	if(n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n) * position.w;
+}
\ No newline at end of file